@@ -17,6 +17,8 @@
 
 #include "aql.h"
 
+#include "aapi.h"
+#include "abuiltin.h"
 #include "acode.h"
 #include "adebug_internal.h"
 #include "ado.h"
@@ -32,24 +34,6 @@
 #include "aerror.h"
 #include "astate.h"
 
-static char *aql_strdup(const char *s) {
-  size_t len;
-  char *copy;
-
-  if (s == NULL) {
-    return NULL;
-  }
-
-  len = strlen(s) + 1;
-  copy = (char *)malloc(len);
-  if (copy == NULL) {
-    return NULL;
-  }
-
-  memcpy(copy, s, len);
-  return copy;
-}
-
 /* Forward declaration for VM execution */
 AQL_API int aqlV_execute(aql_State *L, CallInfo *ci);
 
@@ -105,172 +89,60 @@ AQL_API int aql_loadstring(aql_State *L, const char *source) {
   return 0;
 }
 
+/*
+** Load a chunk from a reader (similar to lua_load). The source is
+** consumed block by block as the lexer advances. 'mode' is NULL or a
+** string of parse options: "r" returns an expression ending the chunk.
+*/
+AQL_API int aql_load(aql_State *L, aql_Reader reader, void *dt,
+                     const char *chunkname, const char *mode) {
+  ZIO z;
+  if (!chunkname) chunkname = "?";
+  aqlZ_init(L, &z, reader, dt);
+  return aqlD_protectedparser(L, &z, chunkname, mode);
+}
+
+/*
+** Stream 'filename' into the parser through a fixed-size block buffer,
+** so even multi-megabyte sources compile with bounded extra memory.
+** Returns the parser status (AQL_OK, AQL_ERRSYNTAX, AQL_ERRMEM), or
+** AQL_ERRFILE when the file cannot be opened.
+*/
+static int loadfile(aql_State *L, const char *filename, const char *mode) {
+  FileReaderData frd;
+  int status;
+  if (!filename || !L)
+    return AQL_ERRFILE;
+  frd.f = fopen(filename, "r");
+  if (!frd.f)
+    return AQL_ERRFILE;
+  status = aql_load(L, aqlZ_file_reader, &frd, filename, mode);
+  fclose(frd.f);
+  return status;
+}
+
 /*
 ** Load a file and compile it with automatic return for last expression
 */
 AQL_API int aql_loadfile_with_return(aql_State *L, const char *filename) {
-  if (!filename || !L) {
-    return -1;
-  }
-  
-  
-  /* Open file */
-  FILE *f = fopen(filename, "r");
-  if (!f) {
-    return -1;
-  }
-  
-  /* Get file size */
-  fseek(f, 0, SEEK_END);
-  long file_size = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  
-  if (file_size < 0) {
-    fclose(f);
-    return -1;
-  }
-  
-  /* Allocate buffer */
-  char *buffer = (char*)malloc(file_size + 1);
-  if (!buffer) {
-    fclose(f);
-    return -1;
-  }
-  
-  /* Read file content */
-  size_t bytes_read = fread(buffer, 1, file_size, f);
-  buffer[bytes_read] = '\0';
-  fclose(f);
-  
-  
-  /* Find the last non-empty line and check if it's an expression */
-  char *last_line_start = NULL;
-  char *p = buffer + bytes_read - 1;
-  
-  
-  /* Skip trailing whitespace */
-  while (p >= buffer && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
-    p--;
-  }
-  
-  if (p >= buffer) {
-    /* Find start of last line */
-    while (p >= buffer && *p != '\n' && *p != '\r') {
-      p--;
-    }
-    last_line_start = p + 1;
-    
-    /* Check if last line looks like an expression (not a statement) */
-      char *line_copy = aql_strdup(last_line_start);
-    if (line_copy) {
-      /* Remove trailing whitespace from line copy */
-      char *end = line_copy + strlen(line_copy) - 1;
-      while (end >= line_copy && (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r')) {
-        *end = '\0';
-        end--;
-      }
-      
-      /* Check if it's not a statement keyword or block delimiter */
-      int is_stmt = (strncmp(line_copy, "let ", 4) == 0 ||
-                     strncmp(line_copy, "if ", 3) == 0 ||
-                     strncmp(line_copy, "while ", 6) == 0 ||
-                     strncmp(line_copy, "for ", 4) == 0 ||
-                     strncmp(line_copy, "function ", 9) == 0 ||
-                     strncmp(line_copy, "return ", 7) == 0 ||
-                     strstr(line_copy, ":=") != NULL ||
-                     strcmp(line_copy, "}") == 0 ||
-                     strcmp(line_copy, "{") == 0);
-      
-      if (!is_stmt && strlen(line_copy) > 0) {
-        /* Last line is an expression, modify buffer to add return */
-        size_t line_start_offset = last_line_start - buffer;
-        size_t line_len = strlen(line_copy);
-        size_t new_size = bytes_read + 7; /* "return " = 7 chars */
-        
-        
-        char *new_buffer = (char*)malloc(new_size + 1);
-        if (new_buffer) {
-          /* Copy everything before last line */
-          memcpy(new_buffer, buffer, line_start_offset);
-          /* Add "return " */
-          memcpy(new_buffer + line_start_offset, "return ", 7);
-          /* Copy the last line */
-          memcpy(new_buffer + line_start_offset + 7, line_copy, line_len);
-          new_buffer[line_start_offset + 7 + line_len] = '\0';
-          
-          free(buffer);
-          buffer = new_buffer;
-          bytes_read = line_start_offset + 7 + line_len;
-          
-        }
-      } else {
-      }
-      free(line_copy);
-    }
-  }
-  
-  /* Compile the (possibly modified) file content */
-  int status = aqlP_compile_string(L, buffer, bytes_read, filename);
-  
-  /* Clean up */
-  free(buffer);
-  
-  if (status == 0) {
-    return 0;
-  } else {
-    return status;
-  }
+  return loadfile(L, filename, "r");
 }
 
 /*
 ** Load a file and compile it (similar to luaL_loadfile)
 */
 AQL_API int aql_loadfile(aql_State *L, const char *filename) {
-  if (!filename || !L) {
-    return -1;
-  }
-  
-  
-  /* Open file */
-  FILE *f = fopen(filename, "r");
-  if (!f) {
-    return -1;
-  }
-  
-  /* Get file size */
-  fseek(f, 0, SEEK_END);
-  long file_size = ftell(f);
-  fseek(f, 0, SEEK_SET);
-  
-  if (file_size < 0) {
-    fclose(f);
-    return -1;
-  }
-  
-  /* Allocate buffer */
-  char *buffer = (char*)malloc(file_size + 1);
-  if (!buffer) {
-    fclose(f);
-    return -1;
-  }
-  
-  /* Read file content */
-  size_t bytes_read = fread(buffer, 1, file_size, f);
-  buffer[bytes_read] = '\0';
-  fclose(f);
-  
-  
-  /* Compile the file content */
-  int status = aqlP_compile_string(L, buffer, bytes_read, filename);
-  
-  /* Clean up */
-  free(buffer);
-  
-  if (status == 0) {
-    return 0;
-  } else {
-    return status;
-  }
+  return loadfile(L, filename, NULL);
+}
+
+/*
+** Register host function 'f' as builtin 'name', callable from scripts
+** compiled afterwards. Returns its id, or -1 when the table is full.
+*/
+AQL_API int aql_registerbuiltin(aql_State *L, const char *name,
+                                aql_BuiltinFunction f,
+                                int minargs, int maxargs) {
+  return aqlB_registerhost(L, name, f, minargs, maxargs);
 }
 
 /*
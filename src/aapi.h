@@ -9,6 +9,11 @@
 
 #include "aql.h"
 
+/* status of 'aql_loadfile' when the file cannot be opened */
+#ifndef AQL_ERRFILE
+#define AQL_ERRFILE     (AQL_ERRERR+1)
+#endif
+
 /* Compilation functions */
 AQL_API int aqlP_compile_string(aql_State *L, const char *code, size_t len, const char *name);
 
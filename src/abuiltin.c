@@ -0,0 +1,613 @@
+/*
+** $Id: abuiltin.c $
+** Native builtin functions
+** See Copyright Notice in aql.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "aql.h"
+#include "abuiltin.h"
+#include "acontainer.h"
+#include "adict.h"
+#include "ado.h"
+#include "agc.h"
+#include "amem.h"
+#include "arange.h"
+#include "astring.h"
+#include "avm.h"
+#include "azio.h"
+
+
+/*
+** {======================================================
+** Registry
+** =======================================================
+*/
+
+/*
+** Entry for 'name': the existing one, so that code compiled earlier
+** keeps calling through the same id, or a new one. Returns -1 when
+** the table is full.
+*/
+static int newentry (aql_State *L, const char *name) {
+  global_State *g = G(L);
+  int id = aqlB_lookup(L, name);
+  if (id < 0) {
+    if (g->nbuiltins >= AQL_MAXBUILTINS)
+      return -1;
+    if (g->nbuiltins >= g->sizebuiltins) {
+      int newsize = (g->sizebuiltins == 0) ? 32 : g->sizebuiltins * 2;
+      if (newsize > AQL_MAXBUILTINS)
+        newsize = AQL_MAXBUILTINS;
+      g->builtins = aqlM_reallocvector(L, g->builtins, g->sizebuiltins,
+                                       newsize, Builtin);
+      g->sizebuiltins = newsize;
+    }
+    id = g->nbuiltins++;
+  }
+  return id;
+}
+
+
+static void setentry (aql_State *L, int id, const char *name,
+                      aql_Builtin fn, aql_BuiltinFunction host,
+                      int minargs, int maxargs) {
+  Builtin *b = &G(L)->builtins[id];
+  b->name = name;
+  b->fn = fn;
+  b->host = host;
+  b->minargs = minargs;
+  b->maxargs = maxargs;
+}
+
+
+/*
+** Register 'fn' under 'name' and return its id, or -1 when the table
+** is full. 'name' is not copied: it must outlive the state.
+*/
+int aqlB_register (aql_State *L, const char *name, aql_Builtin fn,
+                   int minargs, int maxargs) {
+  int id = newentry(L, name);
+  if (id >= 0)
+    setentry(L, id, name, fn, NULL, minargs, maxargs);
+  return id;
+}
+
+
+/*
+** Register host function 'f' under 'name' (see 'aql_registerbuiltin').
+** The name is interned and fixed, so the caller's copy may go away.
+*/
+int aqlB_registerhost (aql_State *L, const char *name,
+                       aql_BuiltinFunction f, int minargs, int maxargs) {
+  int id = newentry(L, name);
+  if (id >= 0) {
+    TString *ts = aqlStr_new(L, name);
+    aqlC_fix(L, obj2gco(ts));
+    setentry(L, id, getstr(ts), NULL, f, minargs, maxargs);
+  }
+  return id;
+}
+
+
+/* id of builtin 'name', or -1 */
+int aqlB_lookup (aql_State *L, const char *name) {
+  global_State *g = G(L);
+  int i;
+  for (i = 0; i < g->nbuiltins; i++) {
+    if (strcmp(g->builtins[i].name, name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+
+void aqlB_arityerror (aql_State *L, const Builtin *b, int nargs) {
+  aqlG_runerror(L, "wrong number of arguments to '%s' (%d given)",
+                b->name, nargs);
+}
+
+
+/*
+** Call builtin 'id' with the call slot at 'func' (used by OP_CALL on a
+** builtin value; OP_CALLBUILTIN inlines the same steps)
+*/
+void aqlB_call (aql_State *L, StkId func, int id, int nargs) {
+  const Builtin *b;
+  if (l_unlikely(id < 0 || id >= G(L)->nbuiltins))
+    aqlG_runerror(L, "unknown builtin function #%d", id);
+  b = aqlB_get(L, id);
+  if (l_unlikely(!aqlB_checkarity(b, nargs)))
+    aqlB_arityerror(L, b, nargs);
+  if (b->fn != NULL)
+    b->fn(L, func, nargs);
+  else
+    aqlB_callhost(L, b, func, nargs);
+}
+
+
+/*
+** Run host builtin 'b' with its arguments at 'res + 1 ...'. The host
+** sees them as stack indices of the current frame and pushes above
+** them; its result (or nil) ends in 'res'. The stack may be
+** reallocated, so a Lua-style caller must reload its base.
+*/
+void aqlB_callhost (aql_State *L, const Builtin *b, StkId res, int nargs) {
+  CallInfo *ci = L->ci;
+  ptrdiff_t r = savestack(L, res);
+  StkId oldstack = L->stack.p;
+  int base = cast_int(res + 1 - ci->func.p);
+  int n;
+  L->top.p = res + 1 + nargs;
+  aqlD_checkstack(L, AQL_MINSTACK);
+  if (L->stack.p != oldstack && !(ci->callstatus & CIST_C))
+    ci->u.l.trap = 1;
+  n = b->host(L, base, nargs);
+  res = restorestack(L, r);
+  if (n > 0) {
+    setobjs2s(L, res, L->top.p - 1);
+  }
+  else
+    setnilvalue(s2v(res));
+  L->top.p = ci->top.p;
+}
+
+
+void aqlB_free (aql_State *L) {
+  global_State *g = G(L);
+  aqlM_freearray(L, g->builtins, cast_sizet(g->sizebuiltins));
+  g->builtins = NULL;
+  g->nbuiltins = g->sizebuiltins = 0;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** Standard builtins
+** =======================================================
+*/
+
+#define arg(res,n)	s2v((res) + (n))
+
+
+/*
+** Append the printed form of 'v' to the output buffer
+*/
+static void outvalue (aql_State *L, const TValue *v) {
+  char *p;
+  switch (ttypetag(v)) {
+    case AQL_VSHRSTR: case AQL_VLNGSTR:
+      aqlZ_outwrite(L, getstr(tsvalue(v)), tsslen(tsvalue(v)));
+      break;
+    case AQL_VBUILDER:
+      aqlZ_outwrite(L, buildervalue(v)->buff, buildervalue(v)->len);
+      break;
+    case AQL_VNUMINT:  /* format in place */
+      p = aqlZ_outspace(L, MAXNUMBER2STR);
+      aqlZ_outaddsize(L, aqlO_fmtint(p, ivalue(v)));
+      break;
+    case AQL_VNUMFLT:
+      p = aqlZ_outspace(L, MAXNUMBER2STR);
+      aqlZ_outaddsize(L, aqlO_fmtflt(p, fltvalue(v)));
+      break;
+    case AQL_VTRUE:
+      aqlZ_outwrite(L, "true", 4);
+      break;
+    case AQL_VFALSE:
+      aqlZ_outwrite(L, "false", 5);
+      break;
+    default: {
+      char buff[3 * MAXNUMBER2STR];
+      int n;
+      if (ttisnil(v)) {  /* any nil variant */
+        aqlZ_outwrite(L, "nil", 3);
+        break;
+      }
+      if (ttisthread(v))
+        n = snprintf(buff, sizeof(buff), "coroutine: %p", (void *)thvalue(v));
+      else if (ttisrange(v)) {
+        RangeObject *range = rangevalue(v);
+        n = snprintf(buff, sizeof(buff), "range(%lld, %lld, %lld)",
+                     (long long)range->start, (long long)range->stop,
+                     (long long)range->step);
+      }
+      else
+        n = snprintf(buff, sizeof(buff), "(unknown type %d)", ttype(v));
+      aqlZ_outwrite(L, buff, n);
+      break;
+    }
+  }
+}
+
+
+static void b_print (aql_State *L, StkId res, int nargs) {
+  int j;
+  for (j = 1; j <= nargs; j++) {
+    if (j > 1)
+      aqlZ_outwrite(L, "\t", 1);
+    outvalue(L, arg(res, j));
+  }
+  if (nargs > 0) {
+    aqlZ_outwrite(L, "\n", 1);
+    aqlZ_outendline(L);
+  }
+  setnilvalue(s2v(res));
+}
+
+
+static void b_type (aql_State *L, StkId res, int nargs) {
+  static const char *const names[AQL_NUMTYPES] = {
+    "nil", "boolean", "userdata", "number", "string", "table",
+    "function", "userdata", "thread", "array", "slice", "dict",
+    "function", "vector", "range", "builder"
+  };
+  UNUSED(nargs);
+  setsvalue2s(L, res, aqlStr_new(L, names[ttype(arg(res, 1))]));
+}
+
+
+static void b_len (aql_State *L, StkId res, int nargs) {
+  UNUSED(nargs);
+  aqlV_objlen(L, res, arg(res, 1));
+}
+
+
+static void b_tostring (aql_State *L, StkId res, int nargs) {
+  const TValue *v = arg(res, 1);
+  UNUSED(nargs);
+  if (ttisstring(v)) {
+    setobjs2s(L, res, res + 1);
+  }
+  else if (ttisnumber(v)) {
+    setsvalue2s(L, res, aqlStr_fromnumber(L, v));
+  }
+  else if (ttisboolean(v)) {
+    setsvalue2s(L, res, aqlStr_new(L, bvalue(v) ? "true" : "false"));
+  }
+  else if (ttisnil(v)) {
+    setsvalue2s(L, res, aqlStr_new(L, "nil"));
+  }
+  else {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "(type %d)", ttype(v));
+    setsvalue2s(L, res, aqlStr_newlazy(L, buffer, strlen(buffer)));
+  }
+}
+
+
+/* tonumber(v): number, or nil if not a numeral */
+static void b_tonumber (aql_State *L, StkId res, int nargs) {
+  TValue *v = arg(res, 1);
+  UNUSED(nargs);
+  if (ttisnumber(v)) {
+    setobjs2s(L, res, res + 1);
+  }
+  else if (!(ttisstring(v) &&  /* not converted in place? */
+             aqlO_str2num(getstr(tsvalue(v)), s2v(res)) == tsslen(tsvalue(v)) + 1)) {
+    setnilvalue(s2v(res));
+  }
+}
+
+
+/* range(stop) | range(start, stop) | range(start, stop, step) */
+static void b_range (aql_State *L, StkId res, int nargs) {
+  aql_Integer start = 0, stop, step = 1;
+  RangeObject *range;
+  int j;
+  for (j = 1; j <= nargs; j++) {
+    if (!ttisinteger(arg(res, j))) {
+      setnilvalue(s2v(res));
+      return;
+    }
+  }
+  if (nargs == 1)
+    stop = ivalue(arg(res, 1));
+  else {
+    start = ivalue(arg(res, 1));
+    stop = ivalue(arg(res, 2));
+    step = (nargs == 3) ? ivalue(arg(res, 3)) : aqlR_infer_step(start, stop);
+  }
+  range = aqlR_new(L, start, stop, step);
+  if (range == NULL) {
+    setnilvalue(s2v(res));
+  }
+  else {
+    setrangevalue(L, s2v(res), range);
+  }
+}
+
+
+/*
+** slice(seq, i [, j]): elements [i, j) of 'seq', bounds clamped. A range
+** yields a new range in O(1); an array or slice yields a copy of the
+** same kind.
+*/
+static void b_slice (aql_State *L, StkId res, int nargs) {
+  const TValue *seq = arg(res, 1);
+  aql_Integer i, j;
+  if (!ttisinteger(arg(res, 2)) || (nargs == 3 && !ttisinteger(arg(res, 3))))
+    aqlG_runerror(L, "bad arguments to 'slice' (integer bounds expected)");
+  i = ivalue(arg(res, 2));
+  if (ttisrange(seq)) {
+    RangeObject *r = rangevalue(seq);
+    j = (nargs == 3) ? ivalue(arg(res, 3)) : r->count;
+    setrangevalue(L, s2v(res), aqlR_slice(L, r, i, j));
+  }
+  else if (ttisarray(seq) || ttisslice(seq)) {
+    AQL_ContainerBase *c = containervalue(seq);
+    AQL_ContainerBase *sub;
+    aql_Integer n = l_castU2S(c->length);
+    size_t esize = acontainer_elem_size(c);
+    j = (nargs == 3) ? ivalue(arg(res, 3)) : n;
+    if (i < 0) i = 0;
+    if (j > n) j = n;
+    if (j < i) j = i;
+    sub = acontainer_new(L, c->type, c->dtype, cast_sizet(j - i));
+    if (sub == NULL)
+      aqlG_runerror(L, "not enough memory");
+    if (j > i)
+      memcpy(sub->data, cast_charp(c->data) + cast_sizet(i) * esize,
+             cast_sizet(j - i) * esize);
+    sub->length = cast_sizet(j - i);
+    setcontainervalue(L, s2v(res), sub);
+  }
+  else
+    aqlG_runerror(L, "bad argument #1 to 'slice' (range, array or slice expected)");
+}
+
+
+/* dict([capacity]): empty hash dict with room for 'capacity' entries */
+static void b_dict (aql_State *L, StkId res, int nargs) {
+  size_t size = 0;
+  if (nargs >= 1 && ttisinteger(arg(res, 1)) && ivalue(arg(res, 1)) > 0)
+    size = cast_sizet(ivalue(arg(res, 1)));
+  setdictvalue(L, s2v(res), aqlD_newcap(L, AQL_DATA_TYPE_ANY,
+                                        AQL_DATA_TYPE_ANY, size));
+}
+
+
+/* ordered([capacity]): empty compact dict, iterated in insertion order */
+static void b_ordered (aql_State *L, StkId res, int nargs) {
+  size_t size = 0;
+  if (nargs >= 1 && ttisinteger(arg(res, 1)) && ivalue(arg(res, 1)) > 0)
+    size = cast_sizet(ivalue(arg(res, 1)));
+  setdictvalue(L, s2v(res), aqlD_newcompact(L, AQL_DATA_TYPE_ANY,
+                                            AQL_DATA_TYPE_ANY, size));
+}
+
+
+/* builder([capacity]) */
+static void b_builder (aql_State *L, StkId res, int nargs) {
+  size_t size = 0;
+  if (nargs >= 1 && ttisinteger(arg(res, 1)) && ivalue(arg(res, 1)) > 0)
+    size = cast_sizet(ivalue(arg(res, 1)));
+  setbuildervalue(L, s2v(res), aqlStr_newbuilder(L, size));
+}
+
+
+/* append(builder, ...): returns the builder */
+static void b_append (aql_State *L, StkId res, int nargs) {
+  StrBuilder *sb;
+  int j;
+  if (!ttisbuilder(arg(res, 1)))
+    aqlG_runerror(L, "bad argument #1 to 'append' (builder expected)");
+  sb = buildervalue(arg(res, 1));
+  for (j = 2; j <= nargs; j++)
+    aqlStr_bappendvalue(L, sb, arg(res, j));
+  setobjs2s(L, res, res + 1);
+}
+
+
+/* build(builder): contents as a string */
+static void b_build (aql_State *L, StkId res, int nargs) {
+  UNUSED(nargs);
+  if (!ttisbuilder(arg(res, 1)))
+    aqlG_runerror(L, "bad argument #1 to 'build' (builder expected)");
+  setsvalue2s(L, res, aqlStr_bbuild(L, buildervalue(arg(res, 1))));
+}
+
+
+/* split(s, sep): array of pieces */
+static void b_split (aql_State *L, StkId res, int nargs) {
+  TString *str, *sep;
+  AQL_ContainerBase *parts;
+  const char *p, *e;
+  size_t lsep, npieces, j;
+  UNUSED(nargs);
+  if (!ttisstring(arg(res, 1)) || !ttisstring(arg(res, 2)))
+    aqlG_runerror(L, "bad arguments to 'split' (string, string expected)");
+  str = tsvalue(arg(res, 1));
+  sep = tsvalue(arg(res, 2));
+  lsep = tsslen(sep);
+  if (lsep == 0)
+    aqlG_runerror(L, "bad argument #2 to 'split' (empty separator)");
+  npieces = aqlStr_count(str, sep) + 1;
+  parts = acontainer_new(L, CONTAINER_ARRAY, AQL_DATA_TYPE_ANY, npieces);
+  if (parts == NULL)
+    aqlG_runerror(L, "cannot allocate split result");
+  p = getstr(str);
+  e = p + tsslen(str);
+  for (j = 0; j < npieces; j++) {
+    const char *m = (j + 1 < npieces)
+        ? aqlStr_search(p, cast_sizet(e - p), getstr(sep), lsep) : e;
+    TValue piece;
+    setsvalue(L, &piece, aqlStr_newlazy(L, p, cast_sizet(m - p)));
+    acontainer_array_set(L, parts, j, &piece);
+    p = m + lsep;
+  }
+  setcontainervalue(L, s2v(res), parts);
+}
+
+
+static void checkstrings (aql_State *L, StkId res, const char *fname) {
+  if (!ttisstring(arg(res, 1)) || !ttisstring(arg(res, 2)))
+    aqlG_runerror(L, "bad arguments to '%s' (string, string expected)", fname);
+}
+
+
+/* count(s, sub) */
+static void b_count (aql_State *L, StkId res, int nargs) {
+  UNUSED(nargs);
+  checkstrings(L, res, "count");
+  setivalue(s2v(res), l_castU2S(aqlStr_count(tsvalue(arg(res, 1)),
+                                             tsvalue(arg(res, 2)))));
+}
+
+
+/* contains(s, sub) */
+static void b_contains (aql_State *L, StkId res, int nargs) {
+  TString *str, *sub;
+  UNUSED(nargs);
+  checkstrings(L, res, "contains");
+  str = tsvalue(arg(res, 1));
+  sub = tsvalue(arg(res, 2));
+  if (aqlStr_search(getstr(str), tsslen(str), getstr(sub), tsslen(sub)) != NULL) {
+    setbtvalue(s2v(res));
+  }
+  else {
+    setbfvalue(s2v(res));
+  }
+}
+
+
+/* flush([mode]) */
+static void b_flush (aql_State *L, StkId res, int nargs) {
+  if (nargs == 1 && (!ttisstring(arg(res, 1)) ||
+                     !aqlZ_setoutmode(L, getstr(tsvalue(arg(res, 1))))))
+    aqlG_runerror(L, "bad argument to 'flush' "
+                     "(\"line\", \"block\" or \"explicit\" expected)");
+  aqlZ_outflush(L);
+  setnilvalue(s2v(res));
+}
+
+
+/* tonumbers(seq [, "int"|"float"]): typed vector */
+static void b_tonumbers (aql_State *L, StkId res, int nargs) {
+  DataType dt = AQL_DATA_TYPE_ANY;
+  AQL_ContainerBase *vec;
+  size_t bad;
+  if (!ttiscontainer(arg(res, 1)) ||
+      containervalue(arg(res, 1))->type == CONTAINER_DICT)
+    aqlG_runerror(L, "bad argument #1 to 'tonumbers' (sequence expected)");
+  if (nargs == 2) {
+    const char *t = ttisstring(arg(res, 2)) ? getstr(tsvalue(arg(res, 2))) : "";
+    if (strcmp(t, "int") == 0) dt = AQL_DATA_TYPE_INT64;
+    else if (strcmp(t, "float") == 0) dt = AQL_DATA_TYPE_FLOAT64;
+    else
+      aqlG_runerror(L, "bad argument #2 to 'tonumbers' "
+                       "(\"int\" or \"float\" expected)");
+  }
+  vec = acontainer_vector_parse(L, containervalue(arg(res, 1)), dt, &bad);
+  if (vec == NULL)
+    aqlG_runerror(L, "tonumbers: element %d is not a valid %s", (int)bad,
+                  dt == AQL_DATA_TYPE_INT64 ? "integer" : "number");
+  setcontainervalue(L, s2v(res), vec);
+}
+
+
+/*
+** Coroutines. A coroutine is a thread running a function; 'yield'
+** suspends it with one value and the next 'resume' continues it, the
+** value passed to 'resume' becoming the value of the 'yield'
+** expression. See 'resume' in ado.c.
+*/
+
+/* coroutine(f): new suspended coroutine that will run 'f' */
+static void b_coroutine (aql_State *L, StkId res, int nargs) {
+  aql_State *co;
+  UNUSED(nargs);
+  if (!ttisclosure(arg(res, 1)))
+    aqlG_runerror(L, "bad argument #1 to 'coroutine' (function expected)");
+  co = aql_newthread(L);  /* pushed on L's top */
+  L->top.p--;
+  setobj2s(co, co->top.p, arg(res, 1));  /* body to call on first resume */
+  co->top.p++;
+  setthvalue2s(L, res, co);
+}
+
+
+static aql_State *checkco (aql_State *L, StkId res, const char *fname) {
+  if (!ttisthread(arg(res, 1)))
+    aqlG_runerror(L, "bad argument #1 to '%s' (coroutine expected)", fname);
+  return thvalue(arg(res, 1));
+}
+
+
+/* resume(co [, v]): run 'co' until it yields; the yielded (or returned) value */
+static void b_resume (aql_State *L, StkId res, int nargs) {
+  aql_State *co = checkco(L, res, "resume");
+  aqlD_resumeco(L, co, (nargs > 1) ? arg(res, 2) : NULL, res);
+}
+
+
+static void b_costatus (aql_State *L, StkId res, int nargs) {
+  static const char *const names[] = {
+    "running", "suspended", "normal", "dead"
+  };
+  aql_State *co = checkco(L, res, "costatus");
+  UNUSED(nargs);
+  setsvalue2s(L, res, aqlStr_new(L, names[aqlD_costatus(L, co)]));
+}
+
+
+/* yield [v] (keyword syntax): its slot is left on top for 'resume' */
+static void b_yield (aql_State *L, StkId res, int nargs) {
+  if (nargs == 0) {
+    setnilvalue(s2v(res));
+  }
+  else {
+    setobjs2s(L, res, res + 1);
+  }
+  L->top.p = res + 1;
+  aql_yield(L, 1);
+}
+
+
+/*
+** Standard builtins, registered in this order so that their ids match
+** the ones of older bytecode (OP_LOADBUILTIN B).
+*/
+static const struct {
+  const char *name;
+  aql_Builtin fn;
+  int minargs;
+  int maxargs;
+} stdbuiltins[] = {
+  {"print", b_print, 0, AQL_BUILTIN_VARARG},
+  {"type", b_type, 1, 1},
+  {"len", b_len, 1, 1},
+  {"tostring", b_tostring, 1, 1},
+  {"tonumber", b_tonumber, 1, 1},
+  {"range", b_range, 1, 3},
+  {"builder", b_builder, 0, 1},
+  {"append", b_append, 1, AQL_BUILTIN_VARARG},
+  {"build", b_build, 1, 1},
+  {"split", b_split, 2, 2},
+  {"count", b_count, 2, 2},
+  {"contains", b_contains, 2, 2},
+  {"flush", b_flush, 0, 1},
+  {"tonumbers", b_tonumbers, 1, 2},
+  {"string", b_tostring, 1, 1},  /* alias for tostring */
+  {"coroutine", b_coroutine, 1, 1},
+  {"resume", b_resume, 1, 2},
+  {"costatus", b_costatus, 1, 1},
+  {"yield", b_yield, 0, 1},  /* keyword: see 'yieldexp' */
+  {"slice", b_slice, 2, 3},
+  {"ordered", b_ordered, 0, 1},
+  {"dict", b_dict, 0, 1},
+  {NULL, NULL, 0, 0}
+};
+
+
+void aqlB_init (aql_State *L) {
+  int i;
+  for (i = 0; stdbuiltins[i].name != NULL; i++)
+    aqlB_register(L, stdbuiltins[i].name, stdbuiltins[i].fn,
+                  stdbuiltins[i].minargs, stdbuiltins[i].maxargs);
+}
+
+/* }====================================================== */
@@ -0,0 +1,58 @@
+/*
+** $Id: abuiltin.h $
+** Native builtin functions
+** See Copyright Notice in aql.h
+*/
+
+#ifndef abuiltin_h
+#define abuiltin_h
+
+#include "aql.h"
+#include "aobject.h"
+#include "aopcodes.h"
+#include "astate.h"
+
+/*
+** A native builtin. The call slot 'res' is followed by its 'nargs'
+** arguments ('res + 1' ... 'res + nargs'); the single result is stored
+** back into 'res'. Arity has already been checked against the entry.
+** Builtins run without a CallInfo of their own, so they must not grow
+** the stack; errors are raised with 'aqlG_runerror'.
+*/
+typedef void (*aql_Builtin) (aql_State *L, StkId res, int nargs);
+
+/* ids are encoded in an instruction operand (OP_CALLBUILTIN C) */
+#define AQL_MAXBUILTINS	(MAXARG_C + 1)
+
+typedef struct Builtin {
+  const char *name;
+  aql_Builtin fn;  /* NULL for a host builtin */
+  int minargs;
+  int maxargs;  /* AQL_BUILTIN_VARARG if unbounded */
+  aql_BuiltinFunction host;  /* set by 'aql_registerbuiltin' */
+} Builtin;
+
+/* entry for id 'id' (no range check) */
+#define aqlB_get(L,id)	(&G(L)->builtins[id])
+
+/* does 'b' accept 'n' arguments? */
+#define aqlB_checkarity(b,n) \
+  ((n) >= (b)->minargs && ((b)->maxargs < 0 || (n) <= (b)->maxargs))
+
+/*
+** Internal to the core: these work directly on stack slots (StkId),
+** which are not part of the public API. Hosts add builtins with
+** 'aql_registerbuiltin' (aql.h).
+*/
+int aqlB_register (aql_State *L, const char *name, aql_Builtin fn,
+                   int minargs, int maxargs);
+int aqlB_registerhost (aql_State *L, const char *name,
+                       aql_BuiltinFunction f, int minargs, int maxargs);
+int aqlB_lookup (aql_State *L, const char *name);
+void aqlB_call (aql_State *L, StkId func, int id, int nargs);
+void aqlB_callhost (aql_State *L, const Builtin *b, StkId res, int nargs);
+void aqlB_arityerror (aql_State *L, const Builtin *b, int nargs);
+void aqlB_init (aql_State *L);
+void aqlB_free (aql_State *L);
+
+#endif
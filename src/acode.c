@@ -24,6 +24,7 @@
 #include "aobject.h"
 #include "aopcodes.h"
 #include "aparser.h"
+#include "ajit.h"
 #include "astring.h"
 #include "acontainer.h"
 
@@ -106,12 +107,16 @@ static void const2exp (TValue *v, expdesc *e) {
 ** 'e' must be a multi-ret expression (function call or vararg).
 */
 void aqlK_setreturns (FuncState *fs, expdesc *e, int nresults) {
-  Instruction *pc = &fs->f->code[e->u.info];
+  Instruction *pc;
   if (e->k == VCALL) {  /* expression is an open function call? */
+    if (nresults != 0 && nresults != 1)
+      e->u.info = aqlK_uninline(fs, e->u.info);
+    pc = &fs->f->code[e->u.info];
     SETARG_C(*pc, nresults + 1);
   }
   else {
     aql_assert(e->k == VVARARG);
+    pc = &fs->f->code[e->u.info];
     SETARG_C(*pc, nresults + 1);
     SETARG_A(*pc, fs->freereg);
     aqlK_reserveregs(fs, 1);
@@ -168,41 +173,31 @@ void aqlK_dischargevars (FuncState *fs, expdesc *e) {
       break;
     }
     case VUPVAL: {  /* move value to some (pending) register */
-      int reg = fs->freereg++;  /* allocate register for result */
-      //aql_debug("[DEBUG] aqlK_dischargevars: VUPVAL using register %d (freereg was %d)\n", reg, fs->freereg - 1);
-      e->u.info = aqlK_codeABC(fs, OP_GETUPVAL, reg, e->u.info, 0);
+      e->u.info = aqlK_codeABC(fs, OP_GETUPVAL, 0, e->u.info, 0);
       e->k = VRELOC;
       break;
     }
     case VINDEXUP: {
-      int reg = fs->freereg++;  /* allocate register for result */
-      //aql_debug("[DEBUG] aqlK_dischargevars: VINDEXUP using register %d (freereg was %d)\n", reg, fs->freereg - 1);
-      e->u.info = aqlK_codeABC(fs, OP_GETTABUP, reg, e->u.ind.t, e->u.ind.idx);
+      e->u.info = aqlK_codeABC(fs, OP_GETTABUP, 0, e->u.ind.t, e->u.ind.idx);
       e->k = VRELOC;
       break;
     }
     case VINDEXED: {
-      int reg = fs->freereg++;  /* allocate register for result */
-      //aql_debug("[DEBUG] aqlK_dischargevars: VINDEXED using register %d (freereg was %d)\n", reg, fs->freereg - 1);
-      aqlK_codeABC(fs, OP_GETTABUP, reg, e->u.ind.t, e->u.ind.idx);
+      aqlK_codeABC(fs, OP_GETTABUP, 0, e->u.ind.t, e->u.ind.idx);
       e->u.info = fs->pc - 1;
       e->k = VRELOC;
       break;
     }
     case VINDEXI: {
       /* Use GETTABUP for integer indexing */
-      int reg = fs->freereg++;  /* allocate register for result */
-      //aql_debug("[DEBUG] aqlK_dischargevars: VINDEXI using register %d (freereg was %d)\n", reg, fs->freereg - 1);
-      aqlK_codeABC(fs, OP_GETTABUP, reg, e->u.ind.t, e->u.ind.idx);
+      aqlK_codeABC(fs, OP_GETTABUP, 0, e->u.ind.t, e->u.ind.idx);
       e->u.info = fs->pc - 1;
       e->k = VRELOC;
       break;
     }
     case VINDEXSTR: {
       /* Use GETTABUP for string indexing */
-      int reg = fs->freereg++;  /* allocate register for result */
-      //aql_debug("[DEBUG] aqlK_dischargevars: VINDEXSTR using register %d (freereg was %d)\n", reg, fs->freereg - 1);
-      aqlK_codeABC(fs, OP_GETTABUP, reg, e->u.ind.t, e->u.ind.idx);
+      aqlK_codeABC(fs, OP_GETTABUP, 0, e->u.ind.t, e->u.ind.idx);
       e->u.info = fs->pc - 1;
       e->k = VRELOC;
       break;
@@ -749,6 +744,9 @@ int aqlK_addk (FuncState *fs, TValue *key, TValue *v) {
       if (ttisstring(v) && ttisstring(&f->k[k]) && tsvalue(v) == tsvalue(&f->k[k])) {
         return k;  /* reuse index */
       }
+      if (ttislightuserdata(v) && pvalue(v) == pvalue(&f->k[k])) {
+        return k;  /* reuse index */
+      }
     }
   }
   
@@ -1129,29 +1127,13 @@ static int jumponcond (FuncState *fs, expdesc *e, int cond) {
     Instruction ie = getinstruction(fs, e);
     if (GET_OPCODE(ie) == OP_NOT) {
       removelastinstruction(fs);  /* remove previous OP_NOT */
-      
-      /* CRITICAL FIX: Allocate a safe register for TEST result */
-      int active_var_level = aqlY_nvarstack(fs);
-      int result_reg = (fs->freereg > active_var_level) ? fs->freereg : active_var_level;
-      
-      /* Update freereg to point past the allocated register */
-      fs->freereg = result_reg + 1;
-      
-      return condjump(fs, OP_TEST, result_reg, GETARG_B(ie), !cond, GETARG_k(ie));
+      return condjump(fs, OP_TEST, GETARG_B(ie), 0, 0, !cond);
     }
     /* else go through */
   }
   discharge2anyreg(fs, e);
   aqlK_freeexp(fs, e);
-  
-  /* CRITICAL FIX: Allocate a safe register for TESTSET result */
-  int active_var_level = aqlY_nvarstack(fs);
-  int result_reg = (fs->freereg > active_var_level) ? fs->freereg : active_var_level;
-  
-  /* Update freereg to point past the allocated register */
-  fs->freereg = result_reg + 1;
-  
-  return condjump(fs, OP_TESTSET, result_reg, e->u.info, 0, cond);
+  return condjump(fs, OP_TESTSET, NO_REG, e->u.info, 0, cond);
 }
 
 /*
@@ -1241,17 +1223,8 @@ static void codenot (FuncState *fs, expdesc *e) {
     case VNONRELOC: {
       discharge2anyreg(fs, e);
       aqlK_freeexp(fs, e);
-      
-      /* CRITICAL FIX: Allocate a safe register for NOT result */
-      /* Don't use register 0 as it may contain active local variables */
-      int active_var_level = aqlY_nvarstack(fs);  /* Level of active variables */
-      int result_reg = (fs->freereg > active_var_level) ? fs->freereg : active_var_level;
-      
-      e->u.info = aqlK_codeABC(fs, OP_NOT, result_reg, e->u.info, 0);
+      e->u.info = aqlK_codeABC(fs, OP_NOT, 0, e->u.info, 0);
       e->k = VRELOC;
-      
-      /* Update freereg to point past the allocated register */
-      fs->freereg = result_reg + 1;
       break;
     }
     default: aql_assert(0);  /* cannot happen */
@@ -1273,7 +1246,7 @@ void aqlK_indexed (FuncState *fs, expdesc *t, expdesc *k) {
     str2K(fs, k);
   aql_assert(!hasjumps(t) &&
              (vkisinreg(t->k) || t->k == VUPVAL));
-  int reg = fs->freereg++;  /* allocate register for result */
+  int reg = aqlK_reserveregs(fs, 1);  /* allocate register for result */
   aql_debug("[DEBUG] aqlK_indexed: using register %d (freereg was %d)\n", reg, fs->freereg - 1);
   if (t->k == VUPVAL && !vkisvar(k->k))  /* upvalue indexed by constant? */
     aqlK_codeABC(fs, OP_GETTABUP, reg, t->u.info, aqlK_exp2RK(fs, k));
@@ -1332,40 +1305,40 @@ static void codecomp (FuncState *fs, BinOpr opr, expdesc *e1, expdesc *e2, int l
 }
 
 /*
-** Emit code to adjust stack to 'nvars' values. If there are no
-** multret expressions, then number of values is 'nexps'.
-** Otherwise, use 'nexps' as a minimum.
+** Emit a SETLIST instruction.
+** 'base' is the register that keeps the container;
+** 'nelems' is #container before this batch (the 0-based slot of the
+** first stored value);
+** 'tostore' is number of values (in registers 'base + 1',...) to add to
+** the container (or AQL_MULTRET to add up to stack top).
 */
 void aqlK_setlist (FuncState *fs, int base, int nelems, int tostore) {
-  /* AQL uses containers instead of tables */
-  int b = (tostore == AQL_MULTRET) ? 0 : tostore;
-  /* Simplified: use SETPROP for container element setting */
-  for (int i = 0; i < nelems; i++) {
-    aqlK_codeABC(fs, OP_SETPROP, base, i, base + i + 1);
+  aql_assert(tostore != 0 && tostore <= LFIELDS_PER_FLUSH);
+  if (tostore == AQL_MULTRET)
+    tostore = 0;
+  if (nelems <= MAXARG_C)
+    aqlK_codeABC(fs, OP_SETLIST, base, tostore, nelems);
+  else {
+    int extra = nelems / (MAXARG_C + 1);
+    nelems %= (MAXARG_C + 1);
+    aqlK_codeABCk(fs, OP_SETLIST, base, tostore, nelems, 1);
+    aqlK_codeextraarg(fs, extra);
   }
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
 /*
-** Emit bytecode to create a new table. Parameter 'pc' is the address
-** of the OP_NEWTABLE instruction that creates the table (or its previous
-** instruction). Parameter 'ra' is the register where the table will be
-** stored. Parameter 'b' and 'c' are the number of array elements and
-** hash elements, respectively.
+** Fix the size operand of an OP_NEWOBJECT emitted before its elements
+** were known. Parameter 'pc' is the address of that instruction, which
+** is always followed by an OP_EXTRAARG holding the high part of 'size';
+** 'k' tells the VM to consume it.
 */
-void aqlK_settablesize (FuncState *fs, int pc, int ra, int asize, int hsize) {
+void aqlK_setobjectsize (FuncState *fs, int pc, int ra, int type, int size) {
   Instruction *inst = &fs->f->code[pc];
-  int rb = (asize > 0) ? aqlO_ceillog2(asize) + 1 : 0;  /* encode array size */
-  int extra = asize - ((1 << (rb - 1)) - 1);  /* extra elements */
-  int rc = (hsize > 0) ? aqlO_ceillog2(hsize) + 1 : 0;   /* encode hash size */
-  if (GETARG_B(*inst) != rb || GETARG_C(*inst) != rc) {
-    /* redo instruction if 'b' or 'c' changed */
-    *inst = CREATE_ABC(OP_NEWOBJECT, ra, rb, rc);
-  }
-  if (extra > 0) {
-    /* will set extra elements in auxiliary instruction */
-    aqlK_codeextraarg(fs, extra);
-  }
+  int extra = size / (MAXARG_C + 1);
+  int rc = size % (MAXARG_C + 1);
+  *inst = CREATE_ABCk(OP_NEWOBJECT, ra, type, rc, 1);
+  *(inst + 1) = CREATE_Ax(OP_EXTRAARG, extra);
 }
 
 /*
@@ -1427,6 +1400,48 @@ int aqlK_retk (FuncState *fs, int first, int nret, int k) {
   return fs->pc - 1;
 }
 
+/*
+** One past the highest register instruction 'i' reads or writes (0 if
+** it touches none). Multi-register operands follow the layouts listed
+** in aopcodes.h.
+*/
+static int regbound (Instruction i) {
+  OpCode op = GET_OPCODE(i);
+  int a = GETARG_A(i);
+  switch (op) {
+    case OP_JMP: case OP_EXTRAARG: case OP_SETTABUP: case OP_RETURN0:
+      return 0;
+    case OP_LOADNIL:
+      return a + GETARG_B(i) + 1;
+    case OP_SELF:
+      return a + 2;
+    case OP_CONCAT:
+      return a + GETARG_B(i);
+    case OP_CALL: {
+      int b = GETARG_B(i), c = GETARG_C(i);
+      int n = (b > 0) ? a + b : a + 1;
+      return (a + c - 1 > n) ? a + c - 1 : n;
+    }
+    case OP_TAILCALL: case OP_RETURN:
+      return (GETARG_B(i) > 0) ? a + GETARG_B(i) : a + 1;
+    case OP_FORPREP: case OP_FORLOOP:
+      return a + 4;  /* 3 internal slots + control variable */
+    case OP_TFORPREP: case OP_TFORLOOP:
+    case OP_ITER_INIT: case OP_ITER_NEXT:
+      return a + 5;
+    case OP_TFORCALL: {  /* call is set up at 'a + 4' */
+      int c = GETARG_C(i);
+      return a + 4 + ((c > 3) ? c : 3);
+    }
+    case OP_SETLIST: case OP_CALLBUILTIN:
+      return a + GETARG_B(i) + 1;
+    case OP_VARARG:
+      return (GETARG_C(i) > 0) ? a + GETARG_C(i) - 1 : a + 1;
+    default:
+      return a + 1;
+  }
+}
+
 /*
 ** Final fixups over emitted bytecode.
 **
@@ -1434,17 +1449,36 @@ int aqlK_retk (FuncState *fs, int first, int nret, int k) {
 ** when a function captured locals (fs->needclose), any RETURN0/RETURN1 must
 ** be upgraded to OP_RETURN so the VM can honor the k-bit and close upvalues
 ** before leaving the frame. TAILCALL/RETURN also get k=1 in that case.
+** In vararg functions they become OP_RETURN too, with C = numparams + 1
+** so the VM can undo the frame shift done by OP_VARARGPREP.
+**
+** It also settles 'maxstacksize': some code paths target registers
+** beyond 'freereg' without reserving them, so the frame size is widened
+** to cover every register the code touches. Calls size frames exactly
+** from this value.
 */
 void aqlK_finish(FuncState *fs) {
   int i;
   Proto *p = fs->f;
+  int framesize = p->maxstacksize;
 
   for (i = 0; i < fs->pc; i++) {
     Instruction *pc = &p->code[i];
+    int need = regbound(*pc);
+    if (GET_OPCODE(*pc) == OP_CLOSURE) {  /* captured locals are registers too */
+      Proto *cp = p->p[GETARG_Bx(*pc)];
+      int u;
+      for (u = 0; u < cp->sizeupvalues; u++) {
+        if (cp->upvalues[u].instack && cp->upvalues[u].idx + 1 > need)
+          need = cp->upvalues[u].idx + 1;
+      }
+    }
+    if (need > framesize)
+      framesize = need;
     switch (GET_OPCODE(*pc)) {
       case OP_RETURN0:
       case OP_RETURN1: {
-        if (!fs->needclose)
+        if (!(fs->needclose || p->is_vararg))
           break;
         SET_OPCODE(*pc, OP_RETURN);
       }
@@ -1453,14 +1487,289 @@ void aqlK_finish(FuncState *fs) {
       case OP_TAILCALL: {
         if (fs->needclose)
           SETARG_k(*pc, 1);
+        if (p->is_vararg)  /* frame was shifted by OP_VARARGPREP */
+          SETARG_C(*pc, p->numparams + 1);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  if (framesize > p->maxstacksize) {
+    if (framesize > MAXREGS)
+      aqlX_syntaxerror(fs->ls, "function or expression needs too many registers");
+    p->maxstacksize = cast_byte(framesize);
+  }
+}
+
+/*
+** {======================================================
+** Call-site inlining
+** =======================================================
+*/
+
+/* hard cap on the size of an inlined body (instructions) */
+#define MAXINLINECODE	64
+
+/*
+** Size budget for inlined functions: the JIT configuration when the
+** JIT is on, AQL_MAXINLINE otherwise.
+*/
+static int inlinebudget (aql_State *L) {
+  int budget = AQL_MAXINLINE;
+  JIT_State *js = L->jit_state;
+  if (js != NULL) {
+    if (js->config.max_inline_size > 0)
+      budget = js->config.max_inline_size;
+    if (js->config.aggressive_inline)
+      budget *= 2;
+  }
+  return (budget < MAXINLINECODE) ? budget : MAXINLINECODE;
+}
+
+/*
+** Nesting depth of the inlined call sites already present in 'p'
+*/
+static int inlinedepth (const Proto *p) {
+  int i, depth = 0;
+  for (i = 0; i < p->sizecode; i++) {
+    if (GET_OPCODE(p->code[i]) == OP_TESTFUNC) {
+      const TValue *k = &p->k[GETARG_B(p->code[i])];
+      int d = inlinedepth(cast(const Proto *, pvalue(k))) + 1;
+      if (d > depth)
+        depth = d;
+    }
+  }
+  return depth;
+}
+
+/*
+** Copy constant 'k' of 'p' into the current function. Return its index
+** there, or -1 if it does not fit an operand bounded by 'limit'.
+*/
+static int inlinek (FuncState *fs, Proto *p, int k, int limit) {
+  int nk = aqlK_addk(fs, &p->k[k], &p->k[k]);
+  return (nk <= limit) ? nk : -1;
+}
+
+/*
+** Rewrite instruction 'i' of function 'p' for a copy inside the current
+** function: registers move up by 'roff', constants move into the
+** current function and the environment becomes upvalue 'env'. Jumps
+** are left for the caller to relocate. Return 0 if the instruction
+** cannot be inlined.
+*/
+static int inlineinstr (FuncState *fs, Proto *p, Instruction *i, int roff,
+                        int env) {
+  Instruction ins = *i;
+  int b = GETARG_B(ins);
+  int c = GETARG_C(ins);
+  int nk;
+  switch (GET_OPCODE(ins)) {
+    case OP_JMP:
+      return 1;
+    case OP_SETTABUP: {  /* A is an upvalue, not a register */
+      if (p->upvalues[GETARG_A(ins)].name != fs->ls->envn ||
+          (nk = inlinek(fs, p, b, MAXARG_B)) < 0)
+        return 0;
+      SETARG_A(ins, env);
+      SETARG_B(ins, nk);
+      if (GETARG_k(ins)) {
+        if ((nk = inlinek(fs, p, c, MAXARG_C)) < 0) return 0;
+        SETARG_C(ins, nk);
+      }
+      else
+        SETARG_C(ins, c + roff);
+      *i = ins;
+      return 1;
+    }
+    case OP_LOADI: case OP_LOADF: case OP_LOADFALSE: case OP_LFALSESKIP:
+    case OP_LOADTRUE: case OP_LOADNIL: case OP_TEST: case OP_CONCAT:
+    case OP_CALL: case OP_CALLBUILTIN: case OP_LOADBUILTIN:
+    case OP_RETURN1: case OP_MMBINI:
+    case OP_EQI: case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+      break;
+    case OP_LOADK: {
+      if ((nk = inlinek(fs, p, GETARG_Bx(ins), MAXARG_Bx)) < 0) return 0;
+      SETARG_Bx(ins, nk);
+      break;
+    }
+    case OP_MOVE: case OP_UNM: case OP_BNOT: case OP_NOT: case OP_LEN:
+    case OP_TESTSET: case OP_EQ: case OP_LT: case OP_LE: case OP_MMBIN:
+    case OP_ADDI: case OP_SUBI: case OP_MULI: case OP_DIVI:
+    case OP_SHRI: case OP_SHLI: case OP_GETI: {
+      SETARG_B(ins, b + roff);
+      break;
+    }
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_MOD: case OP_POW:
+    case OP_DIV: case OP_IDIV: case OP_BAND: case OP_BOR: case OP_BXOR:
+    case OP_SHL: case OP_SHR: case OP_GETTABLE: {
+      SETARG_B(ins, b + roff);
+      SETARG_C(ins, c + roff);
+      break;
+    }
+    case OP_ADDK: case OP_SUBK: case OP_MULK: case OP_MODK: case OP_POWK:
+    case OP_DIVK: case OP_IDIVK: case OP_BANDK: case OP_BORK: case OP_BXORK:
+    case OP_GETFIELD: {
+      if ((nk = inlinek(fs, p, c, MAXARG_C)) < 0) return 0;
+      SETARG_B(ins, b + roff);
+      SETARG_C(ins, nk);
+      break;
+    }
+    case OP_EQK: case OP_MMBINK: case OP_TESTFUNC: {
+      if ((nk = inlinek(fs, p, b, MAXARG_B)) < 0) return 0;
+      SETARG_B(ins, nk);
+      break;
+    }
+    case OP_GETTABUP: {
+      if (p->upvalues[b].name != fs->ls->envn ||
+          (nk = inlinek(fs, p, c, MAXARG_C)) < 0)
+        return 0;
+      SETARG_B(ins, env);
+      SETARG_C(ins, nk);
+      break;
+    }
+    case OP_SETTABLE: case OP_SETI: case OP_SETFIELD: case OP_GETPROP: {
+      if (GET_OPCODE(ins) == OP_SETFIELD) {
+        if ((nk = inlinek(fs, p, b, MAXARG_B)) < 0) return 0;
+        SETARG_B(ins, nk);
+      }
+      else if (GET_OPCODE(ins) != OP_SETI)
+        SETARG_B(ins, b + roff);
+      if (GETARG_k(ins)) {  /* RK(C) */
+        if ((nk = inlinek(fs, p, c, MAXARG_C)) < 0) return 0;
+        SETARG_C(ins, nk);
+      }
+      else
+        SETARG_C(ins, c + roff);
+      break;
+    }
+    default:  /* closures, upvalues, loops, varargs, containers... */
+      return 0;
+  }
+  SETARG_A(ins, GETARG_A(ins) + roff);
+  *i = ins;
+  return 1;
+}
+
+/*
+** Try to inline a call to a function with prototype 'p', whose closure
+** was loaded into register 'base' from the environment (upvalue 'env')
+** and whose 'nargs' arguments follow it. The call site becomes
+**
+**     TESTFUNC base K[p] 1    ; closure still built from 'p'?
+**     JMP      body           ;   yes: run the copied body
+**     CALL     base nargs+1 2 ;   no: regular call
+**     JMP      done
+**   body:
+**     <body of 'p' with its registers above 'base'; every return
+**      becomes 'MOVE base r' plus a jump to 'done'>
+**   done:
+**
+** Only small non-vararg functions whose every return yields one value
+** qualify. A function is inlinable only once its body is closed, so
+** recursive calls are never inlined. Return the position of the CALL,
+** or -1 (with nothing emitted) if the call was not inlined.
+*/
+int aqlK_inlinecall (FuncState *fs, Proto *p, int base, int nargs, int env) {
+  Instruction code[MAXINLINECODE];
+  int pos[MAXINLINECODE + 1];  /* position of each instruction in the copy */
+  int roff = base + 1;
+  int n = p->sizecode - 1;  /* drop the final RETURN0 */
+  int pre = (nargs < p->numparams);  /* missing parameters are set to nil */
+  int done = NO_JUMP;
+  int i, kp, jmp, callpc;
+  TValue v;
+  if (p->is_vararg || n < 1 || n > inlinebudget(fs->ls->L) ||
+      roff + p->maxstacksize >= MAXREGS ||
+      GET_OPCODE(p->code[n]) != OP_RETURN0 ||
+      inlinedepth(p) >= JIT_MAX_INLINE_DEPTH)
+    return -1;
+  pos[0] = pre;
+  for (i = 0; i < n; i++) {
+    Instruction ins = p->code[i];
+    if (GET_OPCODE(ins) == OP_RETURN && GETARG_B(ins) == 2 && !GETARG_k(ins))
+      ins = CREATE_ABC(OP_RETURN1, GETARG_A(ins), 0, 0);
+    if (!inlineinstr(fs, p, &ins, roff, env))
+      return -1;
+    code[i] = ins;
+    pos[i + 1] = pos[i] + 1 + (GET_OPCODE(ins) == OP_RETURN1 && i < n - 1);
+  }
+  if (GET_OPCODE(code[n - 1]) != OP_RETURN1)  /* could reach the RETURN0 */
+    return -1;
+  for (i = 0; i < n; i++) {
+    OpCode op = GET_OPCODE(code[i]);
+    if (op == OP_JMP) {
+      int t = i + 1 + GETARG_sJ(code[i]);
+      if (t < 0 || t >= n)  /* jumps to the final RETURN0 */
+        return -1;
+    }
+    else if ((testTMode(op) || op == OP_LFALSESKIP) && i + 1 < n &&
+             pos[i + 2] - pos[i + 1] != 1)  /* skipped instruction grew */
+      return -1;
+  }
+  setpvalue(&v, p);
+  kp = aqlK_addk(fs, &v, &v);
+  if (kp > MAXARG_B)
+    return -1;
+  aqlK_codeABCk(fs, OP_TESTFUNC, base, kp, 0, 1);
+  jmp = aqlK_jump(fs);
+  callpc = aqlK_codeABC(fs, OP_CALL, base, nargs + 1, 2);
+  done = aqlK_jump(fs);
+  fixjump(fs, jmp, fs->pc);
+  if (pre)
+    aqlK_codeABC(fs, OP_LOADNIL, roff + nargs, p->numparams - nargs - 1, 0);
+  for (i = 0; i < n; i++) {
+    Instruction ins = code[i];
+    switch (GET_OPCODE(ins)) {
+      case OP_JMP: {
+        int t = i + 1 + GETARG_sJ(ins);
+        SETARG_sJ(ins, pos[t] - (pos[i] + 1));
+        aqlK_code(fs, ins);
+        break;
+      }
+      case OP_RETURN1: {
+        aqlK_codeABC(fs, OP_MOVE, base, GETARG_A(ins), 0);
+        if (i < n - 1)
+          aqlK_concat(fs, &done, aqlK_jump(fs));
         break;
       }
       default:
+        aqlK_code(fs, ins);
         break;
     }
   }
+  aqlK_patchtohere(fs, done);
+  return callpc;
+}
+
+/*
+** The call site at 'callpc' must now produce a different number of
+** results. If it was inlined (see 'aqlK_inlinecall'), whose body yields
+** exactly one, fall back to the regular call. When the inlined code is
+** the last thing emitted, the guard, the jump and the copied body are
+** removed and the CALL moves down to where the guard was; otherwise the
+** guard's jump falls through into the CALL, whose following jump skips
+** the body. Return the (possibly new) position of the CALL.
+*/
+int aqlK_uninline (FuncState *fs, int callpc) {
+  Proto *f = fs->f;
+  int done;
+  if (callpc < 2 || GET_OPCODE(f->code[callpc - 2]) != OP_TESTFUNC)
+    return callpc;  /* not inlined */
+  done = callpc + 2 + GETARG_sJ(f->code[callpc + 1]);  /* end of the body */
+  if (done != fs->pc) {  /* code follows the body? */
+    SETARG_sJ(f->code[callpc - 1], 0);
+    return callpc;
+  }
+  f->code[callpc - 2] = f->code[callpc];
+  f->lineinfo[callpc - 2] = f->lineinfo[callpc];
+  fs->pc = callpc - 1;
+  return callpc - 2;
 }
 
+/* }====================================================== */
+
 /*
 ** Code a "conditional jump", from 'v' to 'dest'. If 'v' is
 ** false, will jump to 'dest'. If 'v' is true, will fall through.
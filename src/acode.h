@@ -21,6 +21,12 @@ typedef enum BinOpr BinOpr;
 */
 #define MAXREGS         254
 
+/*
+** Default size budget (instructions) of functions inlined at their
+** call sites; the JIT configuration overrides it when the JIT is on
+*/
+#define AQL_MAXINLINE   16
+
 /*
 ** Marks the end of a patch list. It is an invalid value both as an absolute
 ** address, and as a list link (would link an element to itself).
@@ -48,6 +54,9 @@ AQL_API void aqlK_concat(FuncState *fs, int *l1, int l2);
 AQL_API int aqlK_getlabel(FuncState *fs);
 AQL_API void aqlK_patchclose(FuncState *fs, int list, int level);
 AQL_API void aqlK_finish(FuncState *fs);
+AQL_API int aqlK_inlinecall(FuncState *fs, Proto *p, int base, int nargs,
+                            int env);
+AQL_API int aqlK_uninline(FuncState *fs, int callpc);
 
 /*
 ** Expression handling
@@ -93,6 +102,8 @@ AQL_API void aqlK_newarray(FuncState *fs, struct expdesc *e, int size, int type)
 AQL_API void aqlK_newslice(FuncState *fs, struct expdesc *e, int type);
 AQL_API void aqlK_newdict(FuncState *fs, struct expdesc *e, int keytype, int valtype);
 AQL_API void aqlK_newvector(FuncState *fs, struct expdesc *e, int type, int size);
+AQL_API void aqlK_setlist(FuncState *fs, int base, int nelems, int tostore);
+AQL_API void aqlK_setobjectsize(FuncState *fs, int pc, int ra, int type, int size);
 
 /* Type operations */
 AQL_API void aqlK_checktype(FuncState *fs, struct expdesc *e, int expected_type);
@@ -171,6 +171,11 @@ typedef void* aql_KContext;
 */
 #define MAXNUMBER2STR	44  /* max length for number to string conversion */
 
+/*
+** Size of the per-state buffer collecting 'print' output
+*/
+#define AQL_OUTBUFSIZE	65536
+
 /*
 ** String formatting function macros
 */
@@ -178,7 +183,9 @@ typedef void* aql_KContext;
 #define aql_integer2str(s,sz,n)  \
 	((void)((sz) != 1), sprintf((s), AQL_INTEGER_FMT_STR, (AQLF_I_TYPE)(n)))
 
-#define AQL_NUMBER_FMT_STR		"%" AQL_NUMBER_FRMLEN "g"
+/* floats become strings with AQL_NUMBER_DIGITS significant digits */
+#define AQL_NUMBER_DIGITS		14
+#define AQL_NUMBER_FMT_STR		"%.14" AQL_NUMBER_FRMLEN "g"
 #define aql_number2str(s,sz,n)	\
 	((void)((sz) != 1), sprintf((s), AQL_NUMBER_FMT_STR, (AQLF_N_TYPE)(n)))
 
@@ -216,14 +216,95 @@ AQL_API AQL_ContainerBase *acontainer_slice_view(aql_State *L,
  * 通用向量操作
  * ============================================================================ */
 
+/*
+ * 向量元素按 dtype 存放: INT64/FLOAT64 为原生数值, 其余为 TValue 槽
+ * (与数组相同)
+ */
 AQL_API int acontainer_vector_get(aql_State *L, AQL_ContainerBase *c, 
                                  size_t idx, TValue *result) {
-    return acontainer_array_get(L, c, idx, result);  /* 向量访问与数组相同 */
+    switch (c->dtype) {
+        case AQL_DATA_TYPE_INT64:
+            if (!acontainer_check_bounds(c, idx)) return -1;
+            setivalue(result, ((int64_t*)c->data)[idx]);
+            return 0;
+        case AQL_DATA_TYPE_FLOAT64:
+            if (!acontainer_check_bounds(c, idx)) return -1;
+            setfltvalue(result, ((double*)c->data)[idx]);
+            return 0;
+        default:
+            return acontainer_array_get(L, c, idx, result);  /* 向量访问与数组相同 */
+    }
 }
 
 AQL_API int acontainer_vector_set(aql_State *L, AQL_ContainerBase *c, 
                                  size_t idx, const TValue *value) {
-    return acontainer_array_set(L, c, idx, value);  /* 向量设置与数组相同 */
+    switch (c->dtype) {
+        case AQL_DATA_TYPE_INT64:
+            if (!acontainer_check_bounds(c, idx)) return -1;
+            if (!ttisinteger(value)) return -3;  /* 类型不符 */
+            ((int64_t*)c->data)[idx] = ivalue(value);
+            return 0;
+        case AQL_DATA_TYPE_FLOAT64:
+            if (!acontainer_check_bounds(c, idx)) return -1;
+            if (!ttisnumber(value)) return -3;  /* 类型不符 */
+            ((double*)c->data)[idx] = ttisinteger(value)
+                ? cast_num(ivalue(value)) : fltvalue(value);
+            return 0;
+        default:
+            return acontainer_array_set(L, c, idx, value);  /* 向量设置与数组相同 */
+    }
+}
+
+/*
+ * 批量把字符串 (或数值) 序列解析为数值向量. dtype 为 INT64/FLOAT64 时
+ * 强制该类型; 为 ANY 时自动推断: 先按 INT64 存放, 遇到第一个浮点数时
+ * 原地转为 FLOAT64 (两者都是 8 字节). 失败返回 NULL, *bad 为出错下标.
+ */
+AQL_API AQL_ContainerBase *acontainer_vector_parse(aql_State *L,
+                                                   AQL_ContainerBase *src,
+                                                   DataType dtype, size_t *bad) {
+    size_t n = src->length, i;
+    int isflt = (dtype == AQL_DATA_TYPE_FLOAT64);
+    AQL_ContainerBase *v = acontainer_new(L, CONTAINER_VECTOR,
+        isflt ? AQL_DATA_TYPE_FLOAT64 : AQL_DATA_TYPE_INT64, n);
+    if (v == NULL) {
+        *bad = n;
+        return NULL;
+    }
+    int64_t *iv = (int64_t*)v->data;
+    double *fv = (double*)v->data;
+    for (i = 0; i < n; i++) {
+        TValue elem, num;
+        const TValue *o = &elem;
+        if (acontainer_vector_get(L, src, i, &elem) != 0)
+            goto fail;
+        if (ttisstring(o)) {
+            TString *ts = tsvalue(o);
+            if (aqlO_str2num(getstr(ts), &num) != tsslen(ts) + 1)
+                goto fail;  /* not a numeral (or embedded zeros) */
+            o = &num;
+        }
+        else if (!ttisnumber(o))
+            goto fail;
+        if (isflt)
+            fv[i] = ttisinteger(o) ? cast_num(ivalue(o)) : fltvalue(o);
+        else if (ttisinteger(o))
+            iv[i] = ivalue(o);
+        else if (dtype == AQL_DATA_TYPE_ANY) {  /* first float: switch type */
+            for (size_t j = 0; j < i; j++)
+                fv[j] = cast_num(iv[j]);
+            v->dtype = AQL_DATA_TYPE_FLOAT64;
+            isflt = 1;
+            fv[i] = fltvalue(o);
+        }
+        else
+            goto fail;  /* float in an INT64 vector */
+    }
+    return v;
+fail:
+    *bad = i;
+    acontainer_destroy(L, v);
+    return NULL;
 }
 
 /* ============================================================================
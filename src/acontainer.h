@@ -146,6 +146,9 @@ AQL_API int acontainer_vector_get(aql_State *L, AQL_ContainerBase *c,
                                  size_t idx, TValue *result);
 AQL_API int acontainer_vector_set(aql_State *L, AQL_ContainerBase *c, 
                                  size_t idx, const TValue *value);
+AQL_API AQL_ContainerBase *acontainer_vector_parse(aql_State *L,
+                                                   AQL_ContainerBase *src,
+                                                   DataType dtype, size_t *bad);
 
 /* 通用字典操作 */
 AQL_API int acontainer_dict_get(aql_State *L, AQL_ContainerBase *c, 
@@ -233,6 +233,9 @@ void aqlD_print_function_bytecode(Proto *f, const char *name) {
                 case AQL_VLNGSTR:
                     printf("\"%s\"", getstr(tsvalue(k)));
                     break;
+                case AQL_VLIGHTUSERDATA:  /* OP_TESTFUNC prototype */
+                    printf("proto %p", pvalue(k));
+                    break;
                 default:
                     printf("(unknown type %d)", ttypetag(k));
                     break;
@@ -660,6 +663,8 @@ const char *aqlD_opcode_name(int opcode) {
         case OP_LOADNIL: return "LOADNIL";
         case OP_GETUPVAL: return "GETUPVAL";
         case OP_SETUPVAL: return "SETUPVAL";
+        case OP_GETFLATUP: return "GETFLATUP";
+        case OP_TESTFUNC: return "TESTFUNC";
         case OP_GETTABUP: return "GETTABUP";
         case OP_SETTABUP: return "SETTABUP";
         case OP_CLOSE: return "CLOSE";
@@ -718,6 +723,7 @@ const char *aqlD_value_type_name(TValue *value) {
         case AQL_TUSERDATA: return "userdata";
         case AQL_TTHREAD: return "thread";
         case AQL_TRANGE: return "range";
+        case AQL_TBUILDER: return "builder";
         default: return "unknown";
     }
 }
@@ -31,20 +31,217 @@ static const TValue *aql_index2addr(aql_State *L, int idx) {
 #define MAX_LOAD_FACTOR 192  /* 0.75 * 256 */
 #define MIN_CAPACITY 8
 
+/*
+** Number of slots (power of 2) needed to hold 'n' entries without
+** crossing the load factor
+*/
+static size_t slotsfor(size_t n) {
+  size_t slots = MIN_CAPACITY;
+  while ((n + 1) * 256 > slots * MAX_LOAD_FACTOR)
+    slots *= 2;
+  return slots;
+}
+
+/*
+** Group matching: returns a bit mask with bit 'i' set when control
+** byte 'g[i]' equals 'tag', for the DICT_GROUP bytes starting at 'g'.
+*/
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+static l_inline unsigned group_match(const aql_byte *g, aql_byte tag) {
+  __m128i ctrl = _mm_loadu_si128((const __m128i *)g);
+  return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+}
+#else
+static l_inline unsigned group_match(const aql_byte *g, aql_byte tag) {
+  unsigned m = 0;
+  for (int i = 0; i < DICT_GROUP; i++)
+    if (g[i] == tag) m |= 1u << i;
+  return m;
+}
+#endif
+
+#if defined(__GNUC__)
+#define group_first(m)	__builtin_ctz(m)
+#else
+static l_inline int group_first(unsigned m) {
+  int n = 0;
+  while (!(m & 1u)) { m >>= 1; n++; }
+  return n;
+}
+#endif
+
+/*
+** Set the control byte of a slot, keeping the mirrored tail in sync
+*/
+static l_inline void setctrl(Dict *dict, size_t i, aql_byte tag) {
+  dict->ctrl[i] = tag;
+  for (size_t j = i + dict->capacity; j < dict->capacity + DICT_GROUP;
+       j += dict->capacity)
+    dict->ctrl[j] = tag;
+}
+
+/* entry stored for slot 's' (through the sparse index in compact dicts) */
+#define slotentry(d,s) \
+	(aqlD_iscompact(d) ? &(d)->entries[(d)->index[s]] : &(d)->entries[s])
+
+/* dense-array entries removed from a compact dict */
+#define isdeadentry(e)	checktag(&(e)->key, AQL_TDEADKEY)
+
+/*
+** Allocate zeroed metadata and key/value storage for 'capacity' slots.
+** Compact dicts get a sparse index plus a dense array sized for the
+** number of entries the table may hold before growing.
+*/
+static int allocslots(aql_State *L, Dict *dict, size_t capacity) {
+  size_t nent = aqlD_iscompact(dict)
+              ? (capacity * MAX_LOAD_FACTOR) >> 8 : capacity;
+  aql_byte *meta = (aql_byte*)aqlM_malloc(L, sizedictmeta(capacity));
+  unsigned int *index = NULL;
+  DictEntry *entries;
+  if (meta == NULL) return 0;
+  if (aqlD_iscompact(dict)) {
+    index = aqlM_newvector(L, capacity, unsigned int);
+    if (index == NULL) {
+      aqlM_freemem(L, meta, sizedictmeta(capacity));
+      return 0;
+    }
+  }
+  entries = (DictEntry*)aqlM_newvector(L, nent, DictEntry);
+  if (entries == NULL) {
+    aqlM_freemem(L, meta, sizedictmeta(capacity));
+    if (index) aqlM_freearray(L, index, capacity);
+    return 0;
+  }
+  memset(meta, DICT_EMPTY, sizedictmeta(capacity));
+  dict->ctrl = meta;
+  dict->dist = meta + capacity + DICT_GROUP;
+  dict->index = index;
+  dict->entries = entries;
+  dict->shape = NULL;
+  dict->entcap = nent;
+  dict->nentries = 0;
+  dict->capacity = capacity;
+  dict->mask = capacity - 1;
+  dict->maxdist = 0;
+  dict->size = 0;
+  dict->length = 0;
+  return 1;
+}
+
+/*
+** Release the arrays described by 'dict' (not the object itself)
+*/
+static void freeslots(aql_State *L, const Dict *dict) {
+  if (dict->ctrl)
+    aqlM_freemem(L, dict->ctrl, sizedictmeta(dict->capacity));
+  if (dict->index)
+    aqlM_freearray(L, dict->index, dict->capacity);
+  if (dict->entries && !aqlD_issmall(dict))  /* inline area goes with the object */
+    aqlM_freearray(L, dict->entries, dict->entcap);
+}
+
+/*
+** {======================================================
+** Shapes
+** =======================================================
+*/
+
+static Shape *newshape(aql_State *L, Shape *parent, TString *key) {
+  Shape *s = aqlM_new(L, Shape);
+  s->parent = parent;
+  s->kids = NULL;
+  s->key = key;
+  s->nkeys = parent ? parent->nkeys + 1 : 0;
+  if (parent) {
+    s->next = parent->kids;
+    parent->kids = s;
+  }
+  else s->next = NULL;
+  return s;
+}
+
+static Shape *rootshape(aql_State *L) {
+  global_State *g = G(L);
+  if (g->shaperoot == NULL)
+    g->shaperoot = newshape(L, NULL, NULL);
+  return g->shaperoot;
+}
+
+/*
+** Shape reached from 'shape' by appending 'key' (created on demand)
+*/
+static Shape *shapechild(aql_State *L, Shape *shape, TString *key) {
+  Shape *s;
+  for (s = shape->kids; s != NULL; s = s->next) {
+    if (s->key == key) return s;
+  }
+  return newshape(L, shape, key);
+}
+
+/*
+** Slot of 'key' in 'shape', or -1 if the shape does not have it
+*/
+AQL_API int aqlD_shapeslot(const Shape *shape, const TString *key) {
+  for (; shape != NULL && shape->key != NULL; shape = shape->parent) {
+    if (shape->key == key) return shape->nkeys - 1;
+  }
+  return -1;
+}
+
+static void freeshape(aql_State *L, Shape *s) {
+  while (s != NULL) {
+    Shape *next = s->next;
+    freeshape(L, s->kids);
+    aqlM_free(L, s, sizeof(Shape));
+    s = next;
+  }
+}
+
+AQL_API void aqlD_freeshapes(aql_State *L) {
+  freeshape(L, G(L)->shaperoot);
+  G(L)->shaperoot = NULL;
+}
+
+/* }====================================================== */
+
+/*
+** Switch 'dict' to its small form, using the inline entry area
+*/
+static void setsmall(Dict *dict) {
+  dict->flags |= DICT_FSMALL;
+  dict->ctrl = dict->dist = NULL;
+  dict->index = NULL;
+  dict->entries = dictinline(dict);
+  dict->entcap = DICT_SMALL;
+  dict->nentries = 0;
+  dict->capacity = 0;
+  dict->mask = 0;
+  dict->maxdist = 0;
+  dict->size = 0;
+  dict->length = 0;
+}
+
 /*
 ** Hash function for TValue keys
 */
 AQL_API aql_Unsigned aqlD_hash(const TValue *key) {
-  if (ttisstring(key)) {
-    return tsvalue(key)->hash;
+  if (ttisshrstring(key)) {
+    return tsvalue(key)->hash;  /* seeded at interning */
+  } else if (ttislngstring(key)) {
+    return aqlS_hashlongstr(tsvalue(key));
   } else if (ttisinteger(key)) {
     aql_Integer i = ivalue(key);
     return (aql_Unsigned)((i ^ (i >> 32)) * 0x9e3779b97f4a7c15ULL);
   } else if (ttisfloat(key)) {
-    /* Convert float to integer for hashing */
+    /* Fold exponent bits down so integral floats do not share low bits */
     union { aql_Number n; aql_Unsigned u; } conv;
     conv.n = fltvalue(key);
-    return conv.u;
+    if (conv.n == 0) conv.n = 0;  /* -0.0 and 0.0 are equal keys */
+    conv.u ^= conv.u >> 32;
+    conv.u ^= conv.u >> 16;
+    return conv.u * 0x9e3779b97f4a7c15ULL;
   } else if (ttisboolean(key)) {
     return bvalue(key) ? 1 : 0;
   } else if (ttisnil(key)) {
@@ -59,7 +256,11 @@ AQL_API aql_Unsigned aqlD_hash(const TValue *key) {
 ** Key equality comparison
 */
 AQL_API int aqlD_keyequal(const TValue *k1, const TValue *k2) {
-  if (rawtt(k1) != rawtt(k2)) return 0;
+  if (rawtt(k1) != rawtt(k2)) {
+    if (ttisstring(k1) && ttisstring(k2))  /* interned vs. lazy string */
+      return aqlS_eqstr(tsvalue(k1), tsvalue(k2));
+    return 0;
+  }
   
   switch (novariant(rawtt(k1))) {
     case AQL_TNIL: return 1;
@@ -73,118 +274,148 @@ AQL_API int aqlD_keyequal(const TValue *k1, const TValue *k2) {
         return 0;  /* Mixed int/float not equal */
       }
     case AQL_TSTRING:
-      return eqshrstr(tsvalue(k1), tsvalue(k2));
+      if (ttisshrstring(k1))  /* interned: same contents, same object */
+        return tsvalue(k1) == tsvalue(k2);
+      return aqlS_eqlngstr(tsvalue(k1), tsvalue(k2));
     default:
       return gcvalue(k1) == gcvalue(k2);
   }
 }
 
-/*
-** Create a new dict with specified key and value types
-*/
-AQL_API Dict *aqlD_new(aql_State *L, DataType key_type, DataType value_type) {
-  return aqlD_newcap(L, key_type, value_type, DEFAULT_DICT_CAPACITY);
-}
-
-/*
-** Create a new dict with specified capacity - 使用统一容器基类
-*/
-AQL_API Dict *aqlD_newcap(aql_State *L, DataType key_type, DataType value_type, size_t capacity) {
-  /* Ensure capacity is power of 2 and at least MIN_CAPACITY */
-  if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
-  capacity = 1 << aqlO_ceillog2((unsigned int)capacity);
-
-  Dict *dict = (Dict*)aqlM_newobject(L, AQL_TDICT, sizeof(Dict));
+static Dict *newdict(aql_State *L, DataType key_type, DataType value_type,
+                     size_t slots, aql_byte flags) {
+  size_t ninline = (slots == 0) ? DICT_SMALL : 0;
+  Dict *dict = (Dict*)aqlM_newobject(L, AQL_TDICT, sizedict(ninline));
   if (dict == NULL) return NULL;
   
   /* 设置字典特定字段 */
   dict->key_type = key_type;
   dict->value_type = value_type;
-  dict->size = 0;
-  dict->length = 0;
-  dict->capacity = capacity;
-  dict->mask = capacity - 1;
   dict->load_factor = MAX_LOAD_FACTOR;
+  dict->flags = flags;
+  dict->ninline = cast_byte(ninline);
   
-  /* 分配并初始化条目数组 - 使用独立内存避免冲突 */
-  dict->entries = (DictEntry*)aqlM_newvector(L, capacity, DictEntry);
-  if (dict->entries == NULL) {
-    aqlM_freemem(L, dict, sizeof(Dict));
-    return NULL;
+  if (ninline > 0) {
+    /* 小字典：条目内联存放，无需额外分配 */
+    setsmall(dict);
+    dict->shape = rootshape(L);
   }
-  
-  /* 初始化所有条目为空 */
-  for (size_t i = 0; i < capacity; i++) {
-    setnilvalue(&dict->entries[i].key);
-    setnilvalue(&dict->entries[i].value);
-    dict->entries[i].hash = 0;
-    dict->entries[i].distance = 0;
-    dict->entries[i].flags = 0;
+  else if (!allocslots(L, dict, slots)) {
+    /* 分配控制字节与条目数组 - 控制字节全部置空 */
+    aqlM_freemem(L, dict, sizedict(ninline));
+    return NULL;
   }
   
   return dict;
 }
 
+/* slots for a dict expecting 'n' entries (0 = small inline form) */
+#define initslots(n)	((n) <= DICT_SMALL ? 0 : slotsfor(n))
+
+/*
+** Create a new dict with specified key and value types
+*/
+AQL_API Dict *aqlD_new(aql_State *L, DataType key_type, DataType value_type) {
+  return newdict(L, key_type, value_type, 0, 0);
+}
+
+/*
+** Create a new dict able to hold 'capacity' entries without rehashing
+** (dict.with_capacity; fed by the C operand of OP_NEWOBJECT)
+*/
+AQL_API Dict *aqlD_newcap(aql_State *L, DataType key_type, DataType value_type, size_t capacity) {
+  return newdict(L, key_type, value_type, initslots(capacity), 0);
+}
+
+/*
+** Create a compact dict: entries live in a dense array in insertion
+** order and the hash table only stores their positions
+*/
+AQL_API Dict *aqlD_newcompact(aql_State *L, DataType key_type, DataType value_type, size_t capacity) {
+  return newdict(L, key_type, value_type, initslots(capacity), DICT_FCOMPACT);
+}
+
 /*
 ** Free a dict and its data - 使用统一容器销毁
 */
 AQL_API void aqlD_free(aql_State *L, Dict *dict) {
   if (dict == NULL) return;
-  if (dict->entries)
-    aqlM_freemem(L, dict->entries, dict->capacity * sizeof(DictEntry));
-  aqlM_freemem(L, dict, sizeof(Dict));
+  freeslots(L, dict);
+  aqlM_freemem(L, dict, sizedict(dict->ninline));
 }
 
 /*
-** Find entry for key (Robin Hood hashing)
+** Linear search in a small dict. Short strings are interned, so for
+** them pointer equality decides.
 */
-static DictEntry *findentry(const Dict *dict, const TValue *key) {
-  if (dict->capacity == 0) {
-    aql_debug("[DEBUG] findentry: dict capacity is 0\n");
+static DictEntry *smallfind(const Dict *dict, const TValue *key) {
+  DictEntry *e = dict->entries;
+  DictEntry *lim = e + dict->size;
+  if (ttisshrstring(key)) {
+    GCObject *gk = gcvalue(key);
+    for (; e < lim; e++) {
+      if (rawtt(&e->key) == rawtt(key) && val_(&e->key).gc == gk)
+        return e;
+    }
     return NULL;
   }
-  
-  aql_Unsigned hash = aqlD_hash(key);
-  size_t index = hash & dict->mask;
-  aql_byte distance = 0;
-  
-  if (ttisstring(key)) {
-    TString *keystr = tsvalue(key);
-    aql_debug("[DEBUG] findentry: searching for key '%s', hash=%u, index=%zu\n", 
-                getstr(keystr), hash, index);
+  for (; e < lim; e++) {
+    if (aqlD_keyequal(&e->key, key))
+      return e;
   }
-  
-  while (1) {
-    DictEntry *entry = &dict->entries[index];
-    
-    if (aqlD_entry_empty(entry)) {
-      aql_debug("[DEBUG] findentry: found empty entry at index %zu, key_type=%d\n", 
-                  index, ttype(&entry->key));
-      return NULL;  /* Key not found */
-    }
-    
-    aql_debug("[DEBUG] findentry: checking entry at index %zu, hash=%llu, distance=%d\n", 
-                index, (unsigned long long)entry->hash, entry->distance);
-    if (ttisstring(&entry->key)) {
-      TString *entrystr = tsvalue(&entry->key);
-      aql_debug("[DEBUG] findentry: entry key is string '%s'\n", getstr(entrystr));
-    }
-    
-    if (entry->hash == hash && aqlD_keyequal(&entry->key, key)) {
-      aql_debug("[DEBUG] findentry: found matching entry!\n");
-      return entry;  /* Found */
-    }
-    
-    /* Robin Hood: if we've traveled further than this entry, key doesn't exist */
-    if (distance > entry->distance) {
-      return NULL;
+  return NULL;
+}
+
+/*
+** Find the slot holding key (with a precomputed hash), or DICT_NOSLOT.
+** Control bytes are scanned a group at a time; only slots whose
+** fragment matches are compared, and the scan stops at the first empty
+** slot or once every distance up to 'maxdist' has been covered (Robin
+** Hood invariant).
+*/
+#define DICT_NOSLOT	(~(size_t)0)
+
+static size_t findslot(const Dict *dict, const TValue *key, aql_Unsigned hash) {
+  aql_byte tag = dict_h2(hash);
+  size_t pos = hash & dict->mask;
+  size_t probed = 0;
+  
+  for (;;) {
+    const aql_byte *g = dict->ctrl + pos;
+    unsigned match = group_match(g, tag);
+    unsigned empty = group_match(g, DICT_EMPTY);
+    if (empty)
+      match &= (empty & (0u - empty)) - 1;  /* only slots before the hole */
+    while (match) {
+      size_t slot = (pos + group_first(match)) & dict->mask;
+      const DictEntry *entry = slotentry(dict, slot);
+      if (entry->hash == hash && aqlD_keyequal(&entry->key, key))
+        return slot;  /* Found */
+      match &= match - 1;
     }
-    
-    distance++;
-    index = (index + 1) & dict->mask;
+    probed += DICT_GROUP;
+    if (empty || probed > dict->maxdist)
+      return DICT_NOSLOT;  /* Key not found */
+    pos = (pos + DICT_GROUP) & dict->mask;
   }
 }
 
+static DictEntry *findentry_h(const Dict *dict, const TValue *key,
+                              aql_Unsigned hash) {
+  size_t slot = findslot(dict, key, hash);
+  return (slot == DICT_NOSLOT) ? NULL : slotentry(dict, slot);
+}
+
+static DictEntry *findentry(const Dict *dict, const TValue *key) {
+  if (aqlD_issmall(dict))
+    return smallfind(dict, key);
+  if (dict->capacity == 0) {
+    aql_debug("[DEBUG] findentry: dict capacity is 0\n");
+    return NULL;
+  }
+  return findentry_h(dict, key, aqlD_hash(key));
+}
+
 /*
 ** Get value for key
 */
@@ -194,58 +425,106 @@ AQL_API const TValue *aqlD_get(const Dict *dict, const TValue *key) {
     return NULL;
   }
   
-  if (ttisstring(key)) {
-    TString *keystr = tsvalue(key);
-    aql_debug("[DEBUG] aqlD_get: looking for key '%s', dict size=%zu, dict=%p\n", 
-                getstr(keystr), dict->size, (void*)dict);
-  }
-  
   DictEntry *entry = findentry(dict, key);
-  if (entry) {
-    aql_debug("[DEBUG] aqlD_get: found entry, value type=%d\n", ttype(&entry->value));
-  } else {
-    aql_debug("[DEBUG] aqlD_get: entry not found\n");
-  }
   return entry ? &entry->value : NULL;
 }
 
 /*
-** Resize dict to new capacity
+** Robin Hood insertion of an entry known to be absent. Entries that
+** are closer to their home slot than the one being placed give way
+** and continue probing. Hashed dicts move the entry '*e' itself;
+** compact dicts move its dense-array position '*ei'. Returns 0 (with
+** the homeless item left in '*e'/'*ei') if a probe distance would no
+** longer fit in 'dist'.
 */
-static int dict_resize(aql_State *L, Dict *dict, size_t new_capacity) {
-  /* Save old data */
-  DictEntry *old_entries = dict->entries;
-  size_t old_capacity = dict->capacity;
-  
-  /* Allocate new array */
-  dict->entries = (DictEntry*)aqlM_newvector(L, new_capacity, DictEntry);
-  if (dict->entries == NULL) {
-    dict->entries = old_entries;  /* Restore on failure */
-    return 0;
-  }
-  
-  dict->capacity = new_capacity;
-  dict->mask = new_capacity - 1;
-  dict->size = 0;
+static int rawinsert(Dict *dict, DictEntry *e, unsigned int *ei) {
+  int compact = aqlD_iscompact(dict);
+  aql_Unsigned hash = compact ? dict->entries[*ei].hash : e->hash;
+  size_t index = hash & dict->mask;
+  aql_byte tag = dict_h2(hash);
+  size_t distance = 0;
   
-  /* Initialize new entries */
-  for (size_t i = 0; i < new_capacity; i++) {
-    dict->entries[i].hash = 0;
-    dict->entries[i].distance = 0;
-    setnilvalue(&dict->entries[i].key);
-    setnilvalue(&dict->entries[i].value);
+  for (;;) {
+    if (dict->ctrl[index] == DICT_EMPTY) {
+      /* Empty slot, insert here */
+      if (compact) dict->index[index] = *ei;
+      else dict->entries[index] = *e;
+      setctrl(dict, index, tag);
+      dict->dist[index] = cast_byte(distance);
+      if (distance > dict->maxdist) dict->maxdist = distance;
+      return 1;
+    }
+    
+    /* Robin Hood: if we've traveled further, swap and continue */
+    if (dict->dist[index] < distance) {
+      aql_byte temptag = dict->ctrl[index];
+      size_t tempdist = dict->dist[index];
+      if (compact) {
+        unsigned int temp = dict->index[index];
+        dict->index[index] = *ei;
+        *ei = temp;
+      } else {
+        DictEntry temp = dict->entries[index];
+        dict->entries[index] = *e;
+        *e = temp;
+      }
+      setctrl(dict, index, tag);
+      dict->dist[index] = cast_byte(distance);
+      if (distance > dict->maxdist) dict->maxdist = distance;
+      tag = temptag;
+      distance = tempdist;
+    }
+    
+    if (++distance > DICT_MAXDIST)
+      return 0;
+    index = (index + 1) & dict->mask;
   }
-  
-  /* Rehash all old entries */
-  for (size_t i = 0; i < old_capacity; i++) {
-    DictEntry *old_entry = &old_entries[i];
-    if (!aqlD_entry_empty(old_entry)) {
-      aqlD_set(L, dict, &old_entry->key, &old_entry->value);
+}
+
+/*
+** Rehash all entries into a table of 'new_capacity' slots. Entries are
+** known to be distinct, so they are placed directly with their stored
+** hash: no key comparisons and no load-factor checks. Compact dicts
+** also squeeze removed entries out of the dense array, keeping the
+** insertion order. If some probe distance overflows, the new table is
+** discarded and a larger one is tried; the old table stays valid until
+** the rehash succeeds.
+*/
+static int dict_resize(aql_State *L, Dict *dict, size_t new_capacity) {
+  Dict old = *dict;  /* Save old data */
+  int dense = aqlD_iscompact(&old) || aqlD_issmall(&old);
+  size_t n = dense ? old.nentries : old.capacity;
+  
+  dict->flags &= ~DICT_FSMALL;  /* small dicts get promoted */
+  for (;;) {
+    size_t i;
+    if (!allocslots(L, dict, new_capacity)) {
+      *dict = old;  /* Restore on failure */
+      return 0;
     }
+    for (i = 0; i < n; i++) {
+      if (dense ? isdeadentry(&old.entries[i]) : old.ctrl[i] == DICT_EMPTY)
+        continue;
+      if (aqlD_iscompact(dict)) {
+        unsigned int ei = cast(unsigned int, dict->nentries++);
+        dict->entries[ei] = old.entries[i];
+        if (!rawinsert(dict, NULL, &ei)) break;
+      }
+      else {
+        DictEntry e = old.entries[i];
+        if (!rawinsert(dict, &e, NULL)) break;
+      }
+    }
+    if (i == n) break;  /* all entries placed */
+    freeslots(L, dict);
+    new_capacity *= 2;
   }
   
-  /* Free old array */
-  aqlM_freearray(L, old_entries, old_capacity);
+  dict->size = old.size;
+  dict->length = old.length;
+  
+  /* Free old arrays */
+  freeslots(L, &old);
   return 1;
 }
 
@@ -258,13 +537,43 @@ AQL_API int aqlD_set(aql_State *L, Dict *dict, const TValue *key, const TValue *
     return 0;
   }
   
-  if (ttisstring(key)) {
-    TString *keystr = tsvalue(key);
-    aql_debug("[DEBUG] aqlD_set: setting key '%s', dict size=%zu, dict=%p\n", 
-                getstr(keystr), dict->size, (void*)dict);
+  TValue ikey;
+  if (ttislngstring(key) && aqlStr_islazy(tsvalue(key))) {
+    /* keys are stored interned: intern a runtime string on first use */
+    setsvalue(L, &ikey, aqlStr_intern(L, tsvalue(key)));
+    key = &ikey;
+  }
+  
+  if (aqlD_issmall(dict)) {
+    DictEntry *entry = smallfind(dict, key);
+    if (entry) {
+      setobj(L, &entry->value, value);
+      return 1;
+    }
+    if (dict->size < DICT_SMALL) {
+      /* Append inline; hash kept for a later promotion */
+      if (dict->shape != NULL)  /* follow (or leave) the shape tree */
+        dict->shape = ttisshrstring(key)
+                    ? shapechild(L, dict->shape, tsvalue(key)) : NULL;
+      entry = &dict->entries[dict->size];
+      entry->hash = aqlD_hash(key);
+      setobj(L, &entry->key, key);
+      setobj(L, &entry->value, value);
+      dict->nentries = ++dict->size;
+      dict->length = dict->size;
+      return 1;
+    }
+    /* Overflow: promote to the hashed form */
+    if (!dict_resize(L, dict, slotsfor(DICT_SMALL + 1)))
+      return 0;
   }
-  if (ttisinteger(value)) {
-    aql_debug("[DEBUG] aqlD_set: value is integer %lld\n", (long long)ivalue(value));
+  
+  aql_Unsigned hash = aqlD_hash(key);
+  DictEntry *entry = findentry_h(dict, key, hash);
+  if (entry) {
+    /* Update existing key */
+    setobj(L, &entry->value, value);
+    return 1;
   }
   
   /* Check load factor and resize if necessary */
@@ -273,88 +582,93 @@ AQL_API int aqlD_set(aql_State *L, Dict *dict, const TValue *key, const TValue *
       return 0;  /* Failed to resize */
     }
   }
-  
-  aql_Unsigned hash = aqlD_hash(key);
-  size_t index = hash & dict->mask;
-  aql_byte distance = 0;
-  
-  if (ttisstring(key)) {
-    TString *keystr = tsvalue(key);
-    aql_debug("[DEBUG] aqlD_set: computed hash=%llu for key '%s'\n", 
-                (unsigned long long)hash, getstr(keystr));
+  else if (aqlD_iscompact(dict) && dict->nentries == dict->entcap) {
+    /* Dense array full of removed entries: compact it in place */
+    if (!dict_resize(L, dict, dict->capacity)) {
+      return 0;
+    }
   }
   
   /* Create entry to insert */
   DictEntry to_insert;
   to_insert.hash = hash;
-  to_insert.distance = distance;
-  aql_debug("[DEBUG] aqlD_set: before setobj, hash=%llu\n", (unsigned long long)to_insert.hash);
   setobj(L, &to_insert.key, key);
   setobj(L, &to_insert.value, value);
-  aql_debug("[DEBUG] aqlD_set: after setobj, hash=%llu\n", (unsigned long long)to_insert.hash);
   
-  aql_debug("[DEBUG] aqlD_set: created entry with hash=%llu\n", (unsigned long long)to_insert.hash);
-  
-  while (1) {
-    DictEntry *entry = &dict->entries[index];
-    
-    if (aqlD_entry_empty(entry)) {
-      /* Empty slot, insert here */
-      *entry = to_insert;
-      aql_debug("[DEBUG] aqlD_set: stored entry at index %zu with hash=%llu\n", 
-                  index, (unsigned long long)entry->hash);
-      dict->size++;
-      dict->length = dict->size;  /* Keep length in sync */
-      return 1;
-    }
-    
-    if (entry->hash == hash && aqlD_keyequal(&entry->key, key)) {
-      /* Update existing key */
-      setobj(L, &entry->value, value);
-      return 1;
-    }
-    
-    /* Robin Hood: if we've traveled further, swap and continue */
-    if (to_insert.distance > entry->distance) {
-      DictEntry temp = *entry;
-      *entry = to_insert;
-      to_insert = temp;
-      /* Update distance for the displaced entry */
-      to_insert.distance = distance;
+  if (aqlD_iscompact(dict)) {
+    /* Append to the dense array, then index it */
+    unsigned int ei = cast(unsigned int, dict->nentries++);
+    dict->entries[ei] = to_insert;
+    if (!rawinsert(dict, NULL, &ei)) {
+      /* Probe sequence too long: rebuild the index larger */
+      if (!dict_resize(L, dict, dict->capacity * 2))
+        return 0;
     }
-    
-    to_insert.distance++;
-    index = (index + 1) & dict->mask;
   }
+  else if (!rawinsert(dict, &to_insert, NULL)) {
+    /* Probe sequence too long: grow and place the displaced entry */
+    if (!dict_resize(L, dict, dict->capacity * 2))
+      return 0;
+    return aqlD_set(L, dict, &to_insert.key, &to_insert.value);
+  }
+  
+  dict->size++;
+  dict->length = dict->size;  /* Keep length in sync */
+  return 1;
 }
 
 /*
-** Delete key from dict
+** Delete key from dict (backward-shift deletion, no tombstones in the
+** hash table; compact dicts only mark the dense entry as removed)
 */
 AQL_API int aqlD_delete(Dict *dict, const TValue *key) {
   if (dict == NULL || key == NULL) return 0;
   
-  DictEntry *entry = findentry(dict, key);
-  if (entry == NULL) return 0;  /* Key not found */
+  if (aqlD_issmall(dict)) {
+    DictEntry *entry = smallfind(dict, key);
+    if (entry == NULL) return 0;  /* Key not found */
+    dict->shape = NULL;  /* slots move: no longer matches a shape */
+    /* Close the gap, keeping insertion order */
+    memmove(entry, entry + 1,
+            (dict->entries + dict->size - entry - 1) * sizeof(DictEntry));
+    dict->nentries = --dict->size;
+    dict->length = dict->size;
+    return 1;
+  }
+  
+  size_t index = findslot(dict, key, aqlD_hash(key));
+  if (index == DICT_NOSLOT) return 0;  /* Key not found */
+  
+  if (aqlD_iscompact(dict)) {
+    DictEntry *entry = &dict->entries[dict->index[index]];
+    settt_(&entry->key, AQL_TDEADKEY);
+    setnilvalue(&entry->value);
+    if (dict->index[index] == dict->nentries - 1)
+      dict->nentries--;  /* last one: reuse its place */
+  }
   
-  /* Mark as deleted and shift entries back */
-  size_t index = entry - dict->entries;
+  /* Shift following entries of the cluster one slot back */
   size_t next_index = (index + 1) & dict->mask;
   
-  while (!aqlD_entry_empty(&dict->entries[next_index]) && 
-         dict->entries[next_index].distance > 0) {
-    dict->entries[index] = dict->entries[next_index];
-    dict->entries[index].distance--;
+  while (dict->ctrl[next_index] != DICT_EMPTY && dict->dist[next_index] > 0) {
+    if (aqlD_iscompact(dict))
+      dict->index[index] = dict->index[next_index];
+    else
+      dict->entries[index] = dict->entries[next_index];
+    setctrl(dict, index, dict->ctrl[next_index]);
+    dict->dist[index] = dict->dist[next_index] - 1;
     
     index = next_index;
     next_index = (next_index + 1) & dict->mask;
   }
   
-  /* Clear the final entry */
-  dict->entries[index].hash = 0;
-  dict->entries[index].distance = 0;
-  setnilvalue(&dict->entries[index].key);
-  setnilvalue(&dict->entries[index].value);
+  /* Clear the final slot */
+  setctrl(dict, index, DICT_EMPTY);
+  dict->dist[index] = 0;
+  if (!aqlD_iscompact(dict)) {
+    setnilvalue(&dict->entries[index].key);
+    setnilvalue(&dict->entries[index].value);
+  }
   
   dict->size--;
   dict->length = dict->size;
@@ -369,17 +683,16 @@ AQL_API size_t aqlD_size(const Dict *dict) {
 }
 
 /*
-** Reserve capacity for dict
+** Reserve room for 'capacity' entries, rehashing at most once
 */
 AQL_API int aqlD_reserve(aql_State *L, Dict *dict, size_t capacity) {
   if (dict == NULL) return 0;
   
-  /* Round up to power of 2 */
-  capacity = 1 << aqlO_ceillog2((unsigned int)capacity);
-  
-  if (capacity <= dict->capacity) return 1;  /* Already have enough */
+  if (aqlD_issmall(dict) && capacity <= DICT_SMALL) return 1;
+  size_t slots = slotsfor(capacity);
+  if (slots <= dict->capacity) return 1;  /* Already have enough */
   
-  return dict_resize(L, dict, capacity);
+  return dict_resize(L, dict, slots);
 }
 
 /*
@@ -388,13 +701,14 @@ AQL_API int aqlD_reserve(aql_State *L, Dict *dict, size_t capacity) {
 AQL_API void aqlD_clear(Dict *dict) {
   if (dict == NULL) return;
   
-  for (size_t i = 0; i < dict->capacity; i++) {
-    dict->entries[i].hash = 0;
-    dict->entries[i].distance = 0;
-    setnilvalue(&dict->entries[i].key);
-    setnilvalue(&dict->entries[i].value);
+  if (!aqlD_issmall(dict))
+    memset(dict->ctrl, DICT_EMPTY, sizedictmeta(dict->capacity));
+  else if (dict->shape != NULL) {
+    while (dict->shape->parent != NULL)  /* back to the empty shape */
+      dict->shape = dict->shape->parent;
   }
-  
+  dict->maxdist = 0;
+  dict->nentries = 0;
   dict->size = 0;
   dict->length = 0;
 }
@@ -406,13 +720,13 @@ AQL_API int aqlD_copy(aql_State *L, Dict *dest, const Dict *src) {
   if (dest == NULL || src == NULL) return 0;
   
   aqlD_clear(dest);
+  if (!aqlD_reserve(L, dest, src->size)) return 0;
   
-  for (size_t i = 0; i < src->capacity; i++) {
-    const DictEntry *entry = &src->entries[i];
-    if (!aqlD_entry_empty(entry)) {
-      if (!aqlD_set(L, dest, &entry->key, &entry->value)) {
-        return 0;  /* Failed to set */
-      }
+  DictIterator iter;
+  TValue *k, *v;
+  aqlD_foreach((Dict *)src, iter, k, v) {
+    if (!aqlD_set(L, dest, k, v)) {
+      return 0;  /* Failed to set */
     }
   }
   
@@ -424,13 +738,13 @@ AQL_API int aqlD_copy(aql_State *L, Dict *dest, const Dict *src) {
 */
 AQL_API int aqlD_merge(aql_State *L, Dict *dest, const Dict *src) {
   if (dest == NULL || src == NULL) return 0;
+  if (!aqlD_reserve(L, dest, dest->size + src->size)) return 0;
   
-  for (size_t i = 0; i < src->capacity; i++) {
-    const DictEntry *entry = &src->entries[i];
-    if (!aqlD_entry_empty(entry)) {
-      if (!aqlD_set(L, dest, &entry->key, &entry->value)) {
-        return 0;  /* Failed to set */
-      }
+  DictIterator iter;
+  TValue *k, *v;
+  aqlD_foreach((Dict *)src, iter, k, v) {
+    if (!aqlD_set(L, dest, k, v)) {
+      return 0;  /* Failed to set */
     }
   }
   
@@ -450,19 +764,8 @@ AQL_API void aqlD_iter_init(DictIterator *iter, Dict *dict) {
 
 AQL_API int aqlD_iter_next(DictIterator *iter) {
   if (iter == NULL || iter->dict == NULL) return 0;
-  
-  while (iter->index < iter->dict->capacity) {
-    DictEntry *entry = &iter->dict->entries[iter->index];
-    iter->index++;
-    
-    if (!aqlD_entry_empty(entry)) {
-      iter->entry = entry;
-      return 1;  /* Found next entry */
-    }
-  }
-  
-  iter->entry = NULL;
-  return 0;  /* No more entries */
+  iter->entry = aqlD_nextentry(iter->dict, &iter->index);
+  return (iter->entry != NULL);
 }
 
 /*
@@ -516,13 +819,12 @@ int aqlD_equal(const Dict *a, const Dict *b) {
   if (a->size != b->size) return 0;
   
   /* Check all entries in a exist in b with same values */
-  for (size_t i = 0; i < a->capacity; i++) {
-    const DictEntry *entry = &a->entries[i];
-    if (!aqlD_entry_empty(entry)) {
-      const TValue *b_value = aqlD_get(b, &entry->key);
-      if (b_value == NULL || !aqlD_keyequal(&entry->value, b_value)) {
-        return 0;
-      }
+  DictIterator iter;
+  TValue *k, *v;
+  aqlD_foreach((Dict *)a, iter, k, v) {
+    const TValue *b_value = aqlD_get(b, k);
+    if (b_value == NULL || !aqlD_keyequal(v, b_value)) {
+      return 0;
     }
   }
   
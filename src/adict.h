@@ -11,21 +11,78 @@
 #include "adatatype.h"
 
 /*
-** Dictionary entry states
+** Slot metadata is kept apart from key/value storage (SoA layout):
+** 'ctrl' holds one control byte per slot (0 = empty, otherwise 0x80
+** plus a 7-bit fragment of the hash) and 'dist' holds the Robin Hood
+** probe distance of the slot. 'ctrl' has DICT_GROUP extra bytes that
+** mirror the first slots, so a whole group of DICT_GROUP control bytes
+** can be loaded from any position without wrapping.
 */
-#define DICT_EMPTY      0
-#define DICT_OCCUPIED   1
-#define DICT_DELETED    2
+#define DICT_GROUP      16    /* slots probed per step (one SSE2 vector) */
+#define DICT_EMPTY      0     /* control byte of an empty slot */
+#define DICT_MAXDIST    255   /* largest probe distance stored in 'dist' */
+
+/* control byte for a given hash: high bit set plus 7 hash bits */
+#define dict_h2(h)      ((aql_byte)(0x80 | (((h) >> 25) & 0x7F)))
+
+/*
+** Compact dicts (DICT_FCOMPACT) keep entries in a dense array in
+** insertion order; the hash table slots then only hold the position
+** of their entry in that array ('index'). Iteration walks the dense
+** array, so it follows insertion order and costs O(size).
+*/
+#define DICT_FCOMPACT   (1 << 0)
+
+#define aqlD_iscompact(d)  ((d)->flags & DICT_FCOMPACT)
+
+/*
+** Small dicts (DICT_FSMALL) hold up to DICT_SMALL entries inline, right
+** after the Dict header, with no hash table at all: lookups are a
+** linear scan (pointer equality for interned short strings). The first
+** insertion beyond DICT_SMALL promotes the dict to the hashed form.
+*/
+#define DICT_FSMALL     (1 << 1)
+#define DICT_SMALL      8
+
+#define aqlD_issmall(d)    ((d)->flags & DICT_FSMALL)
+
+/* inline entry area of a dict and size of a dict with 'n' inline slots */
+#define dictinline(d)   (cast(DictEntry *, (d) + 1))
+#define sizedict(n)     (sizeof(Dict) + (n) * sizeof(DictEntry))
+
+/* bytes of metadata ('ctrl' + mirror + 'dist') for 'n' slots */
+#define sizedictmeta(n) (2 * (n) + DICT_GROUP)
+
+/*
+** Shapes (hidden classes): small dicts whose keys are short strings
+** added in the same order share one Shape describing that key
+** sequence, so the value of the i-th key always lives in slot i of
+** the inline entries. Shapes form a transition tree rooted at
+** 'G(L)->shaperoot' and live until the state is closed.
+*/
+typedef struct Shape {
+    struct Shape *parent; /* Shape without the last key (NULL for root) */
+    struct Shape *kids;   /* Transitions adding one more key */
+    struct Shape *next;   /* Next sibling in parent's 'kids' */
+    TString *key;         /* Key added by this transition */
+    int nkeys;            /* Number of keys; 'key' is in slot nkeys-1 */
+} Shape;
+
+/*
+** Per-instruction inline cache for OP_GETPROP with a constant key
+*/
+typedef struct PropCache {
+    const Shape *shape;   /* Shape seen at this site (NULL = empty) */
+    int slot;             /* Slot of the key in that shape */
+} PropCache;
 
 /*
-** Dictionary entry - Open addressing with Robin Hood hashing
+** Dictionary entry - key/value storage for one slot
 */
 typedef struct DictEntry {
     TValue key;           /* Key value */
     TValue value;         /* Value data */
     aql_Unsigned hash;    /* Hash value for quick comparison */
-    aql_byte distance;    /* Distance from ideal position (Robin Hood) */
-    aql_byte flags;       /* Entry state flags */
 } DictEntry;
 
 /*
@@ -39,15 +96,25 @@ struct Dict {
     size_t length;        /* Number of entries (compatibility) */
     size_t capacity;      /* Hash table capacity (power of 2) */
     size_t mask;          /* Hash mask (capacity - 1) */
+    size_t maxdist;       /* Upper bound of probe distances in use */
     aql_byte load_factor; /* Load factor threshold (0-255 for 0.0-1.0) */
-    DictEntry *entries;   /* Hash table array */
+    aql_byte flags;       /* Representation flags (DICT_F*) */
+    aql_byte ninline;     /* Inline entry slots allocated after header */
+    aql_byte *ctrl;       /* Control bytes (capacity + DICT_GROUP) */
+    aql_byte *dist;       /* Probe distances (capacity) */
+    unsigned int *index;  /* Compact only: slot -> dense entry position */
+    Shape *shape;         /* Small only: key sequence, or NULL if none */
+    size_t nentries;      /* Compact/small: used part of 'entries' */
+    size_t entcap;        /* Allocated size of 'entries' */
+    DictEntry *entries;   /* Key/value array (dense when compact) */
 };
 
 /*
-** Dict creation and destruction
+** Dict creation and destruction ('aqlD_newcap' presizes for entries)
 */
 AQL_API Dict *aqlD_new(aql_State *L, DataType key_type, DataType value_type);
 AQL_API Dict *aqlD_newcap(aql_State *L, DataType key_type, DataType value_type, size_t capacity);
+AQL_API Dict *aqlD_newcompact(aql_State *L, DataType key_type, DataType value_type, size_t capacity);
 AQL_API void aqlD_free(aql_State *L, Dict *dict);
 
 /*
@@ -59,7 +126,7 @@ AQL_API int aqlD_delete(Dict *dict, const TValue *key);
 AQL_API size_t aqlD_size(const Dict *dict);
 
 /*
-** Dict capacity management
+** Dict capacity management ('capacity' counts entries, not slots)
 */
 AQL_API int aqlD_reserve(aql_State *L, Dict *dict, size_t capacity);
 AQL_API void aqlD_clear(Dict *dict);
@@ -77,12 +144,8 @@ static l_inline DictEntry *aqlD_getentry(Dict *dict, size_t index) {
   return &dict->entries[index];
 }
 
-static l_inline int aqlD_entry_empty(const DictEntry *entry) {
-  return ttisnil(&entry->key);
-}
-
-static l_inline int aqlD_entry_deleted(const DictEntry *entry) {
-  return ttisnil(&entry->key) && !ttisnil(&entry->value);
+static l_inline int aqlD_slotempty(const Dict *dict, size_t index) {
+  return dict->ctrl[index] == DICT_EMPTY;
 }
 
 /*
@@ -94,6 +157,12 @@ static l_inline int aqlD_entry_deleted(const DictEntry *entry) {
 ** - gco2dict(o)
 */
 
+/*
+** Shape support
+*/
+AQL_API int aqlD_shapeslot(const Shape *shape, const TString *key);
+AQL_API void aqlD_freeshapes(aql_State *L);
+
 /*
 ** Dict utility functions
 */
@@ -112,13 +181,41 @@ typedef struct DictIterator {
 AQL_API void aqlD_iter_init(DictIterator *iter, Dict *dict);
 AQL_API int aqlD_iter_next(DictIterator *iter);
 
+/*
+** Next live entry at or after cursor '*index' (advanced past it), or
+** NULL at the end. Dense dicts walk their entries in insertion order,
+** hashed ones walk the slots. The cursor is a plain integer, so it can
+** live in a VM register (OP_ITER_NEXT).
+*/
+static l_inline DictEntry *aqlD_nextentry(Dict *dict, size_t *index) {
+  size_t i = *index;
+  if (aqlD_iscompact(dict) || aqlD_issmall(dict)) {
+    for (; i < dict->nentries; i++) {
+      if (!checktag(&dict->entries[i].key, AQL_TDEADKEY)) {
+        *index = i + 1;
+        return &dict->entries[i];
+      }
+    }
+  }
+  else {
+    for (; i < dict->capacity; i++) {
+      if (!aqlD_slotempty(dict, i)) {
+        *index = i + 1;
+        return &dict->entries[i];
+      }
+    }
+  }
+  *index = i;
+  return NULL;
+}
+
 /*
 ** Dict iteration macro
 */
-#define aqlD_foreach(dict, iter, key, value) \
+#define aqlD_foreach(dict, iter, k, v) \
     for (aqlD_iter_init(&iter, dict); \
          aqlD_iter_next(&iter) && \
-         ((key) = &iter.entry->key, (value) = &iter.entry->value); )
+         ((k) = &iter.entry->key, (v) = &iter.entry->value); )
 
 /*
 ** Dict metamethods
@@ -7,6 +7,14 @@
 #define ado_c
 #define AQL_CORE
 
+/* anonymous mappings for thread stacks are outside strict POSIX */
+#if !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+#if defined(__APPLE__) && !defined(_DARWIN_C_SOURCE)
+#define _DARWIN_C_SOURCE
+#endif
+
 #include "aconf.h"
 
 #include <setjmp.h>
@@ -35,13 +43,30 @@
 /* #include "avm.h" - removed to avoid conflicts */
 #include "azio.h"
 
+#if defined(AQL_MMAPSTACK)
+#include <sys/mman.h>
+#include <unistd.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+#if !defined(MAP_ANONYMOUS)
+#error "AQL_MMAPSTACK needs anonymous mappings; define AQL_NOMMAPSTACK"
+#endif
+#endif
+
 /* Forward declarations to avoid circular dependencies */
 AQL_API int aqlV_execute(aql_State *L, CallInfo *ci);
 extern Dict *get_globals_dict(aql_State *L);
 extern CallInfo *aqlE_extendCI(aql_State *L);
 
+/* reuse the next CallInfo of the thread's list, growing it only when empty */
+#define next_ci(L)  (L->ci->next ? L->ci->next : aqlE_extendCI(L))
+
 #define errorstatus(s)	((s) > AQL_YIELD)
 
+/* stack size while handling a stack overflow */
+#define ERRORSTACKSIZE	(AQL_MAXSTACK + 200)
+
 /* maximum number of C calls */
 #ifndef AQL_MAXCCALLS
 #define AQL_MAXCCALLS		200
@@ -81,6 +106,8 @@ AQL_API void aqlD_seterrorobj(aql_State *L, int errcode, StkId oldtop) {
 ** Throw an error
 */
 AQL_API l_noret aqlD_throw(aql_State *L, int errcode) {
+  if (errcode != AQL_YIELD)
+    aqlZ_outflush(L);  /* output printed so far precedes the error report */
   if (L->errorJmp) {  /* thread has an error handler? */
     L->errorJmp->status = errcode;  /* set status */
     longjmp(L->errorJmp->b, 1);  /* jump back */
@@ -149,6 +176,103 @@ AQL_API int aqlD_rawrunprotected(aql_State *L, Pfunc f, void *ud) {
 
 /* }====================================================== */
 
+/*
+** {======================================================
+** Stack memory
+** =======================================================
+*/
+
+#if defined(AQL_MMAPSTACK)
+
+#if !defined(MAP_NORESERVE)
+#define MAP_NORESERVE	0
+#endif
+
+/* address space reserved for each stack: the most it can ever hold */
+#define STACKRESERVE	((size_t)(ERRORSTACKSIZE + EXTRA_STACK) * sizeof(StackValue))
+
+/* bytes of committed pages needed to hold 'n' stack slots */
+static size_t stackpages (int n) {
+  static size_t pagesize = 0;
+  size_t bytes = (size_t)n * sizeof(StackValue);
+  if (pagesize == 0)
+    pagesize = (size_t)sysconf(_SC_PAGESIZE);
+  return (bytes + pagesize - 1) & ~(pagesize - 1);
+}
+
+/*
+** Commit or release pages of a mapped stack so that exactly the pages
+** holding its first 'newn' slots are usable. Pages past them stay
+** reserved and inaccessible, guarding the end of the stack.
+*/
+static int commitstack (StackValue *stack, int oldn, int newn) {
+  size_t oldb = stackpages(oldn), newb = stackpages(newn);
+  if (newb > oldb)
+    return mprotect((char *)stack + oldb, newb - oldb,
+                    PROT_READ | PROT_WRITE) == 0;
+  else if (newb < oldb) {  /* give the memory back, keep the addresses */
+    (void)madvise((char *)stack + newb, oldb - newb, MADV_DONTNEED);
+    (void)mprotect((char *)stack + newb, oldb - newb, PROT_NONE);
+  }
+  return 1;
+}
+
+/*
+** Resize a mapped stack in place: only page protections change, so no
+** pointer into the stack has to be corrected.
+*/
+static int remapstack (aql_State *L, int newsize, int raiseerror) {
+  int lim = stacksize(L) + EXTRA_STACK;
+  if (!commitstack(L->stack.p, lim, newsize + EXTRA_STACK)) {
+    if (raiseerror)
+      aqlG_runerror(L, "stack overflow");
+    return 0;
+  }
+  for (; lim < newsize + EXTRA_STACK; lim++)
+    setnilvalue(s2v(L->stack.p + lim));  /* erase new segment */
+  L->stack_last.p = L->stack.p + newsize;
+  return 1;
+}
+
+#endif
+
+/*
+** Allocate the stack of thread 'L1' with 'size' slots (EXTRA_STACK
+** included). With AQL_MMAPSTACK the whole reserve is mapped up front
+** and only the pages for 'size' are committed; if that fails, the stack
+** is an ordinary block grown by 'aqlD_reallocstack_impl'.
+*/
+AQL_API StackValue *aqlD_newstack (aql_State *L, aql_State *L1, int size) {
+#if defined(AQL_MMAPSTACK)
+  void *p = mmap(NULL, STACKRESERVE, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p != MAP_FAILED) {
+    if (commitstack(cast(StackValue *, p), 0, size)) {
+      L1->stackmapped = 1;
+      return cast(StackValue *, p);
+    }
+    munmap(p, STACKRESERVE);
+  }
+#endif
+  L1->stackmapped = 0;
+  return aqlM_newvector(L, size, StackValue);
+}
+
+/*
+** Free the stack of thread 'L', which currently has 'size' slots
+*/
+AQL_API void aqlD_freestack (aql_State *L, int size) {
+#if defined(AQL_MMAPSTACK)
+  if (L->stackmapped) {
+    munmap(L->stack.p, STACKRESERVE);
+    return;
+  }
+#endif
+  aqlM_freearray(L, L->stack.p, size);
+}
+
+/* }====================================================== */
+
 /*
 ** {======================================================
 ** Stack reallocation
@@ -273,6 +397,11 @@ int aqlD_reallocstack_impl(aql_State *L, int newsize, int raiseerror) {
   aql_assert(newsize <= AQL_MAXSTACK || newsize == ERRORSTACKSIZE);
   aql_assert(L->stack_last.p - L->stack.p == oldsize - EXTRA_STACK);
   
+#if defined(AQL_MMAPSTACK)
+  if (L->stackmapped)  /* grows in place: nothing moves */
+    return remapstack(L, newsize, raiseerror);
+#endif
+
   /* Step 1: Convert all pointers to offsets (like Lua's relstack) */
   relstack(L);
   
@@ -357,17 +486,22 @@ AQL_API int aqlD_growstack(aql_State *L, int n, int raiseerror) {
     if (raiseerror)
       aqlD_throw(L, AQL_ERRERR);  /* error inside message handler */
     return 0;  /* if not 'raiseerror', just signal it */
-  } else {
+  } else if (n < AQL_MAXSTACK) {  /* avoids arithmetic overflows */
     int needed = cast_int(L->top.p - L->stack.p) + n;
     int newsize = aql_calculate_smart_stack_size(L, size, needed);
     
     if (newsize > AQL_MAXSTACK)  /* cannot cross the limit */
       newsize = AQL_MAXSTACK;
-    if (newsize < size)  /* overflow in 'newsize'? */
-      newsize = AQL_MAXSTACK;  /* assume maximum possible size */
-      
-    return aqlD_reallocstack_impl(L, newsize, raiseerror);
+    if (newsize < needed)  /* but must respect what was asked for */
+      newsize = needed;
+    if (l_likely(newsize <= AQL_MAXSTACK))
+      return aqlD_reallocstack_impl(L, newsize, raiseerror);
   }
+  /* else stack is in its limit: add extra size to handle the error */
+  aqlD_reallocstack_impl(L, ERRORSTACKSIZE, raiseerror);
+  if (raiseerror)
+    aqlG_runerror(L, "stack overflow");
+  return 0;
 }
 
 /*
@@ -413,165 +547,87 @@ AQL_API void aqlD_inctop(aql_State *L) {
 ** Move results from function call to proper place
 */
 static void moveresults(aql_State *L, StkId res, int nres, int wanted) {
-  aql_debug("[DEBUG] moveresults: res=%p, nres=%d, wanted=%d, L->top=%p\n", 
-               (void*)res, nres, wanted, (void*)L->top.p);
-  
+  StkId firstresult;
+  int i;
   switch (wanted) {
     case 0:  /* no values needed */
       L->top.p = res;
       return;
     case 1:  /* one value needed */
       if (nres == 0) {  /* no results? */
-        aql_debug("[DEBUG] moveresults: no results, setting nil\n");
         setnilvalue(s2v(res));  /* adjust with nil */
-      } else {  /* at least one result */
-        StkId src = L->top.p - nres;
-        aql_debug("[DEBUG] moveresults: moving result from %p to %p\n", (void*)src, (void*)res);
-        
-        /* Safety check: ensure src is within stack bounds */
-        if (src < L->stack.p || src >= L->stack_last.p) {
-          aql_debug("[ERROR] moveresults: src %p out of bounds (stack=%p, stack_last=%p)\n", 
-                       (void*)src, (void*)L->stack.p, (void*)L->stack_last.p);
-          aqlG_runerror(L, "moveresults: source pointer out of bounds");
-          return;
-        }
-        
-        /* Safety check: ensure res is within stack bounds */
-        if (res < L->stack.p || res >= L->stack_last.p) {
-          aql_debug("[ERROR] moveresults: res %p out of bounds (stack=%p, stack_last=%p)\n", 
-                       (void*)res, (void*)L->stack.p, (void*)L->stack_last.p);
-          aqlG_runerror(L, "moveresults: result pointer out of bounds");
-          return;
-        }
-        
-        aql_debug("[DEBUG] moveresults: source value type=%d\n", rawtt(s2v(src)));
-        
-        /* Additional safety check: verify src and res pointers are valid */
-        if ((char*)src < (char*)L->stack.p || (char*)src >= (char*)L->stack_last.p) {
-          aql_debug("[ERROR] moveresults: src pointer %p invalid after bounds check\n", (void*)src);
-          aqlG_runerror(L, "moveresults: invalid source pointer");
-          return;
-        }
-        if ((char*)res < (char*)L->stack.p || (char*)res >= (char*)L->stack_last.p) {
-          aql_debug("[ERROR] moveresults: res pointer %p invalid after bounds check\n", (void*)res);
-          aqlG_runerror(L, "moveresults: invalid result pointer");
-          return;
-        }
-        
-        aql_debug("[DEBUG] moveresults: about to call setobj2s(res=%p, src=%p)\n", (void*)res, (void*)src);
-        setobj2s(L, res, s2v(src));  /* move it to proper place */
-        aql_debug("[DEBUG] moveresults: setobj2s completed successfully\n");
+      }
+      else {  /* at least one result */
+        setobjs2s(L, res, L->top.p - nres);  /* move it to proper place */
       }
       L->top.p = res + 1;
       return;
     case AQL_MULTRET:
       wanted = nres;  /* we want all results */
-      /* fall through */
+      break;
     default:
-      if (wanted <= nres) {
-        /* move wanted results */
-        aql_debug("[DEBUG] moveresults: moving %d results from L->top-nres=%p to res=%p\n", 
-                     wanted, (void*)(L->top.p - nres), (void*)res);
-        for (int i = 0; i < wanted; i++) {
-          StkId src = L->top.p - nres + i;
-          StkId dst = res + i;
-          aql_debug("[DEBUG] moveresults: [%d] moving from %p (type=%d, val=%d) to %p\n", 
-                       i, (void*)src, rawtt(s2v(src)), 
-                       (ttisinteger(s2v(src)) ? ivalue(s2v(src)) : -999), (void*)dst);
-          setobj2s(L, dst, s2v(src));
-        }
-        L->top.p = res + wanted;
-      } else {
-        /* move all results and fill with nil */
-        for (int i = 0; i < nres; i++)
-          setobj2s(L, res + i, s2v(L->top.p - nres + i));
-        for (int i = nres; i < wanted; i++)
-          setnilvalue(s2v(res + i));
-        L->top.p = res + wanted;
-      }
-      return;
+      break;
   }
+  firstresult = L->top.p - nres;  /* index of first result */
+  if (nres > wanted)  /* extra results? */
+    nres = wanted;  /* don't need them */
+  for (i = 0; i < nres; i++)  /* move all results to correct place */
+    setobjs2s(L, res + i, firstresult + i);
+  for (; i < wanted; i++)  /* complete wanted number of results */
+    setnilvalue(s2v(res + i));
+  L->top.p = res + wanted;  /* top points after the last result */
 }
 
 /*
 ** Post-call function (handles function return)
 */
 AQL_API int aqlD_poscall(aql_State *L, CallInfo *ci, int nres) {
-  int wanted = ci->nresults;
-  
-  aql_debug("[DEBUG] aqlD_poscall: ci=%p, nres=%d, wanted=%d\n", (void*)ci, nres, wanted);
-  
-  /* Move results to proper place */
-  moveresults(L, ci->func.p, nres, wanted);
-  
-  /* CRITICAL: Close upvalues before returning (like Lua) */
-  /* This preserves captured variables by copying them from stack to upvalue storage */
-  StkId func_base = ci->func.p + 1;  /* base of function being returned from */
-  aql_debug("[DEBUG] aqlD_poscall: closing upvalues at level %p\n", (void*)func_base);
-  aqlF_closeupval(L, func_base);
-  
-  /* Check if this is returning to the base C frame. */
-  if (ci->previous == NULL || ci->previous == &L->base_ci) {
-    aql_debug("[DEBUG] aqlD_poscall: base call, returning 1 (exit VM)\n");
-    return 1;  /* Exit VM execution */
-  }
-  
-  /* Restore previous CallInfo */
-  L->ci = ci->previous;
-  aql_debug("[DEBUG] aqlD_poscall: restored previous CallInfo, returning 0 (continue)\n");
-  
-  /* Continue execution in caller */
+  moveresults(L, ci->func.p, nres, ci->nresults);
+  /* close upvalues of the returning frame (copies captured values out) */
+  aqlF_closeupval(L, ci->func.p + 1);
+  if (ci->previous == NULL || ci->previous == &L->base_ci)
+    return 1;  /* returning to the base C frame: exit VM */
+  L->ci = ci->previous;  /* back to caller */
   return 0;
 }
 
 /*
-** Prepare a tail call
+** Prepare a tail call. An AQL callee takes over the caller's frame and
+** CallInfo: function and arguments are moved down to the caller's base,
+** so a chain of tail calls runs in constant stack and never allocates a
+** CallInfo. The stack only has to hold the callee's frame from that base.
+** Return -1 for an AQL function; for a C function, call it and return
+** its number of results (left on top of the stack).
 */
 AQL_API int aqlD_pretailcall(aql_State *L, CallInfo *ci, StkId func, int narg1, int delta) {
-  /* Tail call optimization implementation (based on Lua's luaD_pretailcall) */
-  aql_debug("[DEBUG] aqlD_pretailcall: func=%p, narg1=%d, delta=%d\n", 
-               (void*)func, narg1, delta);
-  
-  /* Check if it's a Lua function */
-  if (ttisclosure(s2v(func))) {
-    LClosure *cl = clLvalue(s2v(func));
-    Proto *p = cl->p;
+  if (ttisLclosure(s2v(func))) {  /* AQL function: reuse the frame */
+    Proto *p = clLvalue(s2v(func))->p;
     int fsize = p->maxstacksize;  /* frame size */
     int nfixparams = p->numparams;
-    
-    aql_debug("[DEBUG] pretailcall: Lua function, fsize=%d, nfixparams=%d, narg1=%d\n", 
-                 fsize, nfixparams, narg1);
-    
-    /* Move down function and arguments (like Lua) */
-    ci->func.p -= delta;  /* restore 'func' (if vararg) */
-    for (int i = 0; i < narg1; i++) {  /* move down function and arguments */
-      setobj2s(L, ci->func.p + i, s2v(func + i));
-      aql_debug("[DEBUG] pretailcall: moved func+arg %d from %p to %p\n", 
-                   i, (void*)(func + i), (void*)(ci->func.p + i));
+    int i;
+    if (l_unlikely(L->stack_last.p - (ci->func.p - delta) <= fsize)) {
+      ptrdiff_t t = savestack(L, func);
+      aqlD_growstack(L, fsize, 1);  /* raises "stack overflow" at the limit */
+      func = restorestack(L, t);
     }
+    ci->func.p -= delta;  /* restore 'func' (if vararg) */
+    for (i = 0; i < narg1; i++)  /* move down function and arguments */
+      setobjs2s(L, ci->func.p + i, func + i);
     func = ci->func.p;  /* moved-down function */
-    
-    /* Complete missing arguments with nil (like Lua) */
-    for (; narg1 <= nfixparams; narg1++) {
-      setnilvalue(s2v(func + narg1));
-      aql_debug("[DEBUG] pretailcall: set nil for missing arg %d\n", narg1);
-    }
-    
-    /* Update call info for new function with safety buffer */
-    int safe_fsize = fsize + AQL_FUNCTION_STACK_SAFETY;  /* Add safety buffer */
-    ci->top.p = func + 1 + safe_fsize;  /* top for new function */
+    ci->u.l.nextraargs = (narg1 - 1 > nfixparams) ? narg1 - 1 - nfixparams : 0;
+    for (; narg1 <= nfixparams; narg1++)
+      setnilvalue(s2v(func + narg1));  /* complete missing arguments */
+    ci->top.p = func + 1 + fsize;  /* top for new function */
     ci->u.l.savedpc = p->code;  /* starting point */
-    ci->callstatus |= CIST_TAIL;  /* Mark as tail call - CRITICAL for TCO */
+    ci->callstatus |= CIST_TAIL;
     L->top.p = func + narg1;  /* set top */
-    
-    aql_debug("[DEBUG] pretailcall: tail call optimized, reusing CallInfo (no stack growth)\n");
-    aql_debug("[DEBUG] pretailcall: ci->callstatus=0x%x, CIST_TAIL=%d\n", 
-                 ci->callstatus, (ci->callstatus & CIST_TAIL) ? 1 : 0);
-    return -1;  /* Lua function, continue execution without new CallInfo */
-  } else {
-    /* C function - not optimized for now */
-    aql_debug("[DEBUG] pretailcall: C function, no optimization\n");
-    return 0;
+    return -1;
+  }
+  else {  /* C function: call it now, the caller returns its results */
+    CClosure *ccl = clCvalue(s2v(func));
+    if (l_unlikely(L->stack_last.p - L->top.p <= AQL_MINSTACK))
+      aqlD_growstack(L, AQL_MINSTACK, 1);
+    return ccl->f(L);
   }
 }
 
@@ -579,14 +635,16 @@ AQL_API int aqlD_pretailcall(aql_State *L, CallInfo *ci, StkId func, int narg1,
 ** Call a function (without yielding)
 */
 AQL_API void aqlD_callnoyield(aql_State *L, StkId func, int nResults) {
-  L->nCcalls++;
-  if (l_unlikely(L->nCcalls >= AQL_MAXCCALLS)) {
+  CallInfo *ci;
+  L->nCcalls += nyci;  /* a C frame in between: cannot yield across it */
+  if (l_unlikely(getCcalls(L) >= AQL_MAXCCALLS)) {
     aqlD_throw(L, AQL_ERRERR);
   }
-  if (aqlD_precall(L, func, nResults) != NULL) {  /* is a AQL function? */
-    aqlV_execute(L, L->ci);  /* call it */
+  if ((ci = aqlD_precall(L, func, nResults)) != NULL) {  /* AQL function? */
+    ci->callstatus |= CIST_FRESH;  /* the VM returns when this frame ends */
+    aqlV_execute(L, ci);  /* call it */
   }
-  L->nCcalls--;
+  L->nCcalls -= nyci;
 }
 
 /*
@@ -601,103 +659,44 @@ AQL_API void aqlD_call(aql_State *L, StkId func, int nResults) {
 */
 AQL_API CallInfo *aqlD_precall(aql_State *L, StkId func, int nResults) {
   TValue *f = s2v(func);
-  ptrdiff_t func_offset = savestack(L, func);  /* Save func offset before potential reallocation */
-  
-  if (ttisLclosure(f)) {
-    /* AQL function call - set up proper CallInfo */
-    LClosure *cl = clLvalue(f);
-    Proto *p = cl->p;
-    int n = cast_int(L->top.p - func) - 1;  /* number of arguments */
-    int nextraargs = (n > p->numparams) ? (n - p->numparams) : 0;
-    
-    aql_debug("[DEBUG] aqlD_precall: AQL function, proto=%p, code=%p, nargs=%d, numparams=%d\n", 
-                 (void*)p, (void*)p->code, n, p->numparams);
-    aql_debug("[DEBUG] aqlD_precall: p->maxstacksize=%d, func=%p, L->top=%p, L->stack_last=%p\n",
-                 p->maxstacksize, (void*)func, (void*)L->top.p, (void*)L->stack_last.p);
-    
-    /* Check stack overflow and handle with dynamic stack growth */
-    if (L->top.p + p->maxstacksize > L->stack_last.p) {
-      aql_debug("[DEBUG] aqlD_precall: stack overflow detected at depth %d\n", L->nCcalls);
-      
-      /* Calculate needed stack space */
-      int needed = cast_int((L->top.p + p->maxstacksize) - L->stack_last.p) + EXTRA_STACK;
-      aql_debug("[DEBUG] aqlD_precall: attempting stack growth, needed=%d\n", needed);
-      
-      /* Attempt stack reallocation (fixed upvalue bug enables this) */
-      if (!aqlD_growstack(L, needed, 0)) {
-        aql_debug("[DEBUG] aqlD_precall: failed to grow stack, aborting\n");
-        aqlG_runerror(L, "stack overflow - unable to allocate memory");
-        return NULL;
-      }
-      
-      /* CRITICAL: Restore func pointer after stack reallocation */
-      func = restorestack(L, func_offset);
-      f = s2v(func);  /* Update f pointer as well */
-      
-      aql_debug("[DEBUG] aqlD_precall: stack grown successfully to %d elements\n", stacksize(L));
-      aql_debug("[DEBUG] aqlD_precall: restored func pointer to %p after reallocation\n", (void*)func);
-    }
-    
-    /* Adjust arguments to match parameters */
-    for (int i = n; i < p->numparams; i++) {
-      setnilvalue(s2v(L->top.p++));  /* fill missing parameters with nil */
+  if (ttisLclosure(f)) {  /* AQL function */
+    CallInfo *ci;
+    Proto *p = clLvalue(f)->p;
+    int narg = cast_int(L->top.p - func) - 1;  /* number of real arguments */
+    int nfixparams = p->numparams;
+    int fsize = p->maxstacksize;  /* frame size (exact, see 'aqlK_finish') */
+    if (l_unlikely(L->stack_last.p - L->top.p <= fsize)) {
+      ptrdiff_t t = savestack(L, func);
+      aqlD_growstack(L, fsize, 1);  /* raises "stack overflow" at the limit */
+      func = restorestack(L, t);
     }
-    
-    /* CRITICAL: Copy arguments to the correct positions for the function */
-    /* Arguments are currently at func+1, func+2, ... func+n */
-    /* They need to stay there because base will be set to func+1 */
-    aql_debug("[DEBUG] aqlD_precall: arguments already in correct position at func+1 to func+%d\n", n);
-    
-    /* Create new CallInfo for the function */
-    CallInfo *ci = aqlE_extendCI(L);
+    ci = next_ci(L);
     ci->func.p = func;
-    ci->u.l.savedpc = p->code;  /* Start at beginning of function code */
-    ci->u.l.nextraargs = nextraargs;
-    ci->callstatus = 0;  /* AQL function */
-    /* Set stack top with safety buffer for compiler register allocation issues */
-    int safe_stacksize = p->maxstacksize + AQL_FUNCTION_STACK_SAFETY;  /* Add safety buffer for complex functions */
-    ci->top.p = func + 1 + safe_stacksize;
-    aql_debug("[DEBUG] aqlD_precall: setting ci->top with maxstacksize=%d + safety=%d = %d\n",
-                 p->maxstacksize, AQL_FUNCTION_STACK_SAFETY, safe_stacksize);
-    aql_debug("[DEBUG] aqlD_precall: ci->top=%p, func=%p, func+1=%p\n",
-                 (void*)ci->top.p, (void*)func, (void*)(func + 1));
-    
-    /* Ensure we have enough stack space for the safety buffer */
-    if (ci->top.p > L->stack_last.p) {
-      aql_debug("[DEBUG] aqlD_precall: need more stack space for safety buffer\n");
-      int additional_needed = cast_int(ci->top.p - L->stack_last.p) + EXTRA_STACK;
-      if (aqlD_growstack(L, additional_needed, 0)) {
-        /* Restore func pointer after potential stack reallocation */
-        func = restorestack(L, func_offset);
-        ci->func.p = func;
-        ci->top.p = func + 1 + safe_stacksize;
-        aql_debug("[DEBUG] aqlD_precall: stack grown for safety buffer, new ci->top=%p\n", 
-                     (void*)ci->top.p);
-      } else {
-        /* Fallback: use original maxstacksize */
-        ci->top.p = func + 1 + p->maxstacksize;
-        aql_debug("[DEBUG] aqlD_precall: using original maxstacksize, ci->top=%p\n", 
-                     (void*)ci->top.p);
-      }
+    ci->nresults = nResults;
+    ci->callstatus = 0;
+    ci->top.p = func + 1 + fsize;
+    ci->u.l.savedpc = p->code;  /* starting point */
+    ci->u.l.trap = 0;
+    if (l_likely(narg == nfixparams))  /* fixed arity: args already in place */
+      ci->u.l.nextraargs = 0;
+    else if (narg > nfixparams)
+      ci->u.l.nextraargs = narg - nfixparams;
+    else {
+      ci->u.l.nextraargs = 0;
+      for (; narg < nfixparams; narg++)
+        setnilvalue(s2v(L->top.p++));  /* complete missing arguments */
     }
-    ci->nresults = nResults;  /* Set expected results */
-    ci->previous = L->ci;  /* Set previous CallInfo for return */
-    
-    /* CRITICAL: Set the base pointer for the function */
-    /* In AQL/Lua, function parameters start at func+1 */
-    /* This makes register 0 in the function point to the first parameter */
-    
-    /* Adjust L->ci to point to new CallInfo */
     L->ci = ci;
-    
-    aql_debug("[DEBUG] aqlD_precall: AQL function CallInfo set up, func=%p, base will be %p\n", 
-                 (void*)func, (void*)(func + 1));
-    return ci;  /* Return new CallInfo for AQL function */
+    return ci;
   } else if (ttisCclosure(f)) {
     /* C function call */
     CClosure *ccl = clCvalue(f);
     int n = cast_int(L->top.p - func) - 1;  /* number of arguments */
     
+    /* frames are sized exactly, so guarantee the C function its minimum */
+    if (l_unlikely(L->stack_last.p - L->top.p <= AQL_MINSTACK))
+      aqlD_growstack(L, AQL_MINSTACK, 1);
+    
     /* Call C function */
     int nres = ccl->f(L);
     
@@ -726,6 +725,168 @@ AQL_API CallInfo *aqlD_precall(aql_State *L, StkId func, int nResults) {
 
 /* }====================================================== */
 
+/*
+** {======================================================
+** Coroutines
+** =======================================================
+*/
+
+/*
+** Signal an error in the call to 'aql_resume', not in the execution
+** of the coroutine itself: drop the arguments and leave the message.
+*/
+static int resume_error (aql_State *L, const char *msg, int narg) {
+  L->top.p -= narg;  /* remove args from the stack */
+  setsvalue2s(L, L->top.p, aqlStr_new(L, msg));  /* push error message */
+  L->top.p++;
+  return AQL_ERRRUN;
+}
+
+/*
+** Do the work for 'aql_resume' in protected mode. A coroutine that has
+** not started gets its body called; a suspended one continues the
+** interpreter frame that yielded, whose saved pc is just past the
+** yield. Yields come from builtins, which leave their result slot on
+** top; after the resumer pops the yielded values, the first value
+** passed back lands in that slot and becomes the value of 'yield'.
+*/
+static void resume (aql_State *L, void *ud) {
+  int n = *(cast(int*, ud));  /* number of arguments */
+  StkId firstArg = L->top.p - n;  /* first argument */
+  CallInfo *ci = L->ci;
+  if (L->status == AQL_OK) {  /* starting a coroutine? */
+    if ((ci = aqlD_precall(L, firstArg - 1, AQL_MULTRET)) != NULL) {
+      ci->callstatus |= CIST_FRESH;
+      aqlV_execute(L, ci);  /* just call its body */
+    }
+  }
+  else {  /* resuming from previous yield */
+    aql_assert(L->status == AQL_YIELD);
+    L->status = AQL_OK;  /* mark that it is running (again) */
+    if (n == 0)
+      setnilvalue(s2v(firstArg));  /* 'yield' with no value passed back */
+    L->top.p = ci->top.p;
+    aqlV_execute(L, ci);  /* continue running the coroutine */
+  }
+}
+
+AQL_API int aql_resume (aql_State *L, aql_State *from, int nargs,
+                        int *nresults) {
+  int status;
+  if (L->status == AQL_OK) {  /* may be starting a coroutine */
+    if (L->ci != &L->base_ci)  /* not in base level? */
+      return resume_error(L, "cannot resume non-suspended coroutine", nargs);
+    else if (L->top.p - (L->ci->func.p + 1) == nargs)  /* no function? */
+      return resume_error(L, "cannot resume dead coroutine", nargs);
+  }
+  else if (L->status != AQL_YIELD)  /* ended with errors? */
+    return resume_error(L, "cannot resume dead coroutine", nargs);
+  L->nCcalls = (from) ? getCcalls(from) : 0;
+  if (getCcalls(L) >= AQL_MAXCCALLS)
+    return resume_error(L, "C stack overflow", nargs);
+  L->nCcalls++;
+  status = aqlD_rawrunprotected(L, resume, &nargs);
+  if (l_likely(!errorstatus(status)))
+    aql_assert(status == L->status);  /* normal end or yield */
+  else {  /* unrecoverable error */
+    L->status = cast_byte(status);  /* mark thread as 'dead' */
+    aqlD_seterrorobj(L, status, L->top.p);  /* push error object */
+    L->top.p++;
+  }
+  *nresults = (status == AQL_YIELD) ? L->ci->u2.nyield
+                                    : cast_int(L->top.p - (L->ci->func.p + 1));
+  return status;
+}
+
+AQL_API int aql_isyieldable (aql_State *L) {
+  return yieldable(L);
+}
+
+/*
+** Suspend the running coroutine with its top 'nresults' values as the
+** yielded ones. The interpreter frame that made the call keeps its
+** saved pc, so no continuation is needed to pick it up again: 'ctx'
+** and 'k' are accepted for API compatibility only.
+*/
+AQL_API int aql_yieldk (aql_State *L, int nresults, aql_KContext ctx,
+                        aql_KFunction k) {
+  UNUSED(ctx); UNUSED(k);
+  if (l_unlikely(!yieldable(L))) {
+    if (L != G(L)->mainthread)
+      aqlG_runerror(L, "attempt to yield across a C-call boundary");
+    else
+      aqlG_runerror(L, "attempt to yield from outside a coroutine");
+  }
+  L->status = AQL_YIELD;
+  L->ci->u2.nyield = nresults;
+  aqlD_throw(L, AQL_YIELD);
+  return 0;  /* not reached */
+}
+
+/*
+** Status of coroutine 'co' as seen from 'L' (AQL_COS_*)
+*/
+AQL_API int aqlD_costatus (aql_State *L, aql_State *co) {
+  if (L == co)
+    return AQL_COS_RUNNING;
+  switch (co->status) {
+    case AQL_YIELD:
+      return AQL_COS_SUSPENDED;
+    case AQL_OK:
+      if (co->ci != &co->base_ci)  /* it is resuming another coroutine */
+        return AQL_COS_NORMAL;
+      else if (co->top.p == co->ci->func.p + 1)  /* no function left? */
+        return AQL_COS_DEAD;
+      else
+        return AQL_COS_SUSPENDED;  /* initial state */
+    default:  /* ended with an error */
+      return AQL_COS_DEAD;
+  }
+}
+
+/*
+** Resume 'co' from 'L', passing 'arg' (if not NULL), and store the first
+** value it yields or returns in 'res'. Errors inside the coroutine are
+** propagated to 'L'. Returns AQL_YIELD while 'co' is suspended and
+** AQL_OK once its body has returned.
+*/
+AQL_API int aqlD_resumeco (aql_State *L, aql_State *co, const TValue *arg,
+                           StkId res) {
+  ptrdiff_t resoff = savestack(L, res);
+  int status, nres;
+  switch (aqlD_costatus(L, co)) {
+    case AQL_COS_SUSPENDED:
+      break;
+    case AQL_COS_DEAD:
+      aqlG_runerror(L, "cannot resume dead coroutine");
+      break;
+    default:
+      aqlG_runerror(L, "cannot resume non-suspended coroutine");
+      break;
+  }
+  if (arg != NULL) {
+    if (l_unlikely(co->stack_last.p - co->top.p <= 1))
+      aqlD_growstack(co, 1, 0);
+    setobj2s(co, co->top.p, arg);
+    co->top.p++;
+  }
+  status = aql_resume(co, L, arg != NULL, &nres);
+  if (l_unlikely(errorstatus(status)))
+    aqlD_throw(L, status);  /* already reported inside the coroutine */
+  res = restorestack(L, resoff);
+  if (nres > 0) {
+    setobj2s(L, res, s2v(co->top.p - nres));
+  }
+  else {
+    setnilvalue(s2v(res));
+  }
+  co->top.p -= nres;  /* pop yielded (or returned) values */
+  return status;
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** Protected compilation and execution
@@ -738,6 +899,39 @@ struct CompileS {  /* data for protected compilation */
   const char *name;
 };
 
+/*
+** Push a freshly parsed main closure and give it the global
+** environment as its first upvalue (like Lua's _ENV)
+*/
+static void initchunk (aql_State *L, LClosure *cl, const char *name) {
+  if (aqlD_get_debug_flags() & AQL_DEBUG_CODE) {
+    aqlD_print_function_bytecode(cl->p, name);
+  }
+
+  /* Push compiled function onto stack */
+  setclLvalue2s(L, L->top.p, cl);
+  L->top.p++;
+  
+  /* Set up global environment as first upvalue (like Lua's _ENV) */
+  if (cl->nupvalues >= 1) {
+    /* First, ensure upvalues are initialized */
+    if (cl->upvals[0] == NULL) {
+      aqlF_initupvals(L, cl);
+    }
+    
+    /*
+    ** AQL uses a dict-backed global environment. Create it eagerly for
+    ** compiled chunks so source-level _ENV accesses do not start from nil.
+    */
+    Dict *globals_dict = get_globals_dict(L);
+    if (globals_dict != NULL) {
+      setobj(L, cl->upvals[0]->v.p, &G(L)->l_globals);
+    } else {
+      setnilvalue(cl->upvals[0]->v.p);
+    }
+  }
+}
+
 static void f_compile(aql_State *L, void *ud) {
   struct CompileS *c = cast(struct CompileS *, ud);
   
@@ -757,34 +951,10 @@ static void f_compile(aql_State *L, void *ud) {
   
   aqlZ_freebuffer(L, &buff);
   aqlZ_cleanup_string(L, &z);
+  aqlM_freearray(L, dyd.aql.inlines.arr, dyd.aql.inlines.size);
   
   if (cl) {
-    if (aqlD_get_debug_flags() & AQL_DEBUG_CODE) {
-      aqlD_print_function_bytecode(cl->p, c->name);
-    }
-
-    /* Push compiled function onto stack */
-    setclLvalue2s(L, L->top.p, cl);
-    L->top.p++;
-    
-    /* Set up global environment as first upvalue (like Lua's _ENV) */
-    if (cl->nupvalues >= 1) {
-      /* First, ensure upvalues are initialized */
-      if (cl->upvals[0] == NULL) {
-        aqlF_initupvals(L, cl);
-      }
-      
-      /*
-      ** AQL uses a dict-backed global environment. Create it eagerly for
-      ** compiled chunks so source-level _ENV accesses do not start from nil.
-      */
-      Dict *globals_dict = get_globals_dict(L);
-      if (globals_dict != NULL) {
-        setobj(L, cl->upvals[0]->v.p, &G(L)->l_globals);
-      } else {
-        setnilvalue(cl->upvals[0]->v.p);
-      }
-    }
+    initchunk(L, cl, c->name);
   } else {
     aqlD_throw(L, AQL_ERRSYNTAX);  /* Compilation failed */
   }
@@ -802,6 +972,47 @@ AQL_API int aqlD_protectedcompile(aql_State *L, const char *code, size_t len, co
   return aqlD_rawrunprotected(L, f_compile, &c);
 }
 
+struct SParser {  /* data to 'f_parser' */
+  ZIO *z;
+  Mbuffer buff;  /* dynamic structure used by the scanner */
+  Dyndata dyd;  /* dynamic structures used by the parser */
+  const char *mode;
+  const char *name;
+};
+
+/*
+** Parse a chunk from an arbitrary reader. The source is pulled through
+** the ZIO as the lexer needs it, so it is never held in memory as a
+** whole. Only text chunks exist; 'mode' carries parse options instead:
+** with 'r', an expression ending the main chunk becomes its return value.
+*/
+static void f_parser (aql_State *L, void *ud) {
+  LClosure *cl;
+  struct SParser *p = cast(struct SParser *, ud);
+  int c = zgetc(p->z);  /* read first character */
+  p->dyd.aql.autoreturn = (p->mode != NULL && strchr(p->mode, 'r') != NULL);
+  cl = aqlY_parser(L, p->z, &p->buff, &p->dyd, p->name, c);
+  if (cl == NULL)
+    aqlD_throw(L, AQL_ERRSYNTAX);
+  initchunk(L, cl, p->name);
+}
+
+AQL_API int aqlD_protectedparser (aql_State *L, ZIO *z, const char *name,
+                                  const char *mode) {
+  struct SParser p;
+  int status;
+  p.z = z; p.name = name; p.mode = mode;
+  memset(&p.dyd, 0, sizeof(p.dyd));
+  aqlZ_initbuffer(L, &p.buff);
+  status = aqlD_rawrunprotected(L, f_parser, &p);
+  aqlZ_freebuffer(L, &p.buff);
+  aqlM_freearray(L, p.dyd.actvar.arr, p.dyd.actvar.size);
+  aqlM_freearray(L, p.dyd.gt.arr, p.dyd.gt.size);
+  aqlM_freearray(L, p.dyd.label.arr, p.dyd.label.size);
+  aqlM_freearray(L, p.dyd.aql.inlines.arr, p.dyd.aql.inlines.size);
+  return status;
+}
+
 struct ExecuteS {  /* data for protected execution */
   int nargs;
   int nresults;
@@ -111,6 +111,8 @@ AQL_API void aqlD_callnoyield(aql_State *L, StkId func, int nResults);
 AQL_API int aqlD_pcall(aql_State *L, Pfunc func, void *u,
                        ptrdiff_t oldtop, ptrdiff_t ef);
 AQL_API int aqlD_poscall(aql_State *L, CallInfo *ci, int nres);
+AQL_API StackValue *aqlD_newstack(aql_State *L, aql_State *L1, int size);
+AQL_API void aqlD_freestack(aql_State *L, int size);
 AQL_API int aqlD_growstack(aql_State *L, int n, int raiseerror);
 AQL_API void aqlD_shrinkstack(aql_State *L);
 AQL_API void aqlD_inctop(aql_State *L);
@@ -231,6 +233,16 @@ AQL_API int aql_yieldk(aql_State *L, int nresults, aql_KContext ctx,
 
 AQL_API int aql_status(aql_State *L);
 
+/* coroutine states reported by 'aqlD_costatus' */
+#define AQL_COS_RUNNING		0
+#define AQL_COS_SUSPENDED	1
+#define AQL_COS_NORMAL		2
+#define AQL_COS_DEAD		3
+
+AQL_API int aqlD_costatus(aql_State *L, aql_State *co);
+AQL_API int aqlD_resumeco(aql_State *L, aql_State *co, const TValue *arg,
+                          StkId res);
+
 /* }================================================================ */
 
 /*
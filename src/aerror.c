@@ -4,12 +4,16 @@
 ** See Copyright Notice in aql.h
 */
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "aerror.h"
 #include "amem.h"
+#include "aobject.h"
+#include "ado.h"
+#include "azio.h"
 
 /*
 ** 全局错误上下文
@@ -379,3 +383,16 @@ AQL_API void aqlE_repl_error_recovery(void) {
   }
 }
 
+/*
+** Report a runtime error and unwind to the enclosing protected call
+*/
+l_noret aqlG_runerror (aql_State *L, const char *fmt, ...) {
+  const char *msg;
+  va_list argp;
+  va_start(argp, fmt);
+  msg = aqlO_pushvfstring(L, fmt, argp);
+  va_end(argp);
+  aqlZ_outflush(L);  /* keep pending output ahead of the report */
+  aqlE_report_error(AQL_ERROR_RUNTIME, AQL_ERROR_LEVEL_ERROR, 0, msg, NULL);
+  aqlD_throw(L, AQL_ERRRUN);
+}
@@ -19,6 +19,7 @@
 #include "amem.h"
 #include "aobject.h"
 #include "astate.h"
+#include "adict.h"
 
 
 
@@ -40,6 +41,25 @@ LClosure *aqlF_newLclosure (aql_State *L, int nupvals) {
 }
 
 
+/*
+** Lua closure with room for a flat slot per upvalue, used when its
+** prototype captures some variables by value
+*/
+LClosure *aqlF_newLclosureflat (aql_State *L, int nupvals) {
+  GCObject *o = aqlC_newobj(L, AQL_VLCL, sizeLclosureflat(nupvals));
+  LClosure *c = gco2lcl(o);
+  TValue *flat;
+  c->p = NULL;
+  c->nupvalues = cast_byte(nupvals);
+  flat = clLflat(c);
+  while (nupvals--) {
+    c->upvals[nupvals] = NULL;
+    setnilvalue(&flat[nupvals]);
+  }
+  return c;
+}
+
+
 /*
 ** fill a closure with new closed upvalues
 */
@@ -268,11 +288,13 @@ Proto *aqlF_newproto (aql_State *L) {
   f->numparams = 0;
   f->is_vararg = 0;
   f->maxstacksize = 0;
+  f->flatupvals = 0;
   f->locvars = NULL;
   f->sizelocvars = 0;
   f->linedefined = 0;
   f->lastlinedefined = 0;
   f->source = NULL;
+  f->propcache = NULL;
   return f;
 }
 
@@ -285,6 +307,8 @@ void aqlF_freeproto (aql_State *L, Proto *f) {
   aqlM_freearray(L, f->abslineinfo, f->sizeabslineinfo);
   aqlM_freearray(L, f->locvars, f->sizelocvars);
   aqlM_freearray(L, f->upvalues, f->sizeupvalues);
+  if (f->propcache)
+    aqlM_freearray(L, f->propcache, f->sizecode);
   aqlM_free(L, f, sizeof(Proto));
 }
 
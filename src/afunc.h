@@ -15,6 +15,15 @@
 #define sizeLclosure(n)	(cast_int(offsetof(LClosure, upvals)) + \
                          cast_int(sizeof(TValue *)) * (n))
 
+/* flat upvalue slots start at the first TValue boundary after 'upvals' */
+#define flatLoffset(n)	((sizeLclosure(n) + cast_int(sizeof(TValue)) - 1) / \
+                         cast_int(sizeof(TValue)) * cast_int(sizeof(TValue)))
+
+#define sizeLclosureflat(n)	(flatLoffset(n) + cast_int(sizeof(TValue)) * (n))
+
+/* flat (by-value) upvalue slots of a closure built by 'aqlF_newLclosureflat' */
+#define clLflat(cl)	cast(TValue *, cast_charp(cl) + flatLoffset((cl)->nupvalues))
+
 /* test whether thread is in 'twups' list */
 #define isintwups(L)	(L->twups != L)
 
@@ -40,6 +49,7 @@
 AQL_API Proto *aqlF_newproto (aql_State *L);
 AQL_API CClosure *aqlF_newCclosure (aql_State *L, int nupvals);
 AQL_API LClosure *aqlF_newLclosure (aql_State *L, int nupvals);
+AQL_API LClosure *aqlF_newLclosureflat (aql_State *L, int nupvals);
 AQL_API void aqlF_initupvals (aql_State *L, LClosure *cl);
 AQL_API UpVal *aqlF_findupval (aql_State *L, StkId level);
 AQL_API void aqlF_newtbcupval (aql_State *L, StkId level);
@@ -124,6 +124,7 @@ int aqlJIT_init(aql_State *L, JIT_Backend backend) {
     js->config.default_level = JIT_LEVEL_OPTIMIZED;
     js->config.hotspot_threshold = JIT_MIN_HOTSPOT_CALLS;
     js->config.max_code_cache_size = JIT_CODE_CACHE_SIZE;
+    js->config.max_inline_size = JIT_MAX_INLINE_SIZE;
     
     /* Initialize hotspot detection configuration */
     js->config.hotspot.call_weight = 0.4;
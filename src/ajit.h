@@ -222,6 +222,7 @@ typedef struct JIT_Cache {
 #define JIT_CACHE_BUCKETS       256
 #define JIT_MIN_HOTSPOT_CALLS   10
 #define JIT_MAX_INLINE_DEPTH    3
+#define JIT_MAX_INLINE_SIZE     16
 #define JIT_MAX_LOOP_UNROLL     8
 #define JIT_CODE_CACHE_SIZE     (16 * 1024 * 1024)
 #define JIT_COMPILATION_TIMEOUT 5000
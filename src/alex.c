@@ -338,6 +338,7 @@ static int isreserved(TString *ts) {
   if (strcmp(s, "return") == 0) {
     return TK_RETURN;
   }
+  if (strcmp(s, "yield") == 0) return TK_YIELD;
   
   /* Logical operators */
   if (strcmp(s, "and") == 0) return TK_AND;
@@ -681,9 +682,9 @@ l_noret aqlX_syntaxerror(LexState *ls, const char *msg) {
   aqlE_report_syntax_error(ls->linenumber, msg,
                      "Check syntax and token order", near_token);
   
-  /* Use longjmp for error recovery instead of exit() */
+  /* Unwind to the protected parser, which returns AQL_ERRSYNTAX */
   if (ls->L && ls->L->errorJmp) {
-    longjmp(ls->L->errorJmp->b, 1);  /* Jump back to error handler */
+    aqlD_throw(ls->L, AQL_ERRSYNTAX);
   } else {
     exit(1);  /* Fallback: exit if no error recovery is set up */
   }
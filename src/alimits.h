@@ -232,6 +232,14 @@ typedef aql_uint32 l_uint32;
 #define STRCACHE_M		2
 #endif
 
+/*
+** Number of small non-negative integers (0 .. NUMCACHE_N-1) whose
+** string forms are cached by 'aqlStr_fromnumber'.
+*/
+#if !defined(NUMCACHE_N)
+#define NUMCACHE_N		256
+#endif
+
 /*
 ** Metamethod constants for arithmetic operations
 */
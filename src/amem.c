@@ -125,10 +125,7 @@ void aqlM_freeobject(aql_State *L, GCObject *o, size_t size) {
       break;
     }
     case AQL_TDICT: {
-      Dict *dict = gco2dict(o);
-      if (dict->entries)
-        aqlM_freemem(L, dict->entries, dict->capacity * sizeof(DictEntry));
-      aqlM_freemem(L, o, sizeof(Dict));
+      aqlD_free(L, gco2dict(o));
       break;
     }
     case AQL_TVECTOR: {
@@ -136,6 +133,10 @@ void aqlM_freeobject(aql_State *L, GCObject *o, size_t size) {
       aqlM_freemem(L, o, sizeofvector(vec->length, vec->dtype));
       break;
     }
+    case AQL_TBUILDER: {
+      aqlStr_freebuilder(L, gco2builder(o));
+      break;
+    }
     default: {
       aqlM_freemem(L, o, size);
       break;
@@ -7,9 +7,11 @@
 #define aobject_c
 #define AQL_CORE
 
+#include <float.h>
 #include <locale.h>
 #include <math.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -154,7 +156,7 @@ static int container_index_tm(aql_State *L) {
       if (ttisinteger(key)) {
         aql_Integer idx = ivalue(key);
         if (idx >= 0) {
-          rc = acontainer_array_get(L, container, (size_t)idx, &result);
+          rc = acontainer_vector_get(L, container, (size_t)idx, &result);
         }
       }
       break;
@@ -192,7 +194,7 @@ static int container_newindex_tm(aql_State *L) {
       if (ttisinteger(key)) {
         aql_Integer idx = ivalue(key);
         if (idx >= 0) {
-          cast_void(acontainer_array_set(L, container, (size_t)idx, value));
+          cast_void(acontainer_vector_set(L, container, (size_t)idx, value));
         }
       }
       break;
@@ -726,12 +728,6 @@ int aqlT_callorderiTM(aql_State *L, const TValue *p1, int v2,
   return aqlT_callorderTM(L, p1, p2, event);
 }
 
-void aqlG_runerror (aql_State *L, const char *fmt, ...) {
-  /* Placeholder - simplified error handling */
-  UNUSED(L); UNUSED(fmt);
-  /* In a real implementation, this would format the error message
-     and throw a runtime error */
-}
 
 /* aqlStr_newlstr 现在在 astring.c 中实现 */
 
@@ -893,13 +889,243 @@ static const char *l_str2dloc (const char *s, aql_Number *result, int mode) {
   return (*endptr == '\0') ? endptr : NULL;  /* OK iff no trailing chars */
 }
 
+/*
+** {==================================================================
+** Fast decimal conversion
+** ===================================================================
+*/
+
+#if AQL_FLOAT_TYPE == AQL_FLOAT_DOUBLE
+
+/* powers of ten exactly representable as doubles */
+static const double exactpow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* 5^0 .. 5^27, exact */
+static const uint64_t pow5small[] = {
+  UINT64_C(1), UINT64_C(5), UINT64_C(25), UINT64_C(125), UINT64_C(625),
+  UINT64_C(3125), UINT64_C(15625), UINT64_C(78125), UINT64_C(390625),
+  UINT64_C(1953125), UINT64_C(9765625), UINT64_C(48828125),
+  UINT64_C(244140625), UINT64_C(1220703125), UINT64_C(6103515625),
+  UINT64_C(30517578125), UINT64_C(152587890625), UINT64_C(762939453125),
+  UINT64_C(3814697265625), UINT64_C(19073486328125),
+  UINT64_C(95367431640625), UINT64_C(476837158203125),
+  UINT64_C(2384185791015625), UINT64_C(11920928955078125),
+  UINT64_C(59604644775390625), UINT64_C(298023223876953125),
+  UINT64_C(1490116119384765625), UINT64_C(7450580596923828125)
+};
+
+#define POW5_STEP	27
+#define POW5_QMIN	(-351)
+
+/* 5^q for q = POW5_QMIN, POW5_QMIN + 27, ..., normalized to 128 bits
+   and truncated (hi, lo) */
+static const uint64_t pow5big[][2] = {
+  {UINT64_C(0x8049a4ac0c5811ae), UINT64_C(0x205b896d777d6278)},  /* 5^-351 */
+  {UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x52064cac828675b9)},  /* 5^-324 */
+  {UINT64_C(0xa76c582338ed2621), UINT64_C(0xaf2af2b80af6f24e)},  /* 5^-297 */
+  {UINT64_C(0x873e4f75e2224e68), UINT64_C(0x5a7744a6e804a291)},  /* 5^-270 */
+  {UINT64_C(0xda7f5bf590966848), UINT64_C(0xaf39a475506a899e)},  /* 5^-243 */
+  {UINT64_C(0xb080392cc4349dec), UINT64_C(0xbd8d794d96aacfb3)},  /* 5^-216 */
+  {UINT64_C(0x8e938662882af53e), UINT64_C(0x547eb47b7282ee9c)},  /* 5^-189 */
+  {UINT64_C(0xe65829b3046b0afa), UINT64_C(0x0cb4a5a3112a5112)},  /* 5^-162 */
+  {UINT64_C(0xba121a4650e4ddeb), UINT64_C(0x92f34d62616ce413)},  /* 5^-135 */
+  {UINT64_C(0x964e858c91ba2655), UINT64_C(0x3a6a07f8d510f86f)},  /* 5^-108 */
+  {UINT64_C(0xf2d56790ab41c2a2), UINT64_C(0xfae27299423fb9c3)},  /* 5^-81 */
+  {UINT64_C(0xc428d05aa4751e4c), UINT64_C(0xaa97e14c3c26b886)},  /* 5^-54 */
+  {UINT64_C(0x9e74d1b791e07e48), UINT64_C(0x775ea264cf55347d)},  /* 5^-27 */
+  {UINT64_C(0x8000000000000000), UINT64_C(0x0000000000000000)},  /* 5^0 */
+  {UINT64_C(0xcecb8f27f4200f3a), UINT64_C(0x0000000000000000)},  /* 5^27 */
+  {UINT64_C(0xa70c3c40a64e6c51), UINT64_C(0x999090b65f67d924)},  /* 5^54 */
+  {UINT64_C(0x86f0ac99b4e8dafd), UINT64_C(0x69a028bb3ded71a3)},  /* 5^81 */
+  {UINT64_C(0xda01ee641a708de9), UINT64_C(0xe80e6f4820cc9495)},  /* 5^108 */
+  {UINT64_C(0xb01ae745b101e9e4), UINT64_C(0x5ec05dcff72e7f8f)},  /* 5^135 */
+  {UINT64_C(0x8e41ade9fbebc27d), UINT64_C(0x14588f13be847307)},  /* 5^162 */
+  {UINT64_C(0xe5d3ef282a242e81), UINT64_C(0x8f1668c8a86da5fa)},  /* 5^189 */
+  {UINT64_C(0xb9a74a0637ce2ee1), UINT64_C(0x6d953e2bd7173692)},  /* 5^216 */
+  {UINT64_C(0x95f83d0a1fb69cd9), UINT64_C(0x4abdaf101564f98e)},  /* 5^243 */
+  {UINT64_C(0xf24a01a73cf2dccf), UINT64_C(0xbc633b39673c8cec)},  /* 5^270 */
+  {UINT64_C(0xc3b8358109e84f07), UINT64_C(0x0a862f80ec4700c8)},  /* 5^297 */
+};
+
+/* 64x64 -> 128-bit product; returns the high half */
+static uint64_t umul128 (uint64_t a, uint64_t b, uint64_t *lo) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 p = (unsigned __int128)a * b;
+  *lo = (uint64_t)p;
+  return (uint64_t)(p >> 64);
+#else
+  uint64_t a0 = a & 0xFFFFFFFFu, a1 = a >> 32;
+  uint64_t b0 = b & 0xFFFFFFFFu, b1 = b >> 32;
+  uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+  uint64_t mid = (p00 >> 32) + (p01 & 0xFFFFFFFFu) + (p10 & 0xFFFFFFFFu);
+  *lo = (mid << 32) | (p00 & 0xFFFFFFFFu);
+  return p11 + (mid >> 32) + (p01 >> 32) + (p10 >> 32);
+#endif
+}
+
+static int clz64 (uint64_t x) {  /* x != 0 */
+#if defined(__GNUC__)
+  return __builtin_clzll(x);
+#else
+  int n = 0;
+  while (!(x & (UINT64_C(1) << 63))) {
+    x <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/*
+** 5^q (q in [-342, 308]) as a normalized 128-bit (hi, lo) times 2^e,
+** returning e. The value is a table entry times an exact 5^b; it never
+** exceeds the true power and is less than 3 units below it.
+*/
+static int pow5approx (int q, uint64_t *hi, uint64_t *lo) {
+  int a = (q - POW5_QMIN) / POW5_STEP;
+  int b = (q - POW5_QMIN) % POW5_STEP;
+  int e = ((152170 * (q - b)) >> 16) - 127;  /* floor(log2(5^(q-b))) - 127 */
+  uint64_t p0, p1, p2, c;
+  if (b == 0) {
+    *hi = pow5big[a][0];
+    *lo = pow5big[a][1];
+    return e;
+  }
+  c = umul128(pow5big[a][1], pow5small[b], &p0);
+  p2 = umul128(pow5big[a][0], pow5small[b], &p1);
+  p1 += c;
+  if (p1 < c) p2++;
+  c = (uint64_t)clz64(p2);  /* p2 != 0, as 5^b >= 5 */
+  if (c > 0) {
+    p2 = (p2 << c) | (p1 >> (64 - c));
+    p1 = (p1 << c) | (p0 >> (64 - c));
+  }
+  *hi = p2;
+  *lo = p1;
+  return e + 64 - (int)c;
+}
+
+/*
+** Eisel-Lemire: 'w' * 10^q correctly rounded to a double. The 128 most
+** significant bits of w * 5^q are within 4 units of the exact product,
+** which decides the rounding unless the bits below the mantissa are
+** that close to a tie; then (and for subnormals) returns 0 so that the
+** caller falls back to the exact conversion.
+*/
+static int eisellemire (uint64_t w, int q, double *res) {
+  uint64_t th, tl, h1, l1, l0, c, mant, lowhi, halfhi, bits;
+  int s, k, e2, biased;
+  if (q < -342) {  /* w * 10^q < 10^-323: rounds to zero */
+    *res = 0.0;
+    return 1;
+  }
+  if (q > 308) {
+    *res = HUGE_VAL;
+    return 1;
+  }
+  e2 = pow5approx(q, &th, &tl);
+  s = clz64(w);
+  w <<= s;
+  c = umul128(w, tl, &l0);
+  h1 = umul128(w, th, &l1);
+  l1 += c;
+  if (l1 < c) h1++;
+  k = (h1 >> 63) ? 75 : 74;  /* bits of (h1, l1) below a 53-bit mantissa */
+  lowhi = h1 & ((UINT64_C(1) << (k - 64)) - 1);
+  halfhi = UINT64_C(1) << (k - 65);
+  if (lowhi == halfhi ? l1 == 0 : (lowhi == halfhi - 1 && l1 >= ~UINT64_C(3)))
+    return 0;  /* too close to halfway */
+  mant = (h1 >> (k - 64)) + (lowhi >= halfhi);
+  if (mant >> 53) {  /* rounding carried into a new bit */
+    mant >>= 1;
+    k++;
+  }
+  biased = k + 64 + e2 + q - s + 52 + 1023;
+  if (biased <= 0)
+    return 0;  /* subnormal */
+  if (biased >= 0x7FF) {
+    *res = HUGE_VAL;
+    return 1;
+  }
+  bits = ((uint64_t)biased << 52) | (mant & ((UINT64_C(1) << 52) - 1));
+  memcpy(res, &bits, sizeof(bits));
+  return 1;
+}
+
+/*
+** Converts a plain decimal numeral (optional spaces and sign, digits
+** with an optional fraction and exponent, optional spaces) without
+** going through 'strtod'. Returns the address of the final '\0', or
+** NULL when 's' has another form (hexadecimal, more than 19 significant
+** digits, ...) or needs the exact conversion.
+*/
+static const char *l_str2dfast (const char *s, aql_Number *result) {
+  uint64_t w = 0;  /* significant digits */
+  int nd = 0;  /* number of digits in 'w' */
+  int q = 0;  /* decimal exponent */
+  int any = 0;  /* any digit seen? */
+  int neg;
+  double d;
+  while (lisspace(cast_uchar(*s))) s++;
+  neg = isneg(&s);
+  for (; *s == '0'; s++) any = 1;
+  for (; lisdigit(cast_uchar(*s)); s++, nd++) {
+    if (nd == 19) return NULL;
+    w = w * 10 + cast_uint(*s - '0');
+  }
+  any |= (nd > 0);
+  if (*s == '.') {
+    s++;
+    if (w == 0)
+      for (; *s == '0'; s++, q--) any = 1;
+    for (; lisdigit(cast_uchar(*s)); s++, nd++, q--) {
+      if (nd == 19) return NULL;
+      w = w * 10 + cast_uint(*s - '0');
+      any = 1;
+    }
+  }
+  if (!any) return NULL;
+  if (*s == 'e' || *s == 'E') {
+    int eneg, ex = 0;
+    s++;
+    eneg = isneg(&s);
+    if (!lisdigit(cast_uchar(*s))) return NULL;
+    for (; lisdigit(cast_uchar(*s)); s++)
+      if (ex < 100000) ex = ex * 10 + (*s - '0');
+    q += eneg ? -ex : ex;
+  }
+  while (lisspace(cast_uchar(*s))) s++;
+  if (*s != '\0') return NULL;
+  if (w == 0)
+    d = 0.0;
+  else if (w <= (UINT64_C(1) << 53) && q >= -22 && q <= 22)
+    /* Clinger: both operands exact, so the one rounding is correct */
+    d = (q < 0) ? (double)w / exactpow10[-q] : (double)w * exactpow10[q];
+  else if (!eisellemire(w, q, &d))
+    return NULL;
+  *result = neg ? -d : d;
+  return s;
+}
+
+#endif
+
+/* }================================================================== */
+
 /*
 ** Convert string 's' to an AQL number (put in 'result') handling the
 ** current locale.
 */
 static const char *l_str2d (const char *s, aql_Number *result) {
   const char *endptr;
-  const char *pmode = strpbrk(s, ".xXnN");  /* look for special chars */
+  const char *pmode;
+#if AQL_FLOAT_TYPE == AQL_FLOAT_DOUBLE
+  if ((endptr = l_str2dfast(s, result)) != NULL)  /* common decimal form? */
+    return endptr;
+#endif
+  pmode = strpbrk(s, ".xXnN");  /* look for special chars */
   int mode = pmode ? ltolower(cast_uchar(*pmode)) : 0;
   if (mode == 'n')  /* reject 'inf' and 'nan' */
     return NULL;
@@ -988,6 +1214,351 @@ int aqlO_utf8esc (char *buff, unsigned long x) {
   return n;
 }
 
+/*
+** {==================================================================
+** Number formatting
+** ===================================================================
+*/
+
+static const char digitpairs[] =
+  "00010203040506070809101112131415161718192021222324"
+  "25262728293031323334353637383940414243444546474849"
+  "50515253545556575859606162636465666768697071727374"
+  "75767778798081828384858687888990919293949596979899";
+
+/*
+** Write the decimal digits of 'u' ending just before 'end', two digits
+** per division; returns a pointer to the first digit.
+*/
+static char *fmtdigits (char *end, aql_Unsigned u) {
+  while (u >= 100) {
+    unsigned d = cast_uint(u % 100) * 2;
+    u /= 100;
+    *--end = digitpairs[d + 1];
+    *--end = digitpairs[d];
+  }
+  if (u >= 10) {
+    unsigned d = cast_uint(u) * 2;
+    *--end = digitpairs[d + 1];
+    *--end = digitpairs[d];
+  }
+  else
+    *--end = cast_char('0' + cast_uint(u));
+  return end;
+}
+
+/*
+** Format integer 'n' into 'buff' (at least MAXNUMBER2STR bytes);
+** returns the length, result is zero-terminated.
+*/
+int aqlO_fmtint (char *buff, aql_Integer n) {
+  char tmp[MAXNUMBER2STR];
+  aql_Unsigned u = aql_castS2U(n);
+  char *p;
+  int len;
+  if (n < 0) u = 0u - u;  /* also correct for the minimum integer */
+  p = fmtdigits(tmp + sizeof(tmp), u);
+  if (n < 0) *--p = '-';
+  len = cast_int(tmp + sizeof(tmp) - p);
+  memcpy(buff, p, len);
+  buff[len] = '\0';
+  return len;
+}
+
+#if AQL_FLOAT_TYPE == AQL_FLOAT_DOUBLE
+
+/*
+** Shortest round-trip formatting of doubles (Grisu2, Loitsch 2010).
+** A double is scaled by a cached power of ten into a 64-bit fixed-point
+** window and digits are produced until the result lies strictly inside
+** the rounding interval of the input, so reading it back always yields
+** the same double. The digit string is the shortest one for all but a
+** tiny fraction of inputs, where it may carry one extra digit.
+*/
+
+typedef struct DiyFp {
+  uint64_t f;
+  int e;
+} DiyFp;
+
+/* normalized 10^k, k = -348, -340, ..., 340, rounded to 64 bits */
+static const uint64_t cachedpow_f[] = {
+  UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+  UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+  UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+  UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+  UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+  UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+  UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+  UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+  UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+  UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+  UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+  UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+  UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+  UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+  UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+  UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+  UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+  UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+  UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+  UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+  UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+  UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+  UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+  UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+  UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+  UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+  UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+  UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+  UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b),
+};
+
+static const short cachedpow_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+  -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+  -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+  -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+  -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+  109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+  375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+  641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+  907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+static const uint64_t pow10u64[] = {
+  UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+  UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+  UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+  UINT64_C(10000000000), UINT64_C(100000000000),
+  UINT64_C(1000000000000), UINT64_C(10000000000000),
+  UINT64_C(100000000000000), UINT64_C(1000000000000000),
+  UINT64_C(10000000000000000), UINT64_C(100000000000000000),
+  UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+};
+
+#define DP_HIDDENBIT	UINT64_C(0x0010000000000000)
+#define DP_SIGMASK	UINT64_C(0x000FFFFFFFFFFFFF)
+
+static DiyFp diyfp (uint64_t f, int e) {
+  DiyFp r;
+  r.f = f;
+  r.e = e;
+  return r;
+}
+
+/* product rounded to the upper 64 bits */
+static DiyFp diyfp_mul (DiyFp a, DiyFp b) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 p = (unsigned __int128)a.f * b.f;
+  uint64_t h = (uint64_t)(p >> 64);
+  if ((uint64_t)p & (UINT64_C(1) << 63)) h++;
+  return diyfp(h, a.e + b.e + 64);
+#else
+  const uint64_t M32 = 0xFFFFFFFFu;
+  uint64_t a1 = a.f >> 32, a0 = a.f & M32;
+  uint64_t b1 = b.f >> 32, b0 = b.f & M32;
+  uint64_t t = ((a0 * b0) >> 32) + ((a1 * b0) & M32) + ((a0 * b1) & M32);
+  t += UINT64_C(1) << 31;  /* round */
+  return diyfp(a1 * b1 + ((a1 * b0) >> 32) + ((a0 * b1) >> 32) + (t >> 32),
+               a.e + b.e + 64);
+#endif
+}
+
+static DiyFp diyfp_normalize (DiyFp a) {
+  while (!(a.f & (UINT64_C(1) << 63))) {
+    a.f <<= 1;
+    a.e--;
+  }
+  return a;
+}
+
+/*
+** Splits 'd' (finite, positive) into 'v' and the boundaries 'm-' and
+** 'm+' halfway to its neighbours, both sharing the exponent of 'm+'.
+*/
+static DiyFp diyfp_boundaries (double d, DiyFp *mminus, DiyFp *mplus) {
+  uint64_t u;
+  int be;
+  DiyFp v, pl, mi;
+  memcpy(&u, &d, sizeof(u));
+  be = (int)((u >> 52) & 0x7FF);
+  if (be != 0)
+    v = diyfp((u & DP_SIGMASK) + DP_HIDDENBIT, be - 1075);
+  else  /* subnormal */
+    v = diyfp(u & DP_SIGMASK, 1 - 1075);
+  pl = diyfp_normalize(diyfp((v.f << 1) + 1, v.e - 1));
+  if (v.f == DP_HIDDENBIT)  /* lower neighbour is closer */
+    mi = diyfp((v.f << 2) - 1, v.e - 2);
+  else
+    mi = diyfp((v.f << 1) - 1, v.e - 1);
+  mi.f <<= mi.e - pl.e;
+  mi.e = pl.e;
+  *mminus = mi;
+  *mplus = pl;
+  return v;
+}
+
+/* cached power c such that 'e' + c.e lands in [-60, -32]; K = -k */
+static DiyFp cachedpower (int e, int *K) {
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int k = (int)dk;
+  unsigned idx;
+  if (dk - k > 0.0) k++;
+  idx = (unsigned)((k >> 3) + 1);
+  *K = -(-348 + (int)(idx << 3));
+  return diyfp(cachedpow_f[idx], cachedpow_e[idx]);
+}
+
+static void grisuround (char *buff, int len, uint64_t delta, uint64_t rest,
+                        uint64_t tenkappa, uint64_t wpw) {
+  while (rest < wpw && delta - rest >= tenkappa &&
+         (rest + tenkappa < wpw || wpw - rest > rest + tenkappa - wpw)) {
+    buff[len - 1]--;
+    rest += tenkappa;
+  }
+}
+
+static int countdigits32 (uint32_t n) {
+  int d = 1;
+  while (d < 10 && n >= pow10u64[d]) d++;
+  return d;
+}
+
+static int digitgen (DiyFp W, DiyFp Mp, uint64_t delta, char *buff,
+                     int *K) {
+  DiyFp one = diyfp(UINT64_C(1) << -Mp.e, Mp.e);
+  uint64_t wpw = Mp.f - W.f;
+  uint32_t p1 = (uint32_t)(Mp.f >> -one.e);
+  uint64_t p2 = Mp.f & (one.f - 1);
+  int kappa = countdigits32(p1);
+  int len = 0;
+  while (kappa > 0) {  /* integral part */
+    uint32_t div = (uint32_t)pow10u64[kappa - 1];
+    uint32_t d = p1 / div;
+    uint64_t rest;
+    p1 %= div;
+    if (d || len) buff[len++] = cast_char('0' + d);
+    kappa--;
+    rest = ((uint64_t)p1 << -one.e) + p2;
+    if (rest <= delta) {
+      *K += kappa;
+      grisuround(buff, len, delta, rest, pow10u64[kappa] << -one.e, wpw);
+      return len;
+    }
+  }
+  for (;;) {  /* fractional part */
+    int d;
+    p2 *= 10;
+    delta *= 10;
+    d = (int)(p2 >> -one.e);
+    if (d || len) buff[len++] = cast_char('0' + d);
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *K += kappa;
+      grisuround(buff, len, delta, p2, one.f,
+                 -kappa < 20 ? wpw * pow10u64[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+/* shortest digits of 'd' (finite, > 0); value is digits * 10^K */
+static int grisu2 (double d, char *buff, int *K) {
+  DiyFp wm, wp;
+  DiyFp v = diyfp_boundaries(d, &wm, &wp);
+  DiyFp c = cachedpower(wp.e, K);
+  DiyFp W = diyfp_mul(diyfp_normalize(v), c);
+  DiyFp Wp = diyfp_mul(wp, c);
+  DiyFp Wm = diyfp_mul(wm, c);
+  Wm.f++;
+  Wp.f--;
+  return digitgen(W, Wp, Wp.f - Wm.f, buff, K);
+}
+
+#endif
+
+/*
+** Format float 'x' into 'buff' (at least MAXNUMBER2STR bytes) exactly
+** as AQL_NUMBER_FMT_STR ('%.14g') would; returns the length, result is
+** zero-terminated. When the shortest round-trip digits fit in
+** AQL_NUMBER_DIGITS they are also what '%.14g' prints, so they are laid
+** out directly (fixed notation for exponents in [-4, 14), 'e' notation
+** otherwise); longer ones, and subnormals, whose shortest digits can be
+** fewer than '%.14g' prints, go through 'aql_number2str'.
+*/
+int aqlO_fmtflt (char *buff, aql_Number x) {
+#if AQL_FLOAT_TYPE == AQL_FLOAT_DOUBLE
+  char digits[24];
+  char *b = buff;
+  int nd, K, exp10;
+  if (isnan(x))
+    return snprintf(buff, MAXNUMBER2STR, "%s", signbit(x) ? "-nan" : "nan");
+  if (signbit(x)) {
+    *b++ = '-';
+    x = -x;
+  }
+  if (isinf(x)) {
+    memcpy(b, "inf", 4);
+    return cast_int(b - buff) + 3;
+  }
+  if (x == 0) {
+    memcpy(b, "0", 2);
+    return cast_int(b - buff) + 1;
+  }
+  nd = grisu2(x, digits, &K);
+  if (nd > AQL_NUMBER_DIGITS || x < DBL_MIN)  /* needs rounding/subnormal */
+    return aql_number2str(buff, MAXNUMBER2STR, (b != buff) ? -x : x);
+  exp10 = nd + K - 1;  /* exponent of the first digit */
+  if (exp10 >= -4 && exp10 < AQL_NUMBER_DIGITS) {  /* fixed notation */
+    if (K >= 0) {  /* integer: digits followed by K zeros */
+      memcpy(b, digits, nd);
+      memset(b + nd, '0', K);
+      b += nd + K;
+    }
+    else if (exp10 >= 0) {  /* ddd.ddd */
+      memcpy(b, digits, exp10 + 1);
+      b += exp10 + 1;
+      *b++ = '.';
+      memcpy(b, digits + exp10 + 1, nd - exp10 - 1);
+      b += nd - exp10 - 1;
+    }
+    else {  /* 0.000ddd */
+      *b++ = '0';
+      *b++ = '.';
+      memset(b, '0', -exp10 - 1);
+      b += -exp10 - 1;
+      memcpy(b, digits, nd);
+      b += nd;
+    }
+  }
+  else {  /* d.ddde+XX */
+    unsigned ue = cast_uint(exp10 < 0 ? -exp10 : exp10);
+    *b++ = digits[0];
+    if (nd > 1) {
+      *b++ = '.';
+      memcpy(b, digits + 1, nd - 1);
+      b += nd - 1;
+    }
+    *b++ = 'e';
+    *b++ = (exp10 < 0) ? '-' : '+';
+    if (ue >= 100) {
+      *b++ = cast_char('0' + ue / 100);
+      ue %= 100;
+    }
+    *b++ = digitpairs[ue * 2];
+    *b++ = digitpairs[ue * 2 + 1];
+  }
+  *b = '\0';
+  return cast_int(b - buff);
+#else
+  return aql_number2str(buff, MAXNUMBER2STR, x);
+#endif
+}
+
+/* }================================================================== */
+
 /*
 ** Convert a number object to a string, adding it to a buffer
 */
@@ -995,9 +1566,9 @@ static int tostringbuff (TValue *obj, char *buff) {
   int len;
   aql_assert(ttisnumber(obj));
   if (ttisinteger(obj))
-    len = aql_integer2str(buff, MAXNUMBER2STR, ivalue(obj));
+    len = aqlO_fmtint(buff, ivalue(obj));
   else {
-    len = aql_number2str(buff, MAXNUMBER2STR, fltvalue(obj));
+    len = aqlO_fmtflt(buff, fltvalue(obj));
     if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
       buff[len++] = aql_getlocaledecpoint();
       buff[len++] = '0';  /* adds '.0' to result */
@@ -1014,9 +1585,9 @@ void aqlO_tostring (aql_State *L, TValue *obj) {
   size_t len;
   
   if (ttisinteger(obj)) {
-    len = aql_integer2str(buff, sizeof(buff), ivalue(obj));
+    len = aqlO_fmtint(buff, ivalue(obj));
   } else if (ttisfloat(obj)) {
-    len = aql_number2str(buff, sizeof(buff), fltvalue(obj));
+    len = aqlO_fmtflt(buff, fltvalue(obj));
   } else {
     return;  /* Not a number, cannot convert */
   }
@@ -467,6 +467,7 @@ typedef struct Upvaldesc {
   aql_byte instack;  /* whether it is in stack (register) */
   aql_byte idx;  /* index of upvalue (in stack or in outer function's list) */
   aql_byte kind;  /* kind of corresponding variable */
+  aql_byte flat;  /* captured by value into a flat slot (never reassigned) */
 } Upvaldesc;
 
 /*
@@ -502,6 +503,7 @@ typedef struct Proto {
   aql_byte numparams;  /* number of fixed (named) parameters */
   aql_byte is_vararg;
   aql_byte maxstacksize;  /* number of registers needed by this function */
+  aql_byte flatupvals;  /* true if some upvalue is flat (see 'clLflat') */
   int sizeupvalues;  /* size of 'upvalues' */
   int sizek;  /* size of 'k' */
   int sizecode;
@@ -520,6 +522,7 @@ typedef struct Proto {
   LocVar *locvars;  /* information about local variables (debug information) */
   TString  *source;  /* used for debug information */
   GCObject *gclist;
+  struct PropCache *propcache;  /* OP_GETPROP inline caches (one per pc) */
 } Proto;
 
 /* }================================================================== */
@@ -593,6 +596,10 @@ typedef struct CClosure {
   TValue upvalue[1];  /* list of upvalues */
 } CClosure;
 
+/*
+** Upvalues marked 'flat' in the prototype hold no UpVal: their values
+** live in TValue slots placed after 'upvals' (see 'clLflat').
+*/
 typedef struct LClosure {
   ClosureHeader;
   struct Proto *p;
@@ -620,6 +627,7 @@ typedef struct Slice Slice;
 typedef struct Dict Dict;
 typedef struct Vector Vector;
 typedef struct RangeObject RangeObject;
+typedef struct StrBuilder StrBuilder;
 
 /* Variant tags for AQL containers */
 #define AQL_VARRAY	makevariant(AQL_TARRAY, 0)
@@ -627,6 +635,7 @@ typedef struct RangeObject RangeObject;
 #define AQL_VDICT	makevariant(AQL_TDICT, 0)
 #define AQL_VVECTOR	makevariant(AQL_TVECTOR, 0)
 #define AQL_VRANGE	makevariant(AQL_TRANGE, 0)
+#define AQL_VBUILDER	makevariant(AQL_TBUILDER, 0)
 
 /* Container type tests */
 #define ttisarray(o)		checktag((o), ctb(AQL_VARRAY))
@@ -634,6 +643,7 @@ typedef struct RangeObject RangeObject;
 #define ttisdict(o)		checktag((o), ctb(AQL_VDICT))
 #define ttisvector(o)		checktag((o), ctb(AQL_VVECTOR))
 #define ttisrange(o)		checktag((o), ctb(AQL_VRANGE))
+#define ttisbuilder(o)		checktag((o), ctb(AQL_VBUILDER))
 
 /* 通用容器类型检查 */
 #define ttiscontainer(o)    (ttisarray(o) || ttisslice(o) || ttisdict(o) || ttisvector(o))
@@ -647,6 +657,7 @@ typedef struct RangeObject RangeObject;
 #define dictvalue(o)	check_exp(ttisdict(o), gco2dict(val_(o).gc))
 #define vectorvalue(o)	check_exp(ttisvector(o), gco2vector(val_(o).gc))
 #define rangevalue(o)	check_exp(ttisrange(o), gco2range(val_(o).gc))
+#define buildervalue(o)	check_exp(ttisbuilder(o), gco2builder(val_(o).gc))
 
 /* Alternative names for compatibility */
 #define arrvalue(o)     arrayvalue(o)
@@ -693,6 +704,11 @@ typedef struct RangeObject RangeObject;
     val_(io).gc = obj2gco(x_); settt_(io, ctb(AQL_VRANGE)); \
     checkliveness(L,io); }
 
+#define setbuildervalue(L,obj,x) \
+  { TValue *io = (obj); StrBuilder *x_ = (x); \
+    val_(io).gc = obj2gco(x_); settt_(io, ctb(AQL_VBUILDER)); \
+    checkliveness(L,io); }
+
 /* }================================================================== */
 
 /*
@@ -739,6 +755,7 @@ typedef struct Table Table;
 #define gco2dict(o)   check_exp((o)->tt == AQL_TDICT, (Dict *)(o))
 #define gco2vector(o) check_exp((o)->tt == AQL_TVECTOR, (Vector *)(o))
 #define gco2range(o)  check_exp((o)->tt == AQL_TRANGE, (RangeObject *)(o))
+#define gco2builder(o) check_exp((o)->tt == AQL_TBUILDER, (StrBuilder *)(o))
 
 /* Note: cast_u is defined in aconf.h */
 
@@ -779,6 +796,8 @@ AQL_API void aqlO_arith (aql_State *L, int op, const TValue *p1,
                            const TValue *p2, StkId res);
 AQL_API size_t aqlO_str2num (const char *s, TValue *o);
 AQL_API int aqlO_hexavalue (int c);
+AQL_API int aqlO_fmtint (char *buff, aql_Integer n);
+AQL_API int aqlO_fmtflt (char *buff, aql_Number x);
 AQL_API void aqlO_tostring (aql_State *L, TValue *obj);
 AQL_API const char *aqlO_pushvfstring (aql_State *L, const char *fmt,
                                                        va_list argp);
@@ -826,7 +845,7 @@ AQL_API void aqlV_concat (aql_State *L, int total);
 AQL_API int aqlV_lessthan(aql_State *L, const TValue *l, const TValue *r);
 AQL_API int aqlV_lessequal(aql_State *L, const TValue *l, const TValue *r);
 AQL_API int aqlV_equalobj(aql_State *L, const TValue *t1, const TValue *t2);
-AQL_API void aqlG_runerror (aql_State *L, const char *fmt, ...);
+AQL_API l_noret aqlG_runerror (aql_State *L, const char *fmt, ...);
 
 /*
 ** Function call declarations (placeholder)
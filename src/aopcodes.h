@@ -285,19 +285,21 @@ typedef enum {
 
   /* === AQL Extensions (83+) === */
   OP_NEWOBJECT,   /* 83  A B C   R[A] := new_object(type[B], size[C]) */
-  OP_GETPROP,     /* 84  A B C   R[A] := R[B].property[C] or R[B][R[C]] */
+  OP_GETPROP,     /* 84  A B C   R[A] := R[B][RK(C)] (k: K[C] string key) */
   OP_SETPROP,     /* 85  A B C   R[A].property[B] := R[C] or R[A][R[B]] := R[C] */
   OP_INVOKE,      /* 86  A B C   R[A] := R[B]:method[C](args...) */
-  OP_ITER_INIT,   /* 87  A B     R[A] := iter_init(R[B]) */
-  OP_ITER_NEXT,   /* 88  A B C   R[C] := iter_next(R[A], R[B]) */
+  OP_ITER_INIT,   /* 87  A Bx    R[A+1] := cursor(R[A]); R[A+2], R[A+3] := nil; pc+=Bx */
+  OP_ITER_NEXT,   /* 88  A Bx    R[A+4] := next(R[A], R[A+1]); pc-=Bx (end: pc+=2) */
   OP_LOADBUILTIN, /* 89  A B     R[A] := builtin_func[B] */
-  OP_CALLBUILTIN, /* 90  A B C   call builtin_func[A] with B args, C results */
+  OP_CALLBUILTIN, /* 90  A B C   R[A] := builtin_func[C](R[A+1], ... ,R[A+B]) */
   OP_SUBI,        /* 91  A B sC  R[A] := R[B] - sC */
   OP_MULI,        /* 92  A B sC  R[A] := R[B] * sC */
   OP_DIVI,        /* 93  A B sC  R[A] := R[B] / sC */
+  OP_GETFLATUP,   /* 94  A B     R[A] := FlatUpValue[B] */
+  OP_TESTFUNC,    /* 95  A B k   if ((R[A] is a closure of K[B]:proto) ~= k) then pc++ */
 } OpCode;
 
-#define NUM_OPCODES	((int)(OP_DIVI) + 1)
+#define NUM_OPCODES	((int)(OP_TESTFUNC) + 1)
 
 /*===========================================================================
   Notes:
@@ -314,6 +316,14 @@ typedef enum {
   OP_EXTRAARG.
 
   (*) In OP_SETLIST, if (B == 0) then B = 'top'; if b > 0, then B = b.
+  On an array container the first value goes to slot C (0-based), and
+  the container grows when the batch runs past its length.
+
+  (*) OP_TESTFUNC guards a call site inlined by 'aqlK_inlinecall'; K[B]
+  is a light userdata holding the inlined function's prototype.
+
+  (*) In OP_NEWOBJECT, if k then the size continues in the next
+  instruction, which is OP_EXTRAARG (size = C + Ax * (MAXARG_C + 1)).
 
   (*) In OP_NEWTABLE, B is log2 of the hash part size (or zero for size 1)
   and C is log2 of the array part size (or zero for size 1).
@@ -514,16 +524,18 @@ static const char *const aql_opnames[NUM_OPCODES+1] = {
 
   /* === AQL Extensions (83+) === */
   "NEWOBJECT",    /* 83  A B C   R[A] := new_object(type[B], size[C]) */
-  "GETPROP",      /* 84  A B C   R[A] := R[B].property[C] or R[B][R[C]] */
+  "GETPROP",      /* 84  A B C   R[A] := R[B][RK(C)] (k: K[C] string key) */
   "SETPROP",      /* 85  A B C   R[A].property[B] := R[C] or R[A][R[B]] := R[C] */
   "INVOKE",       /* 86  A B C   R[A] := R[B]:method[C](args...) */
-  "ITER_INIT",    /* 87  A B     R[A] := iter_init(R[B]) */
-  "ITER_NEXT",    /* 88  A B C   R[C] := iter_next(R[A], R[B]) */
+  "ITER_INIT",    /* 87  A Bx    R[A+1] := cursor(R[A]); pc+=Bx */
+  "ITER_NEXT",    /* 88  A Bx    R[A+4] := next(R[A], R[A+1]); pc-=Bx */
   "LOADBUILTIN",  /* 89  A B     R[A] := builtin_func[B] */
-  "CALLBUILTIN",  /* 90  A B C   call builtin_func[A] with B args, C results */
+  "CALLBUILTIN",  /* 90  A B C   R[A] := builtin_func[C](R[A+1], ... ,R[A+B]) */
   "SUBI",         /* 91  A B sC  R[A] := R[B] - sC */
   "MULI",         /* 92  A B sC  R[A] := R[B] * sC */
   "DIVI",         /* 93  A B sC  R[A] := R[B] / sC */
+  "GETFLATUP",    /* 94  A B     R[A] := FlatUpValue[B] */
+  "TESTFUNC",     /* 95  A B k   if ((R[A] is a closure of K[B]:proto) ~= k) then pc++ */
   NULL
 };
 
@@ -619,13 +631,15 @@ static const aql_byte aql_opmode[NUM_OPCODES] = {
   aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_GETPROP */
   aqlOpMode(0, 0, 0, 0, 0, iABC),    /* OP_SETPROP */
   aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_INVOKE */
-  aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_ITER_INIT */
-  aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_ITER_NEXT */
+  aqlOpMode(0, 0, 0, 0, 0, iABx),    /* OP_ITER_INIT */
+  aqlOpMode(0, 0, 0, 0, 0, iABx),    /* OP_ITER_NEXT */
   aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_LOADBUILTIN */
-  aqlOpMode(0, 0, 0, 0, 0, iABC),    /* OP_CALLBUILTIN */
+  aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_CALLBUILTIN */
   aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_SUBI */
   aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_MULI */
   aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_DIVI */
+  aqlOpMode(0, 0, 0, 0, 1, iABC),    /* OP_GETFLATUP */
+  aqlOpMode(0, 0, 0, 1, 0, iABC),    /* OP_TESTFUNC */
 };
 
 #define getOpMode(m)    (cast(enum OpMode, aql_opmode[m] & 7))
@@ -635,4 +649,7 @@ static const aql_byte aql_opmode[NUM_OPCODES] = {
 #define testOTMode(m)   (aql_opmode[m] & (1 << 6))
 #define testMMMode(m)   (aql_opmode[m] & (1 << 7))
 
+/* number of list items to accumulate before a SETLIST instruction */
+#define LFIELDS_PER_FLUSH	50
+
 #endif /* aopcodes_h */ 
\ No newline at end of file
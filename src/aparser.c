@@ -19,6 +19,7 @@
 
 #include "aql.h"
 #include "aapi.h"
+#include "abuiltin.h"
 #include "acode.h"
 #include "acodegen.h"
 #include "adebug.h"
@@ -141,11 +142,6 @@ static void singlevar (LexState *ls, expdesc *var);
 static void singlevar_unified (LexState *ls, expdesc *var);
 static void funcall_unified (LexState *ls, expdesc *v, int func_reg, int args_start_reg, int nargs, int line);
 
-/* Tail call detection functions */
-static int is_tail_call_candidate(FuncState *fs, expdesc *e, int nret);
-static void analyze_tail_call_pattern(FuncState *fs, expdesc *e, int nret);
-
-
 /* Helper functions */
 static void init_exp (expdesc *e, expkind k, int i);
 static TString *str_checkname (LexState *ls);
@@ -195,6 +191,7 @@ typedef struct BlockCnt {
 */
 static void statement (LexState *ls);
 static void expr (LexState *ls, expdesc *v);
+static BinOpr exprtail (LexState *ls, expdesc *v, int limit);
 static void funcargs (LexState *ls, expdesc *f);
 static void retstat (LexState *ls);
 static int explist (LexState *ls, expdesc *v);
@@ -388,6 +385,10 @@ static int new_localvar (LexState *ls, TString *name) {
   var->aql.container_capacity = 0;
   var->aql.container_flags = 0x02;  /* is_mutable=1, is_container=0 */
   
+  /* Initialize capture information */
+  var->aql.reassigned = 0;
+  var->aql.firstproto = 0;
+  
   /* Initialize debug information */
   #ifdef AQL_DEBUG_BUILD
   var->aql.declaration_line = ls->linenumber;
@@ -481,6 +482,9 @@ static void adjustlocalvars (LexState *ls, int nvars) {
     /* Register for debug information */
     var->vd.pidx = registerlocalvar(ls, fs, var->vd.name);
     
+    /* Closures created from here on may capture the variable */
+    var->aql.firstproto = fs->np;
+    
     
     /* AQL enhancement: Auto-infer type from context if not set */
     if (var->aql.type_level == AQL_TYPE_NONE) {
@@ -499,6 +503,75 @@ static void adjustlocalvars (LexState *ls, int nvars) {
   }
 }
 
+/*
+** Check whether upvalue 'u' of 'p' can live in a flat slot: only
+** OP_GETUPVAL may read it, and every nested function capturing it in
+** turn must be able to take a flat copy too.
+*/
+static int canflatten (Proto *p, int u) {
+  int i, j;
+  for (i = 0; i < p->sizecode; i++) {
+    Instruction ins = p->code[i];
+    switch (GET_OPCODE(ins)) {
+      case OP_SETUPVAL: case OP_GETTABUP:
+        if (GETARG_B(ins) == u) return 0;
+        break;
+      case OP_SETTABUP:
+        if (GETARG_A(ins) == u) return 0;
+        break;
+      default: break;
+    }
+  }
+  for (i = 0; i < p->sizep && p->p[i] != NULL; i++) {
+    Proto *c = p->p[i];
+    for (j = 0; j < c->sizeupvalues; j++) {
+      if (!c->upvalues[j].instack && c->upvalues[j].idx == u &&
+          !canflatten(c, j))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+** Turn upvalue 'u' of 'p' into a flat (by-value) capture: its reads
+** become OP_GETFLATUP and nested functions copy it from the flat slot.
+*/
+static void flattenupval (Proto *p, int u) {
+  int i, j;
+  p->upvalues[u].flat = 1;
+  p->flatupvals = 1;
+  for (i = 0; i < p->sizecode; i++) {
+    if (GET_OPCODE(p->code[i]) == OP_GETUPVAL && GETARG_B(p->code[i]) == u)
+      SET_OPCODE(p->code[i], OP_GETFLATUP);
+  }
+  for (i = 0; i < p->sizep && p->p[i] != NULL; i++) {
+    Proto *c = p->p[i];
+    for (j = 0; j < c->sizeupvalues; j++) {
+      if (!c->upvalues[j].instack && c->upvalues[j].idx == u)
+        flattenupval(c, j);
+    }
+  }
+}
+
+/*
+** A variable going out of scope without ever being stored to after its
+** declaration holds the same value in every closure that captured it,
+** so those closures can copy it instead of sharing an UpVal.
+*/
+static void flattencaptures (FuncState *fs, Vardesc *vd) {
+  int i, j;
+  for (i = vd->aql.firstproto; i < fs->np; i++) {
+    Proto *p = fs->f->p[i];
+    for (j = 0; j < p->sizeupvalues; j++) {
+      Upvaldesc *up = &p->upvalues[j];
+      if (up->instack && up->idx == vd->vd.ridx && !up->flat &&
+          canflatten(p, j))
+        flattenupval(p, j);
+    }
+  }
+}
+
 /*
 ** Close the scope for all variables up to level 'tolevel'.
 ** (debug info.)
@@ -506,12 +579,47 @@ static void adjustlocalvars (LexState *ls, int nvars) {
 static void removevars (FuncState *fs, int tolevel) {
   fs->ls->dyd->actvar.n -= (fs->nactvar - tolevel);
   while (fs->nactvar > tolevel) {
-    LocVar *var = localdebuginfo(fs, --fs->nactvar);
+    Vardesc *vd = getlocalvardesc(fs, fs->nactvar - 1);
+    LocVar *var;
+    if (vd->vd.kind == VDKREG && !vd->aql.reassigned)
+      flattencaptures(fs, vd);
+    var = localdebuginfo(fs, --fs->nactvar);
     if (var)  /* does it have debug information? */
       var->endpc = fs->pc;
   }
 }
 
+/*
+** Record that the local variable behind 'var' (possibly reached as an
+** upvalue of nested functions) is stored to, so that its captures keep
+** a shared UpVal.
+*/
+static void markassigned (FuncState *fs, expdesc *var) {
+  int idx, i;
+  if (var->k == VLOCAL) {
+    getlocalvardesc(fs, var->u.var.vidx)->aql.reassigned = 1;
+    return;
+  }
+  if (var->k != VUPVAL)
+    return;
+  idx = var->u.info;
+  while (!fs->f->upvalues[idx].instack) {  /* walk out to the owner */
+    idx = fs->f->upvalues[idx].idx;
+    fs = fs->prev;
+  }
+  idx = fs->f->upvalues[idx].idx;  /* register in the enclosing function */
+  fs = fs->prev;
+  if (fs == NULL)  /* main function's environment */
+    return;
+  for (i = fs->nactvar - 1; i >= 0; i--) {
+    Vardesc *vd = getlocalvardesc(fs, i);
+    if (vd->vd.kind != RDKCTC && vd->vd.ridx == idx) {
+      vd->aql.reassigned = 1;
+      return;
+    }
+  }
+}
+
 /*
 ** Search the upvalues of the function 'fs' for one
 ** with the given 'name'.
@@ -533,8 +641,10 @@ static Upvaldesc *allocupvalue (FuncState *fs) {
   aqlM_growvector(fs->ls->L, f->upvalues, fs->nups, f->sizeupvalues,
                   Upvaldesc, MAXUPVAL, "upvalues");
   aql_debug("[DEBUG] allocupvalue: after growvector, sizeupvalues=%d\n", f->sizeupvalues);
-  while (oldsize < f->sizeupvalues)
+  while (oldsize < f->sizeupvalues) {
+    f->upvalues[oldsize].flat = 0;
     f->upvalues[oldsize++].name = NULL;
+  }
   aql_debug("[DEBUG] allocupvalue: returning upvalue[%d]\n", fs->nups);
   return &f->upvalues[fs->nups++];
 }
@@ -684,10 +794,11 @@ static int adjust_multiassign_call (LexState *ls, expdesc *e, int nvars) {
     return 0;  /* unreachable */
   }
 
-  pc = &fs->f->code[callpc];
-  if (GET_OPCODE(*pc) != OP_CALL)
+  if (GET_OPCODE(fs->f->code[callpc]) != OP_CALL)
     aqlX_syntaxerror(ls, "multi-variable assignment requires function call with multiple returns");
 
+  callpc = aqlK_uninline(fs, callpc);
+  pc = &fs->f->code[callpc];
   SETARG_C(*pc, nvars + 1);  /* C = expected_returns + 1 */
   base = GETARG_A(*pc);
   if (base + nvars > fs->freereg)
@@ -808,6 +919,91 @@ static void statlist (LexState *ls) {
   }
 }
 
+/*
+** yieldexp -> YIELD [expr]
+** Compiled as a call to the 'yield' builtin. The value is optional: it
+** is omitted when the next token ends the expression or starts a new
+** line. The expression's value is the one passed to the next 'resume'.
+*/
+static void yieldexp (LexState *ls, expdesc *v) {
+  FuncState *fs = ls->fs;
+  int line = ls->linenumber;
+  int base = fs->freereg;
+  int nargs = 0;
+  int id = aqlB_lookup(ls->L, "yield");
+  aqlX_next(ls);  /* skip 'yield' */
+  aqlK_reserveregs(fs, 1);  /* call slot, receives the resumed value */
+  if (!block_follow(ls, 1) && ls->linenumber == line &&
+      ls->t.token != ';' && ls->t.token != TK_RPAREN &&
+      ls->t.token != ',' && ls->t.token != ']') {
+    expdesc e;
+    expr(ls, &e);
+    aqlK_exp2reg(fs, &e, base + 1);
+    fs->freereg = base + 2;
+    nargs = 1;
+  }
+  aqlK_codeABC(fs, OP_CALLBUILTIN, base, nargs, id);
+  aqlK_fixline(fs, line);
+  init_exp(v, VNONRELOC, base);
+  fs->freereg = base + 1;
+}
+
+/*
+** Suffixes of a variable: call arguments and '[' indexes, in any order.
+** Reads use OP_GETPROP, with a constant string key in K[C]. In statement
+** position ('stat'), an index followed by '=' becomes an OP_SETPROP store
+** that ends the suffixes. Returns the kind of the last suffix: TK_LPAREN
+** (call), '[' (read), TK_ASSIGN (store) or 0 (none).
+*/
+static int suffixedexp (LexState *ls, expdesc *v, int stat) {
+  FuncState *fs = ls->fs;
+  int last = 0;
+  while (ls->t.token == TK_LPAREN || ls->t.token == '[') {
+    if (ls->t.token == TK_LPAREN) {
+      /* Function call detected - use unified funcargs */
+      if (v->k != VBUILTIN)
+        aqlK_exp2nextreg(fs, v);  /* ensure function is in a register */
+      funcargs(ls, v);  /* handle function call with Lua-style approach */
+      last = TK_LPAREN;
+    }
+    else {  /* obj[key] */
+      int line = ls->linenumber;
+      int obj, kidx = -1, index_reg = 0, result_reg;
+      expdesc key;
+      aqlK_exp2nextreg(fs, v);  /* ensure object is in a register */
+      obj = v->u.info;
+      aqlX_next(ls);  /* skip '[' */
+      expr(ls, &key);
+      check_match(ls, ']', '[', line);
+      if (stat && ls->t.token == TK_ASSIGN) {  /* obj[key] = value */
+        expdesc val;
+        aqlK_exp2nextreg(fs, &key);
+        aqlX_next(ls);  /* skip '=' */
+        expr(ls, &val);
+        aqlK_exp2nextreg(fs, &val);
+        aqlK_codeABC(fs, OP_SETPROP, obj, key.u.info, val.u.info);
+        return TK_ASSIGN;
+      }
+      if (key.k == VKSTR) {  /* constant string key: use K[C] */
+        kidx = aqlK_stringK(fs, key.u.strval);
+        if (kidx > MAXARG_C) kidx = -1;
+      }
+      if (kidx < 0) {
+        aqlK_exp2nextreg(fs, &key);
+        index_reg = key.u.info;
+      }
+      result_reg = aqlK_reserveregs(fs, 1);
+      if (kidx >= 0)
+        aqlK_codeABCk(fs, OP_GETPROP, result_reg, obj, kidx, 1);
+      else
+        aqlK_codeABC(fs, OP_GETPROP, result_reg, obj, index_reg);
+      init_exp(v, VNONRELOC, result_reg);
+      last = '[';
+    }
+  }
+  return last;
+}
+
 /*
 ** Simple expression parsing - basic literals and variables
 */
@@ -858,84 +1054,78 @@ static void simpleexp (LexState *ls, expdesc *v) {
       body(ls, v, 0, ls->linenumber);
       return;
     }
+    case TK_YIELD: {
+      yieldexp(ls, v);
+      return;
+    }
     case TK_NAME: {
       /* Use unified variable lookup that works for all execution modes */
       singlevar_unified(ls, v);
-      
-      /* Check for postfix operations: function calls or array indexing */
-      while (ls->t.token == TK_LPAREN || ls->t.token == '[') {
-      if (ls->t.token == TK_LPAREN) {
-        /* Function call detected - use unified funcargs */
-        aqlK_exp2nextreg(ls->fs, v);  /* ensure function is in a register */
-        funcargs(ls, v);  /* handle function call with Lua-style approach */
-        } else if (ls->t.token == '[') {
-          /* Array indexing: obj[index] */
-          int line = ls->linenumber;
-          
-          /* Ensure object is in a register */
-          aqlK_exp2nextreg(ls->fs, v);
-          int obj_reg = v->u.info;
-          
-          aqlX_next(ls);  /* skip '[' */
-          
-          /* Parse index expression */
-          expdesc index;
-          expr(ls, &index);
-          aqlK_exp2nextreg(ls->fs, &index);
-          int index_reg = index.u.info;
-          
-          check_match(ls, ']', '[', line);
-          
-          /* Generate OP_GETPROP instruction for array access */
-          int result_reg = ls->fs->freereg++;
-          aqlK_codeABC(ls->fs, OP_GETPROP, result_reg, obj_reg, index_reg);
-          init_exp(v, VNONRELOC, result_reg);
-          
-        }
+      suffixedexp(ls, v, 0);  /* function calls and indexing */
+      return;
+    }
+    case '{': {  /* Dict literal: {key: value, ...} */
+      FuncState *fs = ls->fs;
+      int line = ls->linenumber;
+      int pc = aqlK_codeABC(fs, OP_NEWOBJECT, 0, 0, 0);  /* size fixed below */
+      int dict_reg = fs->freereg;
+      int nentries = 0;
+      aqlK_codeextraarg(fs, 0);  /* space for the high part of the size */
+      aqlK_reserveregs(fs, 1);
+      aqlX_next(ls);  /* skip '{' */
+      while (ls->t.token != '}') {
+        expdesc key, val;
+        if (ls->t.token == TK_NAME && aqlX_lookahead(ls) == TK_COLON)
+          codestring(&key, str_checkname(ls));  /* name: value */
+        else
+          expr(ls, &key);
+        checknext(ls, TK_COLON);
+        aqlK_exp2nextreg(fs, &key);
+        expr(ls, &val);
+        aqlK_exp2nextreg(fs, &val);
+        aqlK_codeABC(fs, OP_SETPROP, dict_reg, key.u.info, val.u.info);
+        fs->freereg = dict_reg + 1;
+        nentries++;
+        if (!testnext(ls, ','))
+          break;
       }
-      
+      check_match(ls, '}', '{', line);
+      /* sized for its entries: filling it never rehashes */
+      aqlK_setobjectsize(fs, pc, dict_reg, 2, nentries);  /* type=2 for dict */
+      init_exp(v, VNONRELOC, dict_reg);
       return;
     }
     case '[': {  /* Array literal: [expr, expr, ...] */
+      FuncState *fs = ls->fs;
       int line = ls->linenumber;
+      int pc = aqlK_codeABC(fs, OP_NEWOBJECT, 0, 0, 0);  /* size fixed below */
+      int array_reg = fs->freereg;
+      int nelems = 0;   /* elements already parsed */
+      int tostore = 0;  /* elements waiting in registers */
+      aqlK_codeextraarg(fs, 0);  /* space for the high part of the size */
+      aqlK_reserveregs(fs, 1);
       aqlX_next(ls);  /* skip '[' */
-      
-      /* Parse array elements and store their register indices */
-      int element_regs[32];  /* Support up to 32 elements for now */
-      int element_count = 0;
-      
-      /* Parse array elements */
       if (ls->t.token != ']') {
         do {
-          if (element_count >= 32) {
-            aqlX_syntaxerror(ls, "too many array elements (max 32)");
-          }
           expdesc element;
+          int reg = array_reg + 1 + tostore;  /* slot SETLIST reads from */
           expr(ls, &element);
-          aqlK_exp2nextreg(ls->fs, &element);
-          element_regs[element_count] = element.u.info;
-          element_count++;
+          aqlK_exp2nextreg(fs, &element);
+          if (element.u.info != reg)  /* index paths may leave it elsewhere */
+            aqlK_codeABC(fs, OP_MOVE, reg, element.u.info, 0);
+          fs->freereg = reg + 1;
+          nelems++;
+          if (++tostore == LFIELDS_PER_FLUSH) {  /* flush a full batch */
+            aqlK_setlist(fs, array_reg, nelems - tostore, tostore);
+            tostore = 0;
+          }
         } while (testnext(ls, ','));
       }
-      
       check_match(ls, ']', '[', line);
-      
-      /* Create array with the correct size */
-      int array_reg = ls->fs->freereg++;
-      aqlK_codeABC(ls->fs, OP_NEWOBJECT, array_reg, 0, element_count);  /* type=0 for array */
-      
-      /* Set array elements using the stored register indices */
-      if (element_count > 0) {
-        for (int i = 0; i < element_count; i++) {
-          /* Create a register for the index */
-          int index_reg = ls->fs->freereg++;
-          aqlK_codeAsBx(ls->fs, OP_LOADI, index_reg, i);
-          
-          /* Generate OP_SETPROP to set array[index] = element */
-          aqlK_codeABC(ls->fs, OP_SETPROP, array_reg, index_reg, element_regs[i]);
-        }
-      }
-      
+      if (tostore > 0)
+        aqlK_setlist(fs, array_reg, nelems - tostore, tostore);
+      /* exact capacity: one allocation, filled by the SETLISTs above */
+      aqlK_setobjectsize(fs, pc, array_reg, 0, nelems);  /* type=0 for array */
       init_exp(v, VNONRELOC, array_reg);
       return;
     }
@@ -958,12 +1148,9 @@ static void simpleexp (LexState *ls, expdesc *v) {
       
       aqlX_next(ls);  /* skip '...' */
       
-      /* Generate OP_VARARG instruction to load all varargs */
-      /* A = target register, C = 0 means load all available varargs */
-      int target_reg = fs->freereg++;
-      aqlK_codeABC(fs, OP_VARARG, target_reg, 0, 0);  /* C=0 means all varargs */
-      
-      init_exp(v, VVARARG, target_reg);
+      /* open OP_VARARG: its register and result count are set by the
+         context ('aqlK_setreturns' / 'aqlK_setoneret') */
+      init_exp(v, VVARARG, aqlK_codeABC(fs, OP_VARARG, 0, 0, 1));
       return;
     }
     default: {
@@ -1061,8 +1248,18 @@ static BinOpr subexpr (LexState *ls, expdesc *v, int limit) {
   else {
     simpleexp(ls, v);
   }
+  op = exprtail(ls, v, limit);
+  leavelevel(ls);
+  return op;  /* return first untreated operator */
+}
+
+/*
+** Binary operators and the ternary following an operand 'v' that has
+** already been parsed; 'limit' as in 'subexpr'
+*/
+static BinOpr exprtail (LexState *ls, expdesc *v, int limit) {
   /* expand while operators have priorities higher than 'limit' */
-  op = getbinopr(ls->t.token);
+  BinOpr op = getbinopr(ls->t.token);
   
   while (op != OPR_NOBINOPR && priority[op].left > limit) {
     expdesc v2;
@@ -1105,8 +1302,6 @@ static BinOpr subexpr (LexState *ls, expdesc *v, int limit) {
     int condition_true = expdesc_is_true(v);
     *v = condition_true ? vtrue : vfalse;
   }
-  
-  leavelevel(ls);
   return op;  /* return first untreated operator */
 }
 
@@ -1114,6 +1309,46 @@ static void expr (LexState *ls, expdesc *v) {
   subexpr(ls, v, 0);
 }
 
+/*
+** Register global function 'name' with prototype 'p' as a candidate for
+** inlining; a later declaration of the same name takes precedence.
+*/
+static void newinline (LexState *ls, TString *name, Proto *p) {
+  Dyndata *dyd = ls->dyd;
+  aqlM_growvector(ls->L, dyd->aql.inlines.arr, dyd->aql.inlines.n,
+                  dyd->aql.inlines.size, InlineDesc, SHRT_MAX, "functions");
+  dyd->aql.inlines.arr[dyd->aql.inlines.n].name = name;
+  dyd->aql.inlines.arr[dyd->aql.inlines.n++].p = p;
+}
+
+/*
+** If the value in register 'base' was just loaded from a global declared
+** as a function, return that function's prototype (the call site may
+** then inline it) and set '*env' to the environment upvalue used.
+*/
+static Proto *inlinecandidate (LexState *ls, int base, int *env) {
+  FuncState *fs = ls->fs;
+  Dyndata *dyd = ls->dyd;
+  Instruction i;
+  TValue *k;
+  int n;
+  if (fs->pc == 0 || fs->lasttarget == fs->pc)
+    return NULL;
+  i = fs->f->code[fs->pc - 1];
+  if (GET_OPCODE(i) != OP_GETTABUP || GETARG_A(i) != base)
+    return NULL;
+  k = &fs->f->k[GETARG_C(i)];
+  if (!ttisstring(k))
+    return NULL;
+  for (n = dyd->aql.inlines.n - 1; n >= 0; n--) {
+    if (eqstr(dyd->aql.inlines.arr[n].name, tsvalue(k))) {
+      *env = GETARG_B(i);
+      return dyd->aql.inlines.arr[n].p;
+    }
+  }
+  return NULL;
+}
+
 /*
 ** Function definition statement: function name() { body }
 */
@@ -1135,8 +1370,11 @@ static void funcstat (LexState *ls, int line) {
   
   /* Parse function body */
   body(ls, &b, 0, line);
+  if (v.k == VINDEXUP)  /* global function: its calls may be inlined */
+    newinline(ls, varname, fs->f->p[fs->np - 1]);
   
   /* Store function to variable */
+  markassigned(ls->fs, &v);
   aqlK_storevar(ls->fs, &v, &b);
 }
 
@@ -1258,6 +1496,8 @@ static void parlist (LexState *ls) {
   adjustlocalvars(ls, nparams);
   f->numparams = cast_byte(nparams);  /* Use nparams instead of fs->nactvar */
   f->is_vararg = cast_byte(is_vararg);  /* Set vararg flag */
+  if (is_vararg)
+    aqlK_codeABC(fs, OP_VARARGPREP, nparams, 0, 0);
   aqlK_reserveregs(fs, nparams);  /* reserve registers for parameters */
   
 }
@@ -1289,64 +1529,58 @@ static void codeclosure (LexState *ls, expdesc *e) {
   aqlK_exp2nextreg(fs, e);  /* fix it at stack top */
 }
 
+/*
+** Code the return of 'nret' values, the last one in 'e' and the others
+** already in consecutive registers from 'base' (the first free register
+** when the list started; it can be above the active locals, as an 'if'
+** condition may leave a temporary behind). A single call becomes a tail
+** call.
+*/
+static void retexp (FuncState *fs, expdesc *e, int base, int nret) {
+  int first;  /* first slot to be returned */
+  if (hasmultret(e->k)) {
+    aqlK_setmultret(fs, e);
+    if (e->k == VCALL && nret == 1 && !fs->bl->insidetbc) {  /* tail call? */
+      SET_OPCODE(getinstruction(fs, e), OP_TAILCALL);
+      first = GETARG_A(getinstruction(fs, e));
+    }
+    else
+      first = base;  /* return all values from here */
+    nret = AQL_MULTRET;  /* return all values */
+  }
+  else if (nret == 1) {  /* only one single value? */
+    aqlK_exp2anyreg(fs, e);  /* can use original slot */
+    first = e->u.info;
+  }
+  else {  /* multiple return values */
+    aqlK_exp2nextreg(fs, e);  /* put last expression in next register */
+    first = fs->freereg - nret;  /* all values are now consecutive */
+  }
+  aql_debug("[DEBUG] retexp: calling aqlK_ret(first=%d, nret=%d)\n", first, nret);
+  aqlK_ret(fs, first, nret);
+}
+
 /*
 ** AQL return statement implementation (based on Lua's retstat)
 */
 static void retstat (LexState *ls) {
   /* stat -> RETURN [explist] [';'] */
-  
   FuncState *fs = ls->fs;
   expdesc e;
   int nret;  /* number of values being returned */
-  int first;  /* first slot to be returned */
-  
-  if (block_follow(ls, 1) || ls->t.token == ';') {
-    nret = 0;  /* return no values */
-    first = 0;  /* no return values */
-  } else {
-    /* Parse the first expression */
+  int base = fs->freereg;  /* where the values will be placed */
+  if (block_follow(ls, 1) || ls->t.token == ';')
+    aqlK_ret(fs, 0, 0);  /* return no values */
+  else {
     nret = 1;
     expr(ls, &e);
-    
-    /* Use Lua's approach: parse expressions and place them in consecutive registers */
     while (testnext(ls, ',')) {
       aqlK_exp2nextreg(fs, &e);  /* put previous expression in next register */
       expr(ls, &e);  /* parse next expression */
       nret++;
     }
-    
-    aql_debug("[DEBUG] retstat: after expr, e.k=%d, hasmultret=%d\n", e.k, hasmultret(e.k));
-    if (hasmultret(e.k)) {
-      aql_debug("[DEBUG] retstat: handling multret, e.k=%d, nret=%d\n", e.k, nret);
-      aqlK_setmultret(fs, &e);
-      if (e.k == VCALL && nret == 1 && !fs->bl->insidetbc) {  /* tail call? */
-        /* For single function call in return, treat as single return value */
-        aql_debug("[DEBUG] retstat: single function call, treating as nret=1\n");
-        aqlK_exp2anyreg(fs, &e);  /* put result in a register */
-        first = e.u.info;  /* use the register where result was placed */
-        nret = 1;  /* single return value */
-      } else {
-        nret = AQL_MULTRET;  /* return all values */
-        first = 0;  /* multret doesn't use first */
-      }
-    }
-    else {
-      aql_debug("[DEBUG] retstat: handling non-multret, e.k=%d, nret=%d\n", e.k, nret);
-      if (nret == 1) {  /* only one single value? */
-        aqlK_exp2anyreg(fs, &e);  /* can use original slot */
-        first = e.u.info;  /* get the register where expression was placed */
-        aql_debug("[DEBUG] retstat: single value, first=%d, e.u.info=%d\n", first, e.u.info);
-      }
-      else {  /* multiple return values */
-        /* FIXED: Put the last expression in the next register */
-        aqlK_exp2nextreg(fs, &e);  /* put last expression in next register */
-        /* All expressions are now in consecutive registers starting from first */
-        first = fs->freereg - nret;  /* first register is freereg - nret */
-      }
-    }
+    retexp(fs, &e, base, nret);
   }
-  aql_debug("[DEBUG] retstat: calling aqlK_ret(first=%d, nret=%d)\n", first, nret);
-  aqlK_ret(fs, first, nret);
   testnext(ls, ';');  /* skip optional semicolon */
 }
 
@@ -1358,9 +1592,20 @@ static void funcargs (LexState *ls, expdesc *f) {
   expdesc args;
   int base, nparams, nargs = 0;
   int line = ls->linenumber;
+  int builtin = -1;
+  int env = 0, callpc = -1;
+  Proto *inl = NULL;
 
-  aql_assert(f->k == VNONRELOC);
-  base = f->u.info;  /* base register for call */
+  if (f->k == VBUILTIN) {  /* direct builtin call: no function value */
+    builtin = f->u.info;
+    base = fs->freereg;
+    aqlK_reserveregs(fs, 1);  /* slot for the result */
+  }
+  else {
+    aql_assert(f->k == VNONRELOC);
+    base = f->u.info;  /* base register for call */
+    inl = inlinecandidate(ls, base, &env);
+  }
   /*
   ** Keep function and arguments contiguous, like Lua does. Without this,
   ** nested calls such as print(hello(41)) can leave a hole between the
@@ -1395,6 +1640,13 @@ static void funcargs (LexState *ls, expdesc *f) {
   }
   aql_debug("[DEBUG] funcargs: base=%d, args.k=%d, hasmultret=%d, freereg=%d\n", 
                base, args.k, hasmultret(args.k), fs->freereg);
+  if (builtin >= 0) {  /* R[base] := builtin(R[base + 1], ...) */
+    aqlK_codeABC(fs, OP_CALLBUILTIN, base, nargs, builtin);
+    aqlK_fixline(fs, line);
+    init_exp(f, VNONRELOC, base);
+    fs->freereg = base + 1;
+    return;
+  }
   if (hasmultret(args.k))
     nparams = AQL_MULTRET;  /* open call */
   else {
@@ -1403,7 +1655,11 @@ static void funcargs (LexState *ls, expdesc *f) {
                  nparams, nargs, fs->freereg, base);
   }
   aql_debug("[DEBUG] funcargs: generating CALL with base=%d, B=%d, C=2\n", base, nparams + 1);
-  init_exp(f, VCALL, aqlK_codeABC(fs, OP_CALL, base, nparams + 1, 2));
+  if (inl != NULL && nparams != AQL_MULTRET)
+    callpc = aqlK_inlinecall(fs, inl, base, nparams, env);
+  if (callpc < 0)
+    callpc = aqlK_codeABC(fs, OP_CALL, base, nparams + 1, 2);
+  init_exp(f, VCALL, callpc);
   aqlK_fixline(fs, line);
   fs->freereg = base + 1;  /* call removes function and arguments and leaves
                               one result (unless changed later) */
@@ -1594,8 +1850,11 @@ static void forbody (LexState *ls, int base, int line, int nvars, int isgen) {
   
   aql_debug("[DEBUG] forbody: base=%d, nvars=%d, isgen=%d\n", base, nvars, isgen);
   
-  /* Generate FORPREP instruction */
-  prep = aqlK_codeAsBx(fs, OP_FORPREP, base, 0);
+  /* Generate FORPREP/ITER_INIT instruction */
+  if (isgen)
+    prep = aqlK_codeABx(fs, OP_ITER_INIT, base, 0);
+  else
+    prep = aqlK_codeAsBx(fs, OP_FORPREP, base, 0);
   
   /* Enter loop block */
   enterblock(fs, &bl, 1);  /* isloop = 1 */
@@ -1616,6 +1875,25 @@ static void forbody (LexState *ls, int base, int line, int nvars, int isgen) {
   
   checknext(ls, '}');  /* expect '}' */
   
+  if (isgen) {
+    /*
+    ** ITER_INIT jumps to ITER_NEXT, which walks containers natively and
+    ** skips the TFORCALL/TFORLOOP pair when done; any other iterable
+    ** falls through to that pair (coroutines and iterator functions).
+    */
+    int next;
+    fixforjump(fs, prep, aqlK_getlabel(fs), 0);
+    next = aqlK_codeABx(fs, OP_ITER_NEXT, base, 0);
+    fixforjump(fs, next, prep + 1, 1);          /* ITER_NEXT jumps back to body */
+    aqlK_codeABC(fs, OP_TFORCALL, base, 0, nvars);
+    aqlK_fixline(fs, line);
+    endfor = aqlK_codeABx(fs, OP_TFORLOOP, base, 0);
+    fixforjump(fs, endfor, prep + 1, 1);        /* TFORLOOP jumps back to body */
+    aqlK_patchtohere(fs, bl.breaklist);
+    aqlK_patchlist(fs, bl.continuelist, next);
+    return;
+  }
+
   /* Generate FORLOOP instruction */
   endfor = aqlK_codeAsBx(fs, OP_FORLOOP, base, 0);
   
@@ -1812,8 +2090,6 @@ static void forinstat_range (LexState *ls, int line, TString *varname) {
   /* forinstat_range -> NAME IN expr '{' block '}' */
   /* Note: FOR and NAME tokens already consumed by caller */
   FuncState *fs = ls->fs;
-  BlockCnt bl;
-  int iterator_reg, value_reg;
   
   /* FOR and variable name already consumed by caller */
   
@@ -1879,58 +2155,28 @@ static void forinstat_range (LexState *ls, int line, TString *varname) {
   }
   
   /* If we get here, it's not a range() call */
-  /* Fall back to generic iterator protocol for containers */
-  
-  /* Parse the iterable expression */
-  expdesc iterable;
-  expr(ls, &iterable);
-  aqlK_exp2nextreg(fs, &iterable);
-  
-  checknext(ls, '{');  /* expect '{' */
-  
-  /* Generate iterator setup code */
-  iterator_reg = fs->freereg;
-  int state_reg = fs->freereg + 1;
-  value_reg = fs->freereg + 2;
-  aqlK_reserveregs(fs, 3);
-  
-  /* Generate ITER_INIT instruction to initialize iterator */
-  aqlK_codeABC(fs, OP_ITER_INIT, iterator_reg, iterable.u.info, 0);
-  
-  /* Create loop variable */
-  new_localvar(ls, varname);
-  
-  /* Enter loop block */
-  enterblock(fs, &bl, 1);  /* isloop = 1 */
-  adjustlocalvars(ls, 1);  /* adjust for loop variable */
-  
-  /* Loop start label */
-  int loopstart = aqlK_getlabel(fs);
-  
-  /* Generate ITER_NEXT instruction */
-  aqlK_codeABC(fs, OP_ITER_NEXT, iterator_reg, state_reg, value_reg);
-  
-  /* Test if iteration is finished (value is nil) */
-  int test_jump = aqlK_codeABC(fs, OP_TEST, value_reg, 0, 0);  /* if value is nil, jump to exit */
-  
-  /* Move iterator value to loop variable */
-  Vardesc *loopvar = getlocalvardesc(fs, fs->nactvar - 1);
-  aqlK_codeABC(fs, OP_MOVE, loopvar->vd.ridx, value_reg, 0);
-  
-  /* Parse loop body */
-  block(ls);
-  
-  /* Jump back to loop start */
-  aqlK_codeAsBx(fs, OP_JMP, 0, loopstart - aqlK_getlabel(fs) - 1);
-  
-  /* Patch test jump to exit loop */
-  aqlK_patchtohere(fs, test_jump);
-  
-  /* Leave loop block */
-  leaveblock(fs);
-  
-  checknext(ls, '}');  /* expect '}' */
-  
+  /*
+  ** Generic for: R[base] holds the iterable (a container, a coroutine or
+  ** an iterator function), base+1..base+3 are the state (the cursor for
+  ** containers), control and closing slots, and base+4 is the loop
+  ** variable. ITER_INIT fills the state slots.
+  */
+  {
+    int base = fs->freereg;
+    expdesc iterable;
+    new_localvar(ls, aqlStr_newlstr(ls->L, "(for state)", 11));  /* base+0: iterable */
+    new_localvar(ls, aqlStr_newlstr(ls->L, "(for state)", 11));  /* base+1: state */
+    new_localvar(ls, aqlStr_newlstr(ls->L, "(for state)", 11));  /* base+2: control */
+    new_localvar(ls, aqlStr_newlstr(ls->L, "(for state)", 11));  /* base+3: closing */
+    new_localvar(ls, varname);  /* base+4: user variable */
+    expr(ls, &iterable);
+    aqlK_exp2reg(fs, &iterable, base);  /* loads may leave freereg above base */
+    fs->freereg = base + 1;
+    aqlK_reserveregs(fs, 3);
+    adjustlocalvars(ls, 4);  /* control variables */
+    checknext(ls, '{');  /* expect '{' */
+    forbody(ls, base, line, 1, 1);  /* 1 user variable, generic for */
+  }
 }
 
 /*
@@ -2118,6 +2364,7 @@ static void assignment_from_var(LexState *ls, expdesc *var) {
   if (testnext(ls, TK_ASSIGN)) {  /* name = expr or name := expr */
     expdesc e;
     expr(ls, &e);  /* parse right-hand side */
+    markassigned(ls->fs, var);
     aqlK_storevar(ls->fs, var, &e);
   }
   else {
@@ -2127,7 +2374,7 @@ static void assignment_from_var(LexState *ls, expdesc *var) {
 
 /*
 ** Expression statement (Lua-style): func | assignment
-** Properly handle both assignments and function calls
+** name = expr, name[key]... = expr or a call name(...)...
 */
 static void exprstat(LexState *ls) {
   FuncState *fs = ls->fs;
@@ -2140,19 +2387,54 @@ static void exprstat(LexState *ls) {
   if (ls->t.token == TK_ASSIGN || ls->t.token == '=') {
     /* Assignment: name = expr */
     assignment_from_var(ls, &v);
+    return;
+  }
+  switch (suffixedexp(ls, &v, 1)) {
+    case TK_ASSIGN:  /* indexed store, already coded */
+      break;
+    case TK_LPAREN:
+      /* Statement calls execute for side effects and discard results. */
+      mark_statement_call(fs, &v);
+      break;
+    default:
+      /* Not supported as statement */
+      aqlX_syntaxerror(ls, "syntax error (only assignments and function calls allowed as statements)");
   }
-  else if (ls->t.token == TK_LPAREN && (v.k == VNONRELOC || v.k == VRELOC || v.k == VINDEXUP || v.k == VLOCAL)) {
-    /* Function call: name(...) - use unified funcargs */
-    aqlK_exp2nextreg(fs, &v);  /* ensure function is in a register */
-    funcargs(ls, &v);  /* handle function call with Lua-style approach */
+}
 
-    /* Statement calls execute for side effects and discard results. */
-    mark_statement_call(fs, &v);
+/*
+** Top-level statement of a chunk loaded with 'autoreturn': an expression
+** that ends the chunk is returned, as if written 'return expr'. Anything
+** else must still be an assignment or a call.
+*/
+static void autoretstat (LexState *ls) {
+  FuncState *fs = ls->fs;
+  expdesc e;
+  int base = fs->freereg;  /* where a returned value list will start */
+  int call = 0;  /* is the statement a plain call? */
+  if (ls->t.token == TK_NAME) {
+    int last;
+    singlevar_unified(ls, &e);
+    if (ls->t.token == TK_ASSIGN || ls->t.token == '=') {  /* assignment */
+      assignment_from_var(ls, &e);
+      return;
+    }
+    last = suffixedexp(ls, &e, 1);
+    if (last == TK_ASSIGN)  /* indexed store */
+      return;
+    call = (last == TK_LPAREN && ls->t.token != TK_QUESTION &&
+            getbinopr(ls->t.token) == OPR_NOBINOPR);
+    exprtail(ls, &e, 0);  /* operators following the operand, if any */
   }
-  else {
-    /* Not supported as statement */
+  else
+    expr(ls, &e);
+  testnext(ls, ';');
+  if (ls->t.token == TK_EOS)  /* last statement: return its value */
+    retexp(fs, &e, base, 1);
+  else if (call)
+    mark_statement_call(fs, &e);
+  else
     aqlX_syntaxerror(ls, "syntax error (only assignments and function calls allowed as statements)");
-  }
 }
 
 /*
@@ -2186,9 +2468,10 @@ static void statement (LexState *ls) {
     }
     case TK_FOR: {  /* stat -> forstat or forinstat */
       /* Look ahead to determine which type of for loop */
+      BlockCnt bl;
       aqlX_next(ls);  /* skip FOR */
       TString *varname = str_checkname(ls);  /* get variable name */
-      
+      enterblock(ls->fs, &bl, 0);  /* scope for loop and control variables */
       
       if (ls->t.token == TK_ASSIGN) {
         /* Numeric for loop: for i = start, end [, step] */
@@ -2202,6 +2485,7 @@ static void statement (LexState *ls) {
       } else {
         aqlX_syntaxerror(ls, "'=' or 'in' expected after for variable");
       }
+      leaveblock(ls->fs);  /* loop scope ('break' jumps to this point) */
       break;
     }
     case TK_LET: {  /* stat -> letstat */
@@ -2233,8 +2517,17 @@ static void statement (LexState *ls) {
       funcstat(ls, line);
       break;
     }
+    case TK_YIELD: {  /* stat -> yieldexp (value discarded) */
+      expdesc e;
+      yieldexp(ls, &e);
+      break;
+    }
     default: {  /* stat -> func | assignment */
-      exprstat(ls);
+      if (ls->dyd->aql.autoreturn && ls->fs->prev == NULL &&
+          ls->fs->bl->previous == NULL)
+        autoretstat(ls);  /* may be the chunk's trailing expression */
+      else
+        exprstat(ls);
       break;
     }
   }
@@ -2291,6 +2584,11 @@ static void close_func (LexState *ls) {
   /* Constants are already in f->k, just update the size */
   f->sizek = fs->nk;
   
+  /* Trim spare upvalue descriptors: closures are built from all of them */
+  f->upvalues = aqlM_reallocvector(L, f->upvalues, f->sizeupvalues,
+                                   fs->nups, Upvaldesc);
+  f->sizeupvalues = fs->nups;
+  
   
   ls->fs = fs->prev;
 }
@@ -2304,6 +2602,7 @@ static void mainfunc (LexState *ls, FuncState *fs) {
   Upvaldesc *env;
   open_func(ls, fs, &bl);
   fs->f->is_vararg = 1;  /* main function is always declared vararg */
+  aqlK_codeABC(fs, OP_VARARGPREP, 0, 0, 0);
   env = allocupvalue(fs);  /* ...set environment upvalue */
   env->instack = 1;
   env->idx = 0;
@@ -2484,31 +2783,9 @@ static int get_variable(TString *name, TValue *result) {
 ** Unified variable lookup for all execution modes
 ** Simplified version without extra abstraction layers
 */
-/* Builtin function table */
-static const struct {
-  const char *name;
-  int id;
-} builtin_functions[] = {
-  {"print", 0},
-  {"type", 1},
-  {"len", 2},
-  {"tostring", 3},
-  {"string", 3},    /* alias for tostring */
-  {"tonumber", 4},
-  {"range", 5},
-  {"print2", 99},   /* experimental Lua-style parameter access */
-  {NULL, -1}  /* sentinel */
-};
-
-/* Check if a name is a builtin function */
-static int get_builtin_id(TString *name) {
-  const char *str = getstr(name);
-  for (int i = 0; builtin_functions[i].name != NULL; i++) {
-    if (strcmp(str, builtin_functions[i].name) == 0) {
-      return builtin_functions[i].id;
-    }
-  }
-  return -1;  /* not a builtin */
+/* Check if a name is a builtin function (see abuiltin.c) */
+static int get_builtin_id(LexState *ls, TString *name) {
+  return aqlB_lookup(ls->L, getstr(name));
 }
 
 static void singlevar_unified(LexState *ls, expdesc *var) {
@@ -2516,20 +2793,10 @@ static void singlevar_unified(LexState *ls, expdesc *var) {
   FuncState *fs = ls->fs;
   
   /* Builtins are call syntax only; plain names can be user globals. */
-  int builtin_id = get_builtin_id(varname);
+  int builtin_id = get_builtin_id(ls, varname);
   if (builtin_id >= 0 && ls->t.token == TK_LPAREN) {
-    /* This is a builtin function - put it in a register like any other function */
-    if (fs != NULL) {
-      /* Compilation mode: load builtin function into a register */
-      aqlK_reserveregs(fs, 1);
-      int reg = fs->freereg - 1;
-      /* Generate instruction to load builtin function into register */
-      aqlK_codeABC(fs, OP_LOADBUILTIN, reg, builtin_id, 0);
-      init_exp(var, VNONRELOC, reg);
-    } else {
-      /* REPL mode: for now, keep the old VBUILTIN behavior */
-      init_exp(var, VBUILTIN, builtin_id);
-    }
+    /* called directly by 'funcargs' (OP_CALLBUILTIN); nothing to load */
+    init_exp(var, VBUILTIN, builtin_id);
     return;
   }
   
@@ -140,6 +140,10 @@ typedef union Vardesc {
     size_t container_capacity;    /* Container capacity */
     aql_byte container_flags;     /* is_container:1, is_mutable:1, etc. */
     
+    /* Capture information (flat upvalues) */
+    aql_byte reassigned;          /* stored to after its declaration */
+    int firstproto;               /* 'fs->np' when the scope started */
+    
     #ifdef AQL_DEBUG_BUILD
     /* Debug information (zero-cost in release) */
     int declaration_line;         /* Declaration line */
@@ -152,6 +156,15 @@ typedef union Vardesc {
   TValue k;  /* constant value (Lua-compatible) */
 } Vardesc;
 
+/*
+** global function whose body is known at compile time (a candidate for
+** inlining at its call sites; see 'aqlK_inlinecall')
+*/
+typedef struct InlineDesc {
+  TString *name;  /* global name the function was declared with */
+  Proto *p;  /* its prototype */
+} InlineDesc;
+
 /*
 ** description of pending goto statements and label statements
 */
@@ -201,9 +214,17 @@ typedef struct Dyndata {
       int container_capacity; /* Container array capacity */
     } containers;
     
+    /* Global functions declared so far (inlining candidates) */
+    struct {
+      InlineDesc *arr;
+      int n;
+      int size;
+    } inlines;
+    
     /* Execution mode tracking */
     AQLExecMode current_mode;   /* Current execution mode */
     bool mode_locked;           /* Is mode locked for this scope? */
+    bool autoreturn;            /* Return a trailing main-chunk expression? */
   } aql;
 } Dyndata;
 
@@ -158,12 +158,10 @@ AQL_API void *aql_touserdata(aql_State *L, int idx) {
 }
 
 /*
-** Resume coroutine (placeholder)
+** Status of a thread (AQL_OK, AQL_YIELD or an error code)
 */
-AQL_API int aql_resume(aql_State *L, aql_State *from, int nargs, int *nresults) {
-    (void)from; (void)nargs; (void)nresults;
-    fprintf(stderr, "AQL Runtime Error: coroutines not implemented in MVP\n");
-    return AQL_ERRRUN;
+AQL_API int aql_status(aql_State *L) {
+    return L->status;
 }
 
 /* aql_pop is defined as a macro in aql.h */
@@ -71,6 +71,7 @@ typedef struct aql_State aql_State;
 #define AQL_TBUILTIN		12  /* builtin functions */
 #define AQL_TVECTOR		13
 #define AQL_TRANGE		14
+#define AQL_TBUILDER		15  /* string builders */
 
 #define AQL_NUMTYPES		16
 
@@ -89,6 +90,17 @@ typedef struct aql_State aql_State;
 */
 typedef int (*aql_CFunction) (aql_State *L);
 
+/*
+** Type for builtins registered by the host (see 'aql_registerbuiltin'):
+** the 'nargs' arguments are at stack indices 'base' ... 'base+nargs-1';
+** the function may push up to AQL_MINSTACK values and returns 1 to
+** take the last one pushed as its result, or 0 for nil
+*/
+typedef int (*aql_BuiltinFunction) (aql_State *L, int base, int nargs);
+
+/* 'maxargs' of a builtin without an upper bound */
+#define AQL_BUILTIN_VARARG	(-1)
+
 /*
 ** Type for continuation functions
 */
@@ -319,6 +331,10 @@ AQL_API size_t   (aql_stringtonumber) (aql_State *L, const char *s);
 AQL_API aql_Alloc (aql_getallocf) (aql_State *L, void **ud);
 AQL_API void      (aql_setallocf) (aql_State *L, aql_Alloc f, void *ud);
 
+AQL_API int (aql_registerbuiltin) (aql_State *L, const char *name,
+                                   aql_BuiltinFunction f,
+                                   int minargs, int maxargs);
+
 AQL_API void (aql_toclose) (aql_State *L, int idx);
 AQL_API void (aql_closeslot) (aql_State *L, int idx);
 
@@ -175,7 +175,7 @@ static int load_bytecode_text_file(const char *filename, Instruction **code, int
     int in_constants_section = 0;
     
     // 统一的常量存储
-    Constant constants_array[20];  // 支持最多20个常量
+    static Constant constants_array[20];  // 支持最多20个常量 (返回给调用者，不能放在栈上)
     int constants_count = 0;
     
     aql_debug("[DEBUG] 开始读取文件行\n");
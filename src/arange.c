@@ -72,6 +72,21 @@ AQL_API void aqlR_free(aql_State *L, RangeObject *range) {
   UNUSED(range);
 }
 
+/*
+** Sub-range: O(1), the result is a new range over the same progression
+*/
+AQL_API RangeObject *aqlR_slice(aql_State *L, const RangeObject *r,
+                                aql_Integer i, aql_Integer j) {
+  RangeObject *sub;
+  if (i < 0) i = 0;
+  if (j > r->count) j = r->count;
+  if (j < i) j = i;
+  sub = aqlR_new(L, aqlR_at(r, i), aqlR_at(r, j), r->step);
+  sub->count = j - i;  /* exact, even if 'stop' overshoots the last element */
+  sub->finished = (sub->count == 0);
+  return sub;
+}
+
 /*
 ** Infer step size based on start and stop values
 */
@@ -36,6 +36,18 @@ AQL_API int aqlR_range3(aql_State *L);  /* range(start, stop, step) */
 AQL_API int aqlR_iter(aql_State *L);    /* __iter method */
 AQL_API int aqlR_next(aql_State *L);    /* __next method */
 
+/*
+** Element 'i' of a range (0 <= i < count), computed from start and
+** step so that indexing, 'len' and iteration never materialize it
+*/
+static l_inline aql_Integer aqlR_at (const RangeObject *r, aql_Integer i) {
+  return intop(+, r->start, intop(*, i, r->step));
+}
+
+/* Sub-range of elements [i, j) (clamped to the range), sharing its step */
+AQL_API RangeObject *aqlR_slice(aql_State *L, const RangeObject *r,
+                                aql_Integer i, aql_Integer j);
+
 /* Utility functions */
 AQL_API aql_Integer aqlR_infer_step(aql_Integer start, aql_Integer stop);
 AQL_API aql_Integer aqlR_calculate_count(aql_Integer start, aql_Integer stop, aql_Integer step);
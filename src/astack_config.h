@@ -46,6 +46,20 @@
 /* Minimum growth size to avoid frequent reallocations */
 #define AQL_MIN_STACK_GROWTH        50
 
+/*
+** Stack Memory
+**
+** With AQL_MMAPSTACK, each thread reserves address space for the largest
+** stack it may reach (AQL_MAXSTACK_SIZE slots) and commits pages only as
+** the stack grows. Growing then never moves the stack, so frames, open
+** upvalues and CallInfos keep their pointers; reserved pages not yet
+** committed fault on access. Define AQL_NOMMAPSTACK to keep the
+** realloc-and-correct scheme (also used if the reservation fails).
+*/
+#if !defined(AQL_NOMMAPSTACK) && (defined(__unix__) || defined(__APPLE__))
+#define AQL_MMAPSTACK
+#endif
+
 /*
 ** Recursion Depth Limits
 */
@@ -63,14 +77,12 @@
 ** Stack Reallocation Safety Limits
 */
 
-/* Maximum CallInfo entries to process during stack reallocation */
-#define AQL_MAX_CALLINFO_REALLOC    50000  /* Handles deep recursion */
+/* Maximum CallInfo entries to process during stack reallocation
+   (every frame holds at least one slot, so no stack can have more) */
+#define AQL_MAX_CALLINFO_REALLOC    AQL_MAXSTACK_SIZE
 
 /* Maximum upvalue entries to process during stack reallocation */
-#define AQL_MAX_UPVALUE_REALLOC     10000  /* Handles complex closures */
-
-/* Safety buffer for function stack allocation (addresses compiler register allocation issues) */
-#define AQL_FUNCTION_STACK_SAFETY   300    /* Extra registers for very complex functions and deep nested loops */
+#define AQL_MAX_UPVALUE_REALLOC     AQL_MAXSTACK_SIZE
 
 /*
 ** Stack Memory Calculation Helpers
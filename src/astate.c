@@ -14,8 +14,10 @@
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "aql.h"
+#include "abuiltin.h"
 #include "astate.h"
 #include "aobject.h"
 #include "amem.h"
@@ -25,6 +27,7 @@
 #include "adatatype.h"
 #include "astack_config.h"
 #include "adebug.h"
+#include "azio.h"
 
 /*
 ** thread state + extra space
@@ -56,6 +59,8 @@ void aqlD_errerr(aql_State *L);
 int aqlD_closeprotected(aql_State *L, ptrdiff_t level, int status);
 void aqlD_seterrorobj(aql_State *L, int errcode, StkId oldtop);
 void aqlD_reallocstack(aql_State *L, int newsize, int raiseerror);
+AQL_API StackValue *aqlD_newstack(aql_State *L, aql_State *L1, int size);
+AQL_API void aqlD_freestack(aql_State *L, int size);
 /* aqlF_closeupval moved to afunc.c */
 void aqlC_freeallobjects(aql_State *L);
 void aqlai_userstateclose(aql_State *L);
@@ -79,13 +84,26 @@ int aqlD_rawrunprotected(aql_State *L, Pfunc f, void *ud);
 */
 #define aqlC_checkGC(L) ((void)0)
 #define aqlC_white(g) (0)
-#define aqlC_newobjdt(L,t,sz,offset) ((GCObject *)aqlM_malloc_tagged(L, sz, t))
+#define aqlC_newobjdt(L,t,sz,offset) newobjdt(L, t, sz, offset)
+
+/*
+** Create an object whose GC header lives 'offset' bytes into its block
+** (threads carry AQL_EXTRASPACE bytes in front of their state).
+*/
+static GCObject *newobjdt (aql_State *L, int tt, size_t sz, size_t offset) {
+    global_State *g = G(L);
+    char *p = cast(char *, aqlM_realloc(L, NULL, 0, sz));
+    GCObject *o = cast(GCObject *, p + offset);
+    o->marked = aqlC_white(g);
+    o->tt_ = cast_byte(tt);
+    o->next = g->allgc;
+    g->allgc = o;
+    return o;
+}
 
 /*
 ** Helper function macros
 */
-#define getCcalls(L) ((L)->nCcalls)
-#define incnny(L) /* no-op for now */
 #define resethookcount(L) (L->hookcount = L->basehookcount)
 #define gettotalbytes(g) cast(lu_mem, (g)->totalbytes + (g)->GCdebt)
 #define completestate(g) ttisnil(&(g)->nilvalue)
@@ -109,9 +127,19 @@ int aqlD_rawrunprotected(aql_State *L, Pfunc f, void *ud);
 ** A macro to create a "random" seed when a state is created;
 ** the seed is used to randomize string hashes.
 */
+#define addbuff(b,p,e) \
+  { size_t t = cast_sizet(e); \
+    memcpy(b + p, &t, sizeof(t)); p += sizeof(t); }
+
 static unsigned int aqlai_makeseed (aql_State *L) {
-    UNUSED(L);
-    return (unsigned int)time(NULL);
+    char buff[3 * sizeof(size_t)];
+    unsigned int h = cast_uint(time(NULL));
+    int p = 0;
+    addbuff(buff, p, L);  /* heap variable */
+    addbuff(buff, p, &h);  /* local variable */
+    addbuff(buff, p, &aql_newstate);  /* public function */
+    aql_assert(p == sizeof(buff));
+    return aqlS_hash_data(buff, p, h);
 }
 
 /*
@@ -205,7 +233,7 @@ static void aqlE_incCstack (aql_State *L) {
 static void stack_init (aql_State *L1, aql_State *L) {
     int i; CallInfo *ci;
     /* initialize stack array */
-    L1->stack.p = aqlM_newvector(L, BASIC_STACK_SIZE + EXTRA_STACK, StackValue);
+    L1->stack.p = aqlD_newstack(L, L1, BASIC_STACK_SIZE + EXTRA_STACK);
     for (i = 0; i < BASIC_STACK_SIZE + EXTRA_STACK; i++)
         setnilvalue(s2v(L1->stack.p + i));  /* erase new stack */
     L1->top.p = L1->stack.p;
@@ -229,7 +257,7 @@ static void freestack (aql_State *L) {
     L->ci = &L->base_ci;  /* free the entire 'ci' list */
     freeCI(L);
     aql_assert(L->nci == 0);
-    aqlM_freearray(L, L->stack.p, stacksize(L) + EXTRA_STACK);  /* free stack */
+    aqlD_freestack(L, stacksize(L) + EXTRA_STACK);  /* free stack */
 }
 
 /*
@@ -303,6 +331,7 @@ static int f_aqlopen (aql_State *L, void *ud) {
     init_registry(L, g);
     aqlStr_init(L);  /* init string system */
     aqlT_initmetamethods(L);  /* init metamethod names and builtin metatables */
+    aqlB_init(L);  /* register the standard builtins */
     /* Skip subsystem initialization for MVP */
     g->gcemergency = 0;  /* allow gc */
     setnilvalue(&g->nilvalue);  /* now state is complete */
@@ -330,6 +359,8 @@ static void preinit_thread (aql_State *L, global_State *g) {
     L->status = AQL_OK;
     L->errfunc = 0;
     L->oldpc = 0;
+    L->jit_state = NULL;
+    L->stackmapped = 0;
 }
 
 static void close_state (aql_State *L) {
@@ -344,7 +375,11 @@ static void close_state (aql_State *L) {
         aqlC_freeallobjects(L);  /* collect all objects */
         aqlai_userstateclose(L);
     }
+    aqlZ_outclose(L);  /* flush pending 'print' output */
+    aqlD_freeshapes(L);
+    aqlB_free(L);
     aqlM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+    aqlM_freearray(L, G(L)->strt.oldhash, G(L)->strt.oldsize);
     freestack(L);
     aql_assert(gettotalbytes(g) == sizeof(LG));
     (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
@@ -444,6 +479,15 @@ AQL_API aql_State *aql_newstate (aql_Alloc f, void *ud) {
     g->gcemergency = GCSTPGC;  /* no GC while building state */
     g->strt.size = g->strt.nuse = 0;
     g->strt.hash = NULL;
+    g->strt.oldhash = NULL;
+    g->strt.oldsize = g->strt.rehashidx = 0;
+    g->shaperoot = NULL;
+    g->outbuf = NULL;
+    g->outn = 0;
+    /* like stdio: line buffered on a terminal, block buffered otherwise */
+    g->outmode = isatty(fileno(stdout)) ? AQL_OUTLINE : AQL_OUTBLOCK;
+    g->builtins = NULL;
+    g->nbuiltins = g->sizebuiltins = 0;
     setnilvalue(&g->l_registry);
     g->panic = NULL;
     g->gcstate = GCSpause;
@@ -79,6 +79,7 @@ struct aql_State {
   CommonHeader;
   aql_byte status;
   aql_byte allowhook;
+  aql_byte stackmapped;  /* stack lives in a reserved region (AQL_MMAPSTACK) */
   unsigned short nci;  /* number of items in 'ci' list */
   StkIdRel top;  /* first free slot in the stack */
   struct global_State *l_G;
@@ -103,6 +104,28 @@ struct aql_State {
 
 #define G(L)	(L->l_G)
 
+/*
+** About 'nCcalls': the lower 16 bits count the number of recursive
+** invocations in the C stack; the higher 16 bits count the number of
+** non-yieldable calls in the stack. (They are together so that both
+** can be changed and saved with one instruction.)
+*/
+
+/* true if this thread does not have non-yieldable calls in the stack */
+#define yieldable(L)		(((L)->nCcalls & 0xffff0000) == 0)
+
+/* real number of C calls */
+#define getCcalls(L)	((L)->nCcalls & 0xffff)
+
+/* Increment the number of non-yieldable calls */
+#define incnny(L)	((L)->nCcalls += 0x10000)
+
+/* Decrement the number of non-yieldable calls */
+#define decnny(L)	((L)->nCcalls -= 0x10000)
+
+/* Non-yieldable call increment */
+#define nyci	(0x10000 | 1)
+
 /*
 ** Union of all collectable objects (only for conversions)
 ** ISO C99, 6.5.2.3 p.5:
@@ -147,6 +170,9 @@ typedef struct stringtable {
   TString **hash;
   int nuse;  /* number of elements */
   int size;
+  TString **oldhash;  /* table being migrated from (NULL if none) */
+  int oldsize;
+  int rehashidx;  /* next bucket of 'oldhash' to migrate */
 } stringtable;
 
 /* Note: CallInfo is now defined earlier in this file */
@@ -235,9 +261,17 @@ typedef struct global_State {
   TString *tmname[TM_N];  /* array with tag-method names */
   struct Table *mt[AQL_NUMTYPES];  /* metatables for basic types */
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
+  TString *intcache[NUMCACHE_N];  /* strings of small integers */
+  char *outbuf;  /* pending 'print' output (NULL until first print) */
+  size_t outn;  /* number of pending bytes in 'outbuf' */
+  int outmode;  /* flush policy for 'outbuf' (AQL_OUTLINE, ...) */
+  struct Builtin *builtins;  /* native builtins, indexed by id (abuiltin.c) */
+  int nbuiltins;  /* number of registered builtins */
+  int sizebuiltins;  /* size of 'builtins' */
   aql_WarnFunction warnf;  /* warning function */
   void *ud_warn;         /* auxiliary data to 'warnf' */
   TValue l_globals;  /* global variables dict */
+  struct Shape *shaperoot;  /* root of the dict shape tree */
   GCObject *finoold;  /* list of survival/old objects with finalizers */
 } global_State; /* forward declaration, actual definition in aobject.h */
 
@@ -15,6 +15,9 @@
 #include <ctype.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdint.h>
 #include "adebug.h"
 
 /* 前向声明和宏定义 */
@@ -26,13 +29,100 @@
 #define AQLAI_MAXALIGN double u; void *s; long l; aql_Number n;
 #endif
 
-/* 字符串哈希函数 */
-static unsigned int aqlS_hash_string(const char *str, size_t l) {
-    unsigned int hash = 5381;
-    for (size_t i = 0; i < l; i++) {
-        hash = ((hash << 5) + hash) + cast_byte(str[i]);
+/* ============================================================================
+ * 字符串哈希 (seeded, word-at-a-time; wyhash 风格)
+ * ============================================================================ */
+
+#define HSECRET0  0xa0761d6478bd642fULL
+#define HSECRET1  0xe7037ed1a0b428dbULL
+#define HSECRET2  0x8ebc6af09c88c6e3ULL
+#define HSECRET3  0x589965cc75374cc3ULL
+
+static l_inline uint64_t hread64 (const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static l_inline uint64_t hread32 (const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* 1..3 bytes: first, middle and last byte */
+static l_inline uint64_t hread3 (const unsigned char *p, size_t l) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[l >> 1] << 8) | p[l - 1];
+}
+
+/* 64x64 -> 128 multiply, folded to 64 bits */
+static l_inline uint64_t hmix (uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), lo, hi;
+    uint64_t c = t < rl;
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+/*
+** Hash 'l' bytes of 'str' with 'seed'. Reads 8 bytes at a time (48 per
+** round on long inputs, in three independent lanes) and mixes with a
+** full-width multiply, so every input bit reaches the result and the
+** outcome cannot be predicted without the seed.
+*/
+unsigned int aqlS_hash_data (const char *str, size_t l, unsigned int seed) {
+    const unsigned char *p = (const unsigned char *)str;
+    uint64_t h = hmix((uint64_t)seed ^ HSECRET0, HSECRET1);
+    uint64_t a, b;
+    if (l <= 16) {
+        if (l >= 4) {
+            size_t off = (l >> 3) << 2;
+            a = (hread32(p) << 32) | hread32(p + off);
+            b = (hread32(p + l - 4) << 32) | hread32(p + l - 4 - off);
+        } else if (l > 0) {
+            a = hread3(p, l);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = l;
+        if (i > 48) {
+            uint64_t h1 = h, h2 = h;
+            do {
+                h = hmix(hread64(p) ^ HSECRET1, hread64(p + 8) ^ h);
+                h1 = hmix(hread64(p + 16) ^ HSECRET2, hread64(p + 24) ^ h1);
+                h2 = hmix(hread64(p + 32) ^ HSECRET3, hread64(p + 40) ^ h2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            h ^= h1 ^ h2;
+        }
+        while (i > 16) {
+            h = hmix(hread64(p) ^ HSECRET1, hread64(p + 8) ^ h);
+            p += 16;
+            i -= 16;
+        }
+        a = hread64(p + i - 16);
+        b = hread64(p + i - 8);
     }
-    return hash;
+    h = hmix(hmix(a ^ HSECRET1, b ^ h) ^ HSECRET0 ^ l, HSECRET1);
+    return cast(unsigned int, h ^ (h >> 32));
+}
+
+/*
+** Continue a hash over more data (the previous hash acts as the seed)
+*/
+unsigned int aqlS_hash_continue (const char *str, size_t l, unsigned int hash) {
+    return aqlS_hash_data(str, l, hash);
 }
 
 /* 模运算宏 */
@@ -72,31 +162,15 @@ static l_noret aqlM_toobig(aql_State *L) {
  * ============================================================================ */
 
 /*
-** 计算长字符串的哈希值 (使用djb2算法的变种)
+** 计算长字符串的哈希值 (延迟计算; 'hash' 在计算前保存种子)
 */
 unsigned int aqlS_hashlongstr(TString *ts) {
-    const char *str = getstr(ts);
-    size_t len = tsslen(ts);
-    unsigned int hash = 5381;
-    
-    /* 对于长字符串，只哈希头部、中部和尾部 */
-    if (len <= 32) {
-        /* 短于32字节，全部哈希 */
-        for (size_t i = 0; i < len; i++) {
-            hash = ((hash << 5) + hash) + cast_byte(str[i]);
-        }
-    } else {
-        /* 长字符串采样哈希 */
-        size_t step = len / 16;  /* 步长 */
-        for (size_t i = 0; i < len; i += step) {
-            hash = ((hash << 5) + hash) + cast_byte(str[i]);
-        }
-        /* 确保包含首尾字符 */
-        hash = ((hash << 5) + hash) + cast_byte(str[0]);
-        hash = ((hash << 5) + hash) + cast_byte(str[len-1]);
+    aql_assert(ts->shrlen == 0xFF);
+    if (ts->extra == 0) {  /* no hash yet? */
+        ts->hash = aqlS_hash_data(getstr(ts), tsslen(ts), ts->hash);
+        ts->extra = 1;  /* now it has its hash */
     }
-    
-    return hash;
+    return ts->hash;
 }
 
 /*
@@ -110,7 +184,7 @@ int aqlS_eqlngstr(TString *a, TString *b) {
     if (len != tsslen(b)) return 0;
     
     /* 哈希值不同，直接返回不相等 (如果都已计算) */
-    if (a->hash != 0 && b->hash != 0 && a->hash != b->hash) return 0;
+    if (a->extra && b->extra && a->hash != b->hash) return 0;
     
     /* 逐字节比较 */
     return (memcmp(getstr(a), getstr(b), len) == 0);
@@ -122,18 +196,16 @@ int aqlS_eqlngstr(TString *a, TString *b) {
 int aqlS_eqstr(TString *a, TString *b) {
     if (a == b) return 1;  /* 相同对象 */
     
-    /* 检查是否都是短字符串或都是长字符串 */
     int a_is_short = (a->shrlen != 0xFF);
     int b_is_short = (b->shrlen != 0xFF);
     
-    if (a_is_short != b_is_short) return 0;  /* 类型不同 */
-    
-    if (a_is_short) {
-        /* 短字符串已经内部化，指针相等即内容相等 */
-        return (a == b);
-    } else {
-        /* 长字符串需要内容比较 */
+    if (a_is_short && b_is_short)
+        return 0;  /* 都已内部化，指针不同即内容不同 */
+    else if (!a_is_short && !b_is_short)
         return aqlS_eqlngstr(a, b);
+    else {  /* interned vs. not-yet-interned string: compare contents */
+        size_t len = tsslen(a);
+        return (len == tsslen(b) && memcmp(getstr(a), getstr(b), len) == 0);
     }
 }
 
@@ -155,7 +227,7 @@ TString *aqlStr_createlngstrobj(aql_State *L, size_t l) {
     ts = gco2ts(o);
     ts->shrlen = 0xFF;  /* 标记为长字符串 */
     ts->u.lnglen = l;
-    ts->hash = 0;  /* 延迟计算哈希值 */
+    ts->hash = G(L)->seed;  /* 延迟计算哈希值 (先保存种子) */
     ts->extra = 0;
     getstr(ts)[l] = '\0';  /* 确保以null结尾 */
     
@@ -163,55 +235,81 @@ TString *aqlStr_createlngstrobj(aql_State *L, size_t l) {
 }
 
 /*
-** 从字符串池中移除字符串
+** The string table grows incrementally: a resize only
+** allocates the new bucket array, and the chains of the old one are
+** moved over a few buckets at a time by later insertions. While a
+** migration is running a string may live in either array, so lookups
+** check both; new strings always go to the new one.
+*/
+
+/* buckets migrated per insertion; one already outpaces the next resize */
+#define STRT_REHASHSTEP	4
+
+static void rehashstep(aql_State *L, stringtable *tb, int nbuckets) {
+    while (nbuckets-- > 0 && tb->rehashidx < tb->oldsize) {
+        TString *p = tb->oldhash[tb->rehashidx];
+        tb->oldhash[tb->rehashidx++] = NULL;
+        while (p) {  /* move the whole chain */
+            TString *hnext = p->u.hnext;
+            unsigned int h = lmod(p->hash, tb->size);
+            p->u.hnext = tb->hash[h];
+            tb->hash[h] = p;
+            p = hnext;
+        }
+    }
+    if (tb->rehashidx >= tb->oldsize) {  /* migration done? */
+        aqlM_freearray(L, tb->oldhash, tb->oldsize);
+        tb->oldhash = NULL;
+        tb->oldsize = tb->rehashidx = 0;
+    }
+}
+
+/*
+** 从字符串池中移除字符串 (during a migration it may be in either array)
 */
 void aqlStr_remove(aql_State *L, TString *ts) {
     stringtable *tb = &G(L)->strt;
     TString **list = &tb->hash[lmod(ts->hash, tb->size)];
     
-    while (*list != ts)  /* 查找字符串 */
+    while (*list != NULL && *list != ts)  /* 查找字符串 */
         list = &(*list)->u.hnext;
+    if (*list == NULL) {  /* not migrated yet */
+        aql_assert(tb->oldhash != NULL);
+        list = &tb->oldhash[lmod(ts->hash, tb->oldsize)];
+        while (*list != ts)
+            list = &(*list)->u.hnext;
+    }
     
     *list = (*list)->u.hnext;  /* 从链表中移除 */
     tb->nuse--;
 }
 
 /*
-** 调整字符串表大小
+** 调整字符串表大小: allocates the new array and starts migrating to it
+** (a migration still running is finished first)
 */
 void aqlStr_resize(aql_State *L, int newsize) {
     stringtable *tb = &G(L)->strt;
-    TString **oldhash = tb->hash;
-    int oldsize = tb->size;
+    TString **newhash;
     
-    /* 分配新的哈希表 */
-    tb->hash = (TString**)aqlM_malloc(L, newsize * sizeof(TString*));
-    if (!tb->hash) {
-        tb->hash = oldhash;  /* 恢复原状态 */
-        return;
-    }
+    if (tb->oldhash != NULL)
+        rehashstep(L, tb, tb->oldsize);  /* finish previous migration */
     
-    /* 初始化新表 */
+    /* 分配新的哈希表 */
+    newhash = (TString**)aqlM_malloc(L, newsize * sizeof(TString*));
+    if (!newhash)
+        return;  /* keep current table */
     for (int i = 0; i < newsize; i++) {
-        tb->hash[i] = NULL;
+        newhash[i] = NULL;
     }
-    tb->size = newsize;
     
-    /* 重新哈希所有字符串 */
-    if (oldhash) {
-        for (int i = 0; i < oldsize; i++) {
-            TString *p = oldhash[i];
-            while (p) {
-                TString *hnext = p->u.hnext;
-                unsigned int h = lmod(p->hash, newsize);
-                p->u.hnext = tb->hash[h];
-                tb->hash[h] = p;
-                p = hnext;
-            }
-        }
-        /* 释放旧表 */
-        aqlM_freemem(L, oldhash, oldsize * sizeof(TString*));
+    if (tb->hash != NULL) {
+        tb->oldhash = tb->hash;
+        tb->oldsize = tb->size;
+        tb->rehashidx = 0;
     }
+    tb->hash = newhash;
+    tb->size = newsize;
 }
 
 /*
@@ -223,6 +321,8 @@ void aqlStr_clearcache(global_State *g) {
             g->strcache[i][j] = NULL;
         }
     }
+    for (int i = 0; i < NUMCACHE_N; i++)
+        g->intcache[i] = NULL;
 }
 
 /*
@@ -240,6 +340,8 @@ void aqlStr_init(aql_State *L) {
             g->strcache[i][j] = NULL;
         }
     }
+    for (i = 0; i < NUMCACHE_N; i++)
+        g->intcache[i] = NULL;
 }
 
 /*
@@ -249,7 +351,7 @@ static TString *internshrstr(aql_State *L, const char *str, size_t l) {
     TString *ts;
     global_State *g = G(L);
     stringtable *tb = &g->strt;
-    unsigned int h = aqlS_hash_string(str, l);
+    unsigned int h = aqlS_hash_data(str, l, g->seed);
     TString **list = &tb->hash[lmod(h, tb->size)];
     
     aql_debug("[DEBUG] internshrstr: str='%.*s', len=%zu, hash=%u, table_size=%d, table_nuse=%d\n", 
@@ -257,7 +359,7 @@ static TString *internshrstr(aql_State *L, const char *str, size_t l) {
     
     aql_assert(l <= AQLAI_MAXSHORTLEN);
     
-    /* 在字符串表中查找 */
+    /* 在字符串表中查找 (迁移期间新旧两个表都查) */
     for (ts = *list; ts != NULL; ts = ts->u.hnext) {
         if (l == tsslen(ts) && (memcmp(str, getstr(ts), l * sizeof(char)) == 0)) {
             /* 找到相同字符串，检查是否需要重新激活 */
@@ -266,12 +368,22 @@ static TString *internshrstr(aql_State *L, const char *str, size_t l) {
             return ts;
         }
     }
+    if (tb->oldhash != NULL) {
+        for (ts = tb->oldhash[lmod(h, tb->oldsize)]; ts != NULL; ts = ts->u.hnext) {
+            if (l == tsslen(ts) && (memcmp(str, getstr(ts), l * sizeof(char)) == 0)) {
+                if (isdead(g, ts))
+                    changewhite(ts);
+                return ts;
+            }
+        }
+    }
     
-    /* 检查是否需要扩展字符串表 */
-    if (tb->nuse >= tb->size && tb->size <= MAX_INT/2) {
+    /* 检查是否需要扩展字符串表; otherwise advance a running migration */
+    if (tb->nuse >= tb->size && tb->size <= MAX_INT/2)
         aqlStr_resize(L, tb->size * 2);
-        list = &tb->hash[lmod(h, tb->size)];  /* 重新计算位置 */
-    }
+    else if (tb->oldhash != NULL)
+        rehashstep(L, tb, STRT_REHASHSTEP);
+    list = &tb->hash[lmod(h, tb->size)];  /* 重新计算位置 */
     
     /* 创建新的短字符串 */
     ts = createstrobj(L, l, AQL_VSHRSTR, h);
@@ -301,10 +413,73 @@ TString *aqlStr_newlstr(aql_State *L, const char *str, size_t l) {
 }
 
 /*
-** 创建新字符串 (以null结尾)
+** 创建新字符串 (以null结尾). C strings passed to the API are usually
+** literals, so the result is cached by address in 'strcache'; the
+** contents are still checked, as the address may have been reused.
 */
 TString *aqlStr_new(aql_State *L, const char *str) {
-    return aqlStr_newlstr(L, str, strlen(str));
+    unsigned int i = point2uint(str) % STRCACHE_N;  /* hash */
+    int j;
+    TString **p = G(L)->strcache[i];
+    for (j = 0; j < STRCACHE_M; j++) {
+        if (p[j] != NULL && strcmp(str, getstr(p[j])) == 0)  /* hit? */
+            return p[j];
+    }
+    /* normal route */
+    for (j = STRCACHE_M - 1; j > 0; j--)
+        p[j] = p[j - 1];  /* move out last element */
+    /* new element is first in the list */
+    p[0] = aqlStr_newlstr(L, str, strlen(str));
+    return p[0];
+}
+
+/*
+** String form of a number, as printed by 'print' (floats without a
+** forced '.0'). Strings of small non-negative integers (counters,
+** indices, keys) are interned once and kept in 'intcache'.
+*/
+TString *aqlStr_fromnumber(aql_State *L, const TValue *o) {
+    char buff[MAXNUMBER2STR];
+    int len;
+    if (ttisinteger(o)) {
+        aql_Integer i = ivalue(o);
+        if (aql_castS2U(i) < NUMCACHE_N) {
+            TString **p = &G(L)->intcache[i];
+            if (*p == NULL) {
+                len = aqlO_fmtint(buff, i);
+                *p = aqlStr_newlstr(L, buff, len);
+                aqlC_fix(L, obj2gco(*p));  /* never collect it */
+            }
+            return *p;
+        }
+        len = aqlO_fmtint(buff, i);
+    }
+    else
+        len = aqlO_fmtflt(buff, fltvalue(o));
+    return aqlStr_newlazy(L, buff, len);
+}
+
+/*
+** Create a string without interning it, whatever its length. Runtime
+** results (concatenations, conversions, substrings) are built this
+** way: most of them are never used as keys, so they skip the string
+** table. Until interned they behave as long strings: equality checks
+** length, hash and contents.
+*/
+TString *aqlStr_newlazy(aql_State *L, const char *str, size_t l) {
+    TString *ts = aqlStr_createlngstrobj(L, l);
+    memcpy(getstr(ts), str, l * sizeof(char));
+    return ts;
+}
+
+/*
+** Canonical (interned) version of a not-yet-interned short string;
+** other strings are returned unchanged
+*/
+TString *aqlStr_intern(aql_State *L, TString *ts) {
+    if (aqlStr_islazy(ts))
+        return internshrstr(L, getstr(ts), ts->u.lnglen);
+    return ts;
 }
 
 /* ============================================================================
@@ -336,21 +511,114 @@ TString *aqlStr_concat(aql_State *L, TString *a, TString *b) {
     if (total < la || total > MAX_SIZE)  /* 溢出检查 */
         aqlM_toobig(L);
     
-    if (total == 0)
-        return aqlStr_newlstr(L, "", 0);
-    
-    /* 直接分配内存进行拼接 */
-    char *buffer = (char *)aqlM_malloc(L, (total + 1) * sizeof(char));
-    if (!buffer) aqlM_toobig(L);
-    
-    memcpy(buffer, getstr(a), la);
-    memcpy(buffer + la, getstr(b), lb);
-    buffer[total] = '\0';
-    
-    TString *result = aqlStr_newlstr(L, buffer, total);
-    aqlM_freemem(L, buffer, (total + 1) * sizeof(char));
+    if (lb == 0) return a;
+    if (la == 0) return b;
     
-    return result;
+    /* copy straight into the new (not interned) string */
+    TString *ts = aqlStr_createlngstrobj(L, total);
+    memcpy(getstr(ts), getstr(a), la);
+    memcpy(getstr(ts) + la, getstr(b), lb);
+    return ts;
+}
+
+/* ============================================================================
+ * 字符串构建器
+ * ============================================================================ */
+
+StrBuilder *aqlStr_newbuilder(aql_State *L, size_t size) {
+    StrBuilder *sb = (StrBuilder *)aqlM_newobject(L, AQL_TBUILDER, sizeof(StrBuilder));
+    sb->len = 0;
+    sb->size = 0;
+    sb->buff = NULL;
+    if (size > 0) {
+        sb->buff = (char *)aqlM_malloc(L, size);
+        sb->size = size;
+    }
+    return sb;
+}
+
+void aqlStr_freebuilder(aql_State *L, StrBuilder *sb) {
+    if (sb->buff)
+        aqlM_freemem(L, sb->buff, sb->size);
+    aqlM_freemem(L, sb, sizeof(StrBuilder));
+}
+
+/*
+** Make room for 'l' more bytes, at least doubling the buffer
+*/
+static void growbuilder(aql_State *L, StrBuilder *sb, size_t l) {
+    size_t newsize;
+    if (l > MAX_SIZE - sb->len)
+        aqlM_toobig(L);
+    newsize = (sb->size > MAX_SIZE / 2) ? MAX_SIZE : sb->size * 2;
+    if (newsize < sb->len + l) newsize = sb->len + l;
+    if (newsize < MINBUILDERSIZE) newsize = MINBUILDERSIZE;
+    sb->buff = (char *)aqlM_realloc(L, sb->buff, sb->size, newsize);
+    sb->size = newsize;
+}
+
+void aqlStr_bappend(aql_State *L, StrBuilder *sb, const char *s, size_t l) {
+    if (l > sb->size - sb->len)
+        growbuilder(L, sb, l);
+    memcpy(sb->buff + sb->len, s, l);
+    sb->len += l;
+}
+
+/*
+** Append the printed form of a value (same format as 'print'); numbers
+** are formatted straight into the buffer without creating a string
+*/
+void aqlStr_bappendvalue(aql_State *L, StrBuilder *sb, const TValue *v) {
+    char buff[64];
+    int n;
+    switch (ttypetag(v)) {
+        case AQL_VSHRSTR: case AQL_VLNGSTR:
+            aqlStr_bappend(L, sb, getstr(tsvalue(v)), tsslen(tsvalue(v)));
+            return;
+        case AQL_VBUILDER: {
+            StrBuilder *other = buildervalue(v);
+            if (other == sb) {  /* appending to itself */
+                if (sb->len > sb->size - sb->len)
+                    growbuilder(L, sb, sb->len);
+                memcpy(sb->buff + sb->len, sb->buff, sb->len);
+                sb->len *= 2;
+            } else {
+                aqlStr_bappend(L, sb, other->buff, other->len);
+            }
+            return;
+        }
+        case AQL_VNUMINT:  /* format in place */
+            if (MAXNUMBER2STR > sb->size - sb->len)
+                growbuilder(L, sb, MAXNUMBER2STR);
+            sb->len += aqlO_fmtint(sb->buff + sb->len, ivalue(v));
+            return;
+        case AQL_VNUMFLT:
+            if (MAXNUMBER2STR > sb->size - sb->len)
+                growbuilder(L, sb, MAXNUMBER2STR);
+            sb->len += aqlO_fmtflt(sb->buff + sb->len, fltvalue(v));
+            return;
+        case AQL_VTRUE:
+            n = snprintf(buff, sizeof(buff), "true");
+            break;
+        case AQL_VFALSE:
+            n = snprintf(buff, sizeof(buff), "false");
+            break;
+        case AQL_VNIL:
+            n = snprintf(buff, sizeof(buff), "nil");
+            break;
+        default:
+            n = snprintf(buff, sizeof(buff), "(type %d)", ttype(v));
+            break;
+    }
+    aqlStr_bappend(L, sb, buff, cast_sizet(n));
+}
+
+/*
+** Materialize the builder contents as a string; the builder keeps its
+** contents and can go on appending
+*/
+TString *aqlStr_bbuild(aql_State *L, StrBuilder *sb) {
+    return aqlStr_newlazy(L, sb->buff ? sb->buff : "", sb->len);
 }
 
 /*
@@ -369,7 +637,7 @@ TString *aqlStr_sub(aql_State *L, TString *str, size_t start, size_t end) {
     if (sublen == 0)
         return aqlStr_newlstr(L, "", 0);
     
-    return aqlStr_newlstr(L, data + start, sublen);
+    return aqlStr_newlazy(L, data + start, sublen);
 }
 
 /* ============================================================================
@@ -388,140 +656,365 @@ TString *aqlS_formatf(aql_State *L, const char *fmt, ...) {
 }
 
 /*
-** 格式化字符串 (va_list版本) - 简化实现
+** Result of 'aqlS_formatv': a stack buffer that moves to the heap when
+** the output outgrows it
 */
-TString *aqlS_formatv(aql_State *L, const char *fmt, va_list args) {
-    char buffer[BUFVFS];  /* 使用固定大小缓冲区 */
-    int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
-    
-    if (len < 0) {
-        /* 格式化错误 */
-        return aqlStr_newlstr(L, "format error", 12);
+typedef struct FmtBuff {
+    char *b;
+    size_t n;     /* bytes in use */
+    size_t size;  /* size of 'b' */
+    char init[BUFVFS];
+} FmtBuff;
+
+static char *fmtspace(aql_State *L, FmtBuff *fb, size_t l) {
+    if (l > fb->size - fb->n) {
+        size_t newsize = (fb->size * 2 > fb->n + l) ? fb->size * 2 : fb->n + l;
+        char *nb = (char *)aqlM_malloc(L, newsize);
+        memcpy(nb, fb->b, fb->n);
+        if (fb->b != fb->init)
+            aqlM_freemem(L, fb->b, fb->size);
+        fb->b = nb;
+        fb->size = newsize;
     }
-    
-    if (len >= (int)sizeof(buffer)) {
-        /* 缓冲区不够，截断 */
-        len = sizeof(buffer) - 1;
-        buffer[len] = '\0';
+    return fb->b + fb->n;
+}
+
+/* appends the output of printf conversion 'spec' of value 'v' (type 't') */
+#define fmtconv(L,fb,spec,t,v) { \
+    t v_ = (v); \
+    int l_ = snprintf(NULL, 0, spec, v_); \
+    snprintf(fmtspace(L, fb, cast_sizet(l_) + 1), cast_sizet(l_) + 1, spec, v_); \
+    (fb)->n += cast_sizet(l_); }
+
+/*
+** Appends number text 's' to the field: '+' and ' ' flags add a sign,
+** '-' pads on the right, '0' with zeros after the sign, else spaces
+*/
+static void fmtnumber(aql_State *L, FmtBuff *fb, const char *flags,
+                      int width, const char *s) {
+    char sign = (*s == '-') ? *s++ : (strchr(flags, '+') ? '+' :
+                                      strchr(flags, ' ') ? ' ' : '\0');
+    size_t l = strlen(s) + (sign != '\0');
+    size_t pad = (width > 0 && cast_sizet(width) > l) ? cast_sizet(width) - l : 0;
+    int zeros = (strchr(flags, '0') && !strchr(flags, '-') && isdigit(cast_uchar(*s)));
+    char *p = fmtspace(L, fb, l + pad);
+    if (pad > 0 && !zeros && !strchr(flags, '-')) {
+        memset(p, ' ', pad);
+        p += pad;
     }
-    
-    return aqlStr_newlstr(L, buffer, (size_t)len);
+    if (sign != '\0')
+        *p++ = sign;
+    if (zeros) {
+        memset(p, '0', pad);
+        p += pad;
+    }
+    memcpy(p, s, strlen(s));
+    p += strlen(s);
+    if (pad > 0 && strchr(flags, '-'))
+        memset(p, ' ', pad);
+    fb->n += l + pad;
+}
+
+/*
+** 格式化字符串 (va_list版本): the printf conversions, with flags, field
+** width, precision ('*' too) and length modifiers. '%f' without a
+** precision and AQL's '%I' ('aql_Integer') print numbers as 'tostring'
+** does ('%.14g' style); '%.Nf' is printf's fixed notation.
+*/
+TString *aqlS_formatv(aql_State *L, const char *fmt, va_list args) {
+    FmtBuff fb;
+    TString *ts;
+    const char *e;
+    fb.b = fb.init;
+    fb.n = 0;
+    fb.size = sizeof(fb.init);
+    while ((e = strchr(fmt, '%')) != NULL) {
+        char spec[48], flags[8], len[3] = "";
+        char *sp = spec;
+        int nflags = 0, width = -1, prec = -1;
+        size_t lf = cast_sizet(e - fmt);
+        memcpy(fmtspace(L, &fb, lf), fmt, lf);
+        fb.n += lf;
+        fmt = e + 1;
+        while (*fmt != '\0' && strchr("-+ #0", *fmt) && nflags < 5)
+            flags[nflags++] = *fmt++;
+        flags[nflags] = '\0';
+        if (*fmt == '*') {
+            width = va_arg(args, int);
+            if (width < 0) {  /* negative width: left-justify */
+                flags[nflags++] = '-';
+                flags[nflags] = '\0';
+                width = (width == INT_MIN) ? INT_MAX : -width;
+            }
+            fmt++;
+        }
+        else if (isdigit(cast_uchar(*fmt)))
+            width = cast_int(strtol(fmt, (char **)&fmt, 10));
+        if (*fmt == '.') {
+            fmt++;
+            if (*fmt == '*') {
+                prec = va_arg(args, int);
+                fmt++;
+            }
+            else
+                prec = cast_int(strtol(fmt, (char **)&fmt, 10));
+        }
+        while (*fmt != '\0' && strchr("hlLqjzt", *fmt) && strlen(len) < 2)
+            strncat(len, fmt++, 1);
+        /* rebuild the conversion with '*' resolved */
+        *sp++ = '%';
+        sp += sprintf(sp, "%s", flags);
+        if (width >= 0) sp += sprintf(sp, "%d", width);
+        if (prec >= 0) sp += sprintf(sp, ".%d", prec);
+        sp += sprintf(sp, "%s%c", len, *fmt);
+        switch (*fmt) {
+            case 'd': case 'i': {
+                if (len[0] == 'l' && len[1] == 'l')
+                    fmtconv(L, &fb, spec, long long, va_arg(args, long long))
+                else if (len[0] == 'l')
+                    fmtconv(L, &fb, spec, long, va_arg(args, long))
+                else if (len[0] == 'z' || len[0] == 't')
+                    fmtconv(L, &fb, spec, ptrdiff_t, va_arg(args, ptrdiff_t))
+                else if (len[0] == 'j')
+                    fmtconv(L, &fb, spec, intmax_t, va_arg(args, intmax_t))
+                else
+                    fmtconv(L, &fb, spec, int, va_arg(args, int))
+                break;
+            }
+            case 'u': case 'o': case 'x': case 'X': {
+                if (len[0] == 'l' && len[1] == 'l')
+                    fmtconv(L, &fb, spec, unsigned long long, va_arg(args, unsigned long long))
+                else if (len[0] == 'l')
+                    fmtconv(L, &fb, spec, unsigned long, va_arg(args, unsigned long))
+                else if (len[0] == 'z' || len[0] == 't')
+                    fmtconv(L, &fb, spec, size_t, va_arg(args, size_t))
+                else if (len[0] == 'j')
+                    fmtconv(L, &fb, spec, uintmax_t, va_arg(args, uintmax_t))
+                else
+                    fmtconv(L, &fb, spec, unsigned int, va_arg(args, unsigned int))
+                break;
+            }
+            case 'f':
+                if (prec < 0) {  /* as 'tostring' */
+                    char buff[MAXNUMBER2STR];
+                    aqlO_fmtflt(buff, cast_num(va_arg(args, double)));
+                    fmtnumber(L, &fb, flags, width, buff);
+                    break;
+                }
+                /* FALLTHROUGH */
+            case 'F': case 'e': case 'E': case 'g': case 'G':
+            case 'a': case 'A': {
+                if (len[0] == 'L')
+                    fmtconv(L, &fb, spec, long double, va_arg(args, long double))
+                else
+                    fmtconv(L, &fb, spec, double, va_arg(args, double))
+                break;
+            }
+            case 'I': {  /* an 'aql_Integer' */
+                char buff[MAXNUMBER2STR];
+                aqlO_fmtint(buff, cast(aql_Integer, va_arg(args, l_uacInt)));
+                fmtnumber(L, &fb, flags, width, buff);
+                break;
+            }
+            case 'c':
+                fmtconv(L, &fb, spec, int, va_arg(args, int))
+                break;
+            case 's': {
+                const char *str = va_arg(args, const char *);
+                fmtconv(L, &fb, spec, const char *, str ? str : "(null)")
+                break;
+            }
+            case 'p':
+                fmtconv(L, &fb, spec, void *, va_arg(args, void *))
+                break;
+            case '%':
+                *fmtspace(L, &fb, 1) = '%';
+                fb.n++;
+                break;
+            default:  /* unknown conversion: copy it as is */
+                lf = cast_sizet(fmt - e) + (*fmt != '\0');
+                memcpy(fmtspace(L, &fb, lf), e, lf);
+                fb.n += lf;
+                if (*fmt == '\0')
+                    fmt--;
+                break;
+        }
+        fmt++;
+    }
+    fmtconv(L, &fb, "%s", const char *, fmt)
+    ts = aqlStr_newlstr(L, fb.b, fb.n);
+    if (fb.b != fb.init)
+        aqlM_freemem(L, fb.b, fb.size);
+    return ts;
 }
 
 /* ============================================================================
  * 字符串搜索和匹配
  * ============================================================================ */
 
+/*
+** Substring search engine. With SSE2, 16 candidate positions are tested
+** at once by comparing the pattern's first and last bytes against the
+** haystack; only positions where both match are checked with memcmp.
+** Without SSE2, a Boyer-Moore-Horspool scan is used.
+*/
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+#if defined(__GNUC__)
+#define firstbit(m)	__builtin_ctz(m)
+#else
+static l_inline int firstbit(unsigned m) {
+    int n = 0;
+    while (!(m & 1u)) { m >>= 1; n++; }
+    return n;
+}
+#endif
+
+static const char *pairsearch(const char *s, size_t l, const char *p, size_t lp) {
+    const __m128i first = _mm_set1_epi8(p[0]);
+    const __m128i last = _mm_set1_epi8(p[lp - 1]);
+    size_t i = 0;
+    for (; i + lp - 1 + 16 <= l; i += 16) {
+        __m128i bf = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i bl = _mm_loadu_si128((const __m128i *)(s + i + lp - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+        while (mask) {
+            size_t pos = i + firstbit(mask);
+            if (memcmp(s + pos + 1, p + 1, lp - 2) == 0)
+                return s + pos;
+            mask &= mask - 1;
+        }
+    }
+    for (; i + lp <= l; i++) {  /* tail shorter than a block */
+        if (s[i] == p[0] && s[i + lp - 1] == p[lp - 1] &&
+            memcmp(s + i + 1, p + 1, lp - 2) == 0)
+            return s + i;
+    }
+    return NULL;
+}
+#else
+static const char *pairsearch(const char *s, size_t l, const char *p, size_t lp) {
+    size_t skip[UCHAR_MAX + 1];
+    size_t i, last = lp - 1;
+    for (i = 0; i <= UCHAR_MAX; i++) skip[i] = lp;
+    for (i = 0; i < last; i++) skip[cast_uchar(p[i])] = last - i;
+    for (i = 0; i + lp <= l; i += skip[cast_uchar(s[i + last])]) {
+        if (s[i + last] == p[last] && memcmp(s + i, p, last) == 0)
+            return s + i;
+    }
+    return NULL;
+}
+#endif
+
+/*
+** Find the first occurrence of 'p' (length 'lp') in 's' (length 'l');
+** returns a pointer to it or NULL
+*/
+const char *aqlStr_search(const char *s, size_t l, const char *p, size_t lp) {
+    if (lp == 0) return s;
+    if (lp > l) return NULL;
+    if (lp == 1) return (const char *)memchr(s, cast_uchar(p[0]), l);
+    return pairsearch(s, l, p, lp);
+}
+
 /*
 ** 在字符串中查找子串 (返回位置，-1表示未找到)
 */
 int aqlStr_find(TString *str, TString *pattern, size_t start) {
     size_t str_len = tsslen(str);
-    size_t pat_len = tsslen(pattern);
     const char *str_data = getstr(str);
-    const char *pat_data = getstr(pattern);
+    const char *found;
     
     if (start >= str_len) return -1;
-    if (pat_len == 0) return (int)start;
-    if (pat_len > str_len - start) return -1;
-    
-    /* 简单的暴力搜索算法 */
-    for (size_t i = start; i <= str_len - pat_len; i++) {
-        if (memcmp(str_data + i, pat_data, pat_len) == 0) {
-            return (int)i;
-        }
-    }
-    
-    return -1;
+    found = aqlStr_search(str_data + start, str_len - start,
+                          getstr(pattern), tsslen(pattern));
+    return found ? (int)(found - str_data) : -1;
 }
 
 /*
-** 从后向前查找子串
+** 从后向前查找子串 (首尾字节过滤)
 */
 int aqlStr_findlast(TString *str, TString *pattern) {
     size_t str_len = tsslen(str);
     size_t pat_len = tsslen(pattern);
     const char *str_data = getstr(str);
     const char *pat_data = getstr(pattern);
+    size_t i;
     
     if (pat_len == 0) return (int)str_len;
     if (pat_len > str_len) return -1;
     
-    /* 从后向前搜索 */
-    for (int i = (int)(str_len - pat_len); i >= 0; i--) {
-        if (memcmp(str_data + i, pat_data, pat_len) == 0) {
-            return i;
-        }
+    for (i = str_len - pat_len + 1; i-- > 0; ) {
+        if (str_data[i] == pat_data[0] &&
+            str_data[i + pat_len - 1] == pat_data[pat_len - 1] &&
+            memcmp(str_data + i, pat_data, pat_len) == 0)
+            return (int)i;
     }
     
     return -1;
 }
 
 /*
-** 字符串替换 (count = -1 表示替换所有) - 简化实现
+** 统计不重叠出现次数 (空模式: 长度 + 1)
+*/
+size_t aqlStr_count(TString *str, TString *pattern) {
+    size_t l = tsslen(str), lp = tsslen(pattern);
+    const char *s = getstr(str), *e = s + l;
+    size_t n = 0;
+    
+    if (lp == 0) return l + 1;
+    while ((s = aqlStr_search(s, cast_sizet(e - s), getstr(pattern), lp)) != NULL) {
+        n++;
+        s += lp;
+    }
+    return n;
+}
+
+/*
+** 字符串替换 (count = -1 表示替换所有). The first pass counts matches,
+** so the result is allocated once at its exact size and filled in the
+** second pass.
 */
 TString *aqlS_replace(aql_State *L, TString *str, TString *old, TString *new, int count) {
     size_t str_len = tsslen(str);
     size_t old_len = tsslen(old);
     size_t new_len = tsslen(new);
     const char *str_data = getstr(str);
+    const char *end = str_data + str_len;
     const char *old_data = getstr(old);
-    const char *new_data = getstr(new);
+    const char *p, *m;
+    size_t n = 0, result_len;
+    char *o;
+    TString *result;
     
     if (old_len == 0) return str;  /* 无法替换空字符串 */
     
-    /* 估计结果大小并分配缓冲区 */
-    size_t max_result_len = str_len + (new_len > old_len ? (new_len - old_len) * 10 : 0);
-    char *buffer = (char *)aqlM_malloc(L, max_result_len + 1);
-    if (!buffer) aqlM_toobig(L);
+    for (p = str_data; (count < 0 || n < cast_sizet(count)) &&
+         (m = aqlStr_search(p, cast_sizet(end - p), old_data, old_len)) != NULL;
+         p = m + old_len)
+        n++;
+    if (n == 0) return str;
     
-    size_t pos = 0;
-    size_t result_pos = 0;
-    int replaced = 0;
-    
-    while (pos < str_len && (count == -1 || replaced < count)) {
-        /* 查找下一个匹配位置 */
-        int found = -1;
-        if (pos <= str_len - old_len) {
-            for (size_t i = pos; i <= str_len - old_len; i++) {
-                if (memcmp(str_data + i, old_data, old_len) == 0) {
-                    found = (int)i;
-                    break;
-                }
-            }
-        }
-        
-        if (found == -1) {
-            /* 没有找到更多匹配，复制剩余部分 */
-            size_t remaining = str_len - pos;
-            memcpy(buffer + result_pos, str_data + pos, remaining);
-            result_pos += remaining;
-            break;
-        } else {
-            /* 复制匹配前的部分 */
-            size_t before_len = found - pos;
-            memcpy(buffer + result_pos, str_data + pos, before_len);
-            result_pos += before_len;
-            
-            /* 复制替换字符串 */
-            memcpy(buffer + result_pos, new_data, new_len);
-            result_pos += new_len;
-            
-            pos = found + old_len;
-            replaced++;
-        }
+    if (new_len >= old_len) {
+        if ((new_len - old_len) > (MAX_SIZE - str_len) / n)
+            aqlM_toobig(L);
+        result_len = str_len + n * (new_len - old_len);
     }
+    else
+        result_len = str_len - n * (old_len - new_len);
     
-    /* 复制剩余部分 */
-    if (pos < str_len) {
-        size_t remaining = str_len - pos;
-        memcpy(buffer + result_pos, str_data + pos, remaining);
-        result_pos += remaining;
+    result = aqlStr_createlngstrobj(L, result_len);  /* not interned */
+    o = getstr(result);
+    for (p = str_data; n > 0; n--, p = m + old_len) {
+        m = aqlStr_search(p, cast_sizet(end - p), old_data, old_len);
+        memcpy(o, p, cast_sizet(m - p));
+        o += m - p;
+        memcpy(o, getstr(new), new_len);
+        o += new_len;
     }
-    
-    buffer[result_pos] = '\0';
-    TString *result = aqlStr_newlstr(L, buffer, result_pos);
-    aqlM_freemem(L, buffer, max_result_len + 1);
+    memcpy(o, p, cast_sizet(end - p));
     
     return result;
 }
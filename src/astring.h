@@ -31,6 +31,13 @@
 AQL_API TString *aqlStr_newlstr(aql_State *L, const char *str, size_t l);
 AQL_API TString *aqlStr_new(aql_State *L, const char *str);
 AQL_API TString *aqlStr_createlngstrobj(aql_State *L, size_t l);
+AQL_API TString *aqlStr_newlazy(aql_State *L, const char *str, size_t l);
+AQL_API TString *aqlStr_intern(aql_State *L, TString *ts);
+AQL_API TString *aqlStr_fromnumber(aql_State *L, const TValue *o);
+
+/* a short-length string created at runtime and not interned yet */
+#define aqlStr_islazy(ts) \
+  ((ts)->shrlen == 0xFF && (ts)->u.lnglen <= AQLAI_MAXSHORTLEN)
 
 /*
 ** String interning and hash table operations
@@ -56,6 +63,25 @@ AQL_API size_t aqlS_len(TString *ts);
 AQL_API TString *aqlStr_concat(aql_State *L, TString *a, TString *b);
 AQL_API TString *aqlStr_sub(aql_State *L, TString *str, size_t start, size_t end);
 
+/*
+** String builder: a mutable byte buffer that grows geometrically, so
+** appending n pieces costs O(total length) instead of O(n^2)
+*/
+struct StrBuilder {
+  CommonHeader;
+  size_t len;   /* bytes in use */
+  size_t size;  /* allocated size of 'buff' */
+  char *buff;
+};
+
+#define MINBUILDERSIZE	32
+
+AQL_API StrBuilder *aqlStr_newbuilder(aql_State *L, size_t size);
+AQL_API void aqlStr_freebuilder(aql_State *L, StrBuilder *sb);
+AQL_API void aqlStr_bappend(aql_State *L, StrBuilder *sb, const char *s, size_t l);
+AQL_API void aqlStr_bappendvalue(aql_State *L, StrBuilder *sb, const TValue *v);
+AQL_API TString *aqlStr_bbuild(aql_State *L, StrBuilder *sb);
+
 /*
 ** String formatting
 */
@@ -65,8 +91,10 @@ AQL_API TString *aqlS_formatv(aql_State *L, const char *fmt, va_list args);
 /*
 ** String searching and matching
 */
+AQL_API const char *aqlStr_search(const char *s, size_t l, const char *p, size_t lp);
 AQL_API int aqlStr_find(TString *str, TString *pattern, size_t start);
 AQL_API int aqlStr_findlast(TString *str, TString *pattern);
+AQL_API size_t aqlStr_count(TString *str, TString *pattern);
 AQL_API TString *aqlS_replace(aql_State *L, TString *str, TString *old, TString *new, int count);
 
 /*
@@ -223,11 +223,16 @@ l_sinline Node *mainpositionfromnode (const Table *t, Node *nd) {
 ** have garbage in, garbage out. What is relevant is that this false
 ** positive does not break anything.  (In particular, 'next' will return
 ** some other valid item on the table or nil.)
+** A runtime string not interned yet has the long-string variant even
+** when short, so strings of different variants are compared by content.
 */
 static int equalkey (const TValue *k1, const Node *n2, int deadok) {
   if ((rawtt(k1) != keytt(n2)) &&  /* not the same variants? */
-       !(deadok && keyisdead(n2) && iscollectable(k1)))
-   return 0;  /* cannot be same key */
+       !(deadok && keyisdead(n2) && iscollectable(k1))) {
+    if (ttisstring(k1) && novariant(keytt(n2)) == AQL_TSTRING)
+      return aqlS_eqstr(tsvalue(k1), keystrval(n2));  /* lazy vs. interned */
+    return 0;  /* cannot be same key */
+  }
   switch (keytt(n2)) {
     case AQL_VNIL: case AQL_VFALSE: case AQL_VTRUE:
       return 1;
@@ -240,7 +245,7 @@ static int equalkey (const TValue *k1, const Node *n2, int deadok) {
     case AQL_VLCF:
       return fvalue(k1) == fvalueraw(keyval(n2));
     case ctb(AQL_VLNGSTR):
-      return aqlS_eqlngstr(tsvalue(k1), keystrval(n2));
+      return aqlS_eqstr(tsvalue(k1), keystrval(n2));
     default:
       return gcvalue(k1) == gcvalueraw(keyval(n2));
   }
@@ -700,6 +705,11 @@ void aqlH_newkey (aql_State *L, Table *t, const TValue *key,
     else if (l_unlikely(aql_numisnan(f)))
       aqlG_runerror(L, "table index is NaN");
   }
+  else if (ttislngstring(key) && aqlStr_islazy(tsvalue(key))) {
+    /* keys are stored interned, so 'aqlH_getshortstr' can find them */
+    setsvalue(L, &aux, aqlStr_intern(L, tsvalue(key)));
+    key = &aux;
+  }
   if (ttisnil(value)) {
     aql_debug("[DEBUG] aqlH_newkey: 值为nil，跳过插入\n");
     return;  /* do not insert nil values */
@@ -749,7 +759,6 @@ void aqlH_newkey (aql_State *L, Table *t, const TValue *key,
   }
   aql_debug("[DEBUG] aqlH_newkey: 准备设置节点键，key类型=%d\n", ttype(key));
   setnodekey(L, mp, key);
-  gnext(mp) = 0;  /* 初始化next字段为0，表示链表末尾 */
   aql_debug("[DEBUG] aqlH_newkey: 节点键设置完成，keytt(mp)=%d, next=%d\n", keytt(mp), gnext(mp));
   aqlC_barrierback(L, obj2gco(t), key);
   aql_assert(isempty(gval(mp)));
@@ -840,7 +849,7 @@ const TValue *aqlH_getshortstr (Table *t, TString *key) {
 
 
 const TValue *aqlH_getstr (Table *t, TString *key) {
-  if (tsslen(key) <= 40)  /* Short string threshold */
+  if (key->shrlen != 0xFF)  /* interned short string? */
     return aqlH_getshortstr(t, key);
   else {  /* for long strings, use generic case */
     TValue ko;
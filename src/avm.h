@@ -263,6 +263,7 @@ AQL_API void aqlV_finishset(aql_State *L, const TValue *t, TValue *key,
 AQL_API int aqlV_execute(aql_State *L, CallInfo *ci);
 AQL_API void aqlV_finishOp(aql_State *L);
 AQL_API void aqlV_concat(aql_State *L, int total);
+AQL_API void aqlV_objlen(aql_State *L, StkId ra, const TValue *rb);
 AQL_API aql_Integer aqlV_idiv(aql_State *L, aql_Integer m, aql_Integer n);
 AQL_API aql_Integer aqlV_mod(aql_State *L, aql_Integer m, aql_Integer n);
 AQL_API aql_Number aqlV_modf(aql_State *L, aql_Number m, aql_Number n);
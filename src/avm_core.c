@@ -19,6 +19,7 @@
 #include "aopcodes.h"
 #include "avm.h"
 
+#include "abuiltin.h"
 #include "acontainer.h"
 #include "adatatype.h"
 #include "adebug.h"
@@ -30,6 +31,7 @@
 #include "arange.h"
 #include "astring.h"
 #include "aobject.h"
+#include "azio.h"
 
 extern Dict *get_globals_dict(aql_State *L);
 
@@ -143,7 +145,7 @@ static const char *get_function_name(LClosure *cl) {
 
 /* 字符串函数映射 */
 #define aqlS_newlstr    aqlStr_newlstr
-#define aqlS_createlngstrobj(L,l) aqlStr_newlstr(L, NULL, l)
+#define aqlS_createlngstrobj(L,l) aqlStr_createlngstrobj(L, l)
 
 /* aql 数值比较宏 */
 #define aqli_numlt(a,b)     ((a) < (b))
@@ -184,13 +186,36 @@ static const TValue aqlO_nilobject_ = {{NULL}, AQL_VNIL};
   checkliveness(L,io); } while(0)
 #define aqlC_barrier    aqlC_barrier_
 #define aql_threadyield(L) ((void)0)  /* 空操作 */
-#define aqlT_adjustvarargs(L,nfixparams,ci,p) ((void)0)  /* 空操作 */
+
+/*
+** Prepare the frame of a vararg function (OP_VARARGPREP): the function
+** and its fixed parameters are copied above the actual arguments, so the
+** extra arguments stay below the new frame, out of reach of its
+** registers and of the frames it calls. OP_RETURN/OP_TAILCALL undo the
+** shift through their C operand (see 'aqlK_finish').
+*/
+static void aqlT_adjustvarargs (aql_State *L, int nfixparams, CallInfo *ci,
+                                const Proto *p) {
+  int i;
+  int actual = cast_int(L->top.p - ci->func.p) - 1;  /* number of arguments */
+  int nextra = actual - nfixparams;  /* number of extra arguments */
+  ci->u.l.nextraargs = nextra;
+  aqlD_checkstack(L, p->maxstacksize + 1);
+  /* copy function to the top of the stack */
+  setobjs2s(L, L->top.p++, ci->func.p);
+  /* move fixed parameters to the top of the stack */
+  for (i = 1; i <= nfixparams; i++) {
+    setobjs2s(L, L->top.p++, ci->func.p + i);
+    setnilvalue(s2v(ci->func.p + i));  /* erase original parameter (for GC) */
+  }
+  ci->func.p += actual + 1;
+  ci->top.p += actual + 1;
+  aql_assert(L->top.p <= ci->top.p && ci->top.p <= L->stack_last.p);
+}
 
 static void aqlT_getvarargs (aql_State *L, CallInfo *ci, StkId ra, int n) {
-  LClosure *cl = clLvalue(s2v(ci->func.p));
-  Proto *p = cl->p;
   int nextra = ci->u.l.nextraargs;
-  StkId vararg = ci->func.p + 1 + p->numparams;
+  StkId vararg = ci->func.p - nextra;  /* extra arguments sit below 'func' */
 
   if (n == 1) {
     AQL_ContainerBase *args = acontainer_new(L, CONTAINER_ARRAY,
@@ -205,8 +230,16 @@ static void aqlT_getvarargs (aql_State *L, CallInfo *ci, StkId ra, int n) {
     return;
   }
 
-  if (n < 0)
+  if (n < 0) {  /* get all extra arguments available */
     n = nextra;
+    L->top.p = ra;
+    if (l_unlikely(L->stack_last.p - ra <= nextra)) {
+      ptrdiff_t t = savestack(L, ra);
+      aqlD_growstack(L, nextra, 1);
+      ra = restorestack(L, t);
+      vararg = ci->func.p - nextra;
+    }
+  }
   for (int i = 0; i < n; i++) {
     if (i < nextra) {
       setobjs2s(L, ra + i, vararg + i);
@@ -658,6 +691,8 @@ int aqlV_lessequal (aql_State *L, const TValue *l, const TValue *r) {
 int aqlV_equalobj (aql_State *L, const TValue *t1, const TValue *t2) {
   const TValue *tm;
   if (ttypetag(t1) != ttypetag(t2)) {  /* not the same variant? */
+    if (ttisstring(t1) && ttisstring(t2))  /* interned vs. lazy string */
+      return aqlS_eqstr(tsvalue(t1), tsvalue(t2));
     if (ttype(t1) != ttype(t2) || ttype(t1) != AQL_TNUMBER)
       return 0;  /* only numbers can be equal with different variants */
     else {  /* two numbers with different variants */
@@ -711,22 +746,18 @@ int aqlV_equalobj (aql_State *L, const TValue *t1, const TValue *t2) {
 static int value_to_string_value(aql_State *L, const TValue *src, TValue *dst) {
   if (ttisstring(src)) {
     setobj(L, dst, src);
-  } else if (ttisinteger(src)) {
-    char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%lld", (long long)ivalue(src));
-    setsvalue(L, dst, aqlStr_new(L, buffer));
-  } else if (ttisfloat(src)) {
-    char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%.14g", fltvalue(src));
-    setsvalue(L, dst, aqlStr_new(L, buffer));
+  } else if (ttisnumber(src)) {
+    setsvalue(L, dst, aqlStr_fromnumber(L, src));
   } else if (ttisboolean(src)) {
     setsvalue(L, dst, aqlStr_new(L, bvalue(src) ? "true" : "false"));
   } else if (ttisnil(src)) {
     setsvalue(L, dst, aqlStr_new(L, "nil"));
+  } else if (ttisbuilder(src)) {  /* current contents of the builder */
+    setsvalue(L, dst, aqlStr_bbuild(L, buildervalue(src)));
   } else {
     char buffer[32];
     snprintf(buffer, sizeof(buffer), "(type %d)", ttype(src));
-    setsvalue(L, dst, aqlStr_new(L, buffer));
+    setsvalue(L, dst, aqlStr_newlazy(L, buffer, strlen(buffer)));
   }
   return ttisstring(dst);
 }
@@ -751,6 +782,13 @@ static void copy2buff (aql_State *L, StkId top, int n, char *buff) {
 void aqlV_concat (aql_State *L, int total) {
   if (total == 1)
     return;  /* "concatenation" of one string is itself */
+  {  /* builders take part with their current contents */
+    StkId p;
+    for (p = L->top.p - total; p < L->top.p; p++) {
+      if (ttisbuilder(s2v(p)))
+        setsvalue2s(L, p, aqlStr_bbuild(L, buildervalue(s2v(p))));
+    }
+  }
   do {
     StkId top = L->top.p;
     int n = 2;  /* number of elements handled in this pass (at least 2) */
@@ -773,15 +811,9 @@ void aqlV_concat (aql_State *L, int total) {
           aqlG_runerror(L, "string length overflow");
         tl += l;
       }
-      if (tl <= aqlI_MAXSHORTLEN) {  /* is result a short string? */
-        char buff[aqlI_MAXSHORTLEN];
-        copy2buff(L, top, n, buff);
-        ts = aqlS_newlstr(L, buff, tl);
-      }
-      else {  /* long string; copy strings directly to final result */
-        ts = aqlS_createlngstrobj(L, tl);
-        copy2buff(L, top, n, getstr(ts));
-      }
+      /* copy strings directly to the (not interned) result */
+      ts = aqlS_createlngstrobj(L, tl);
+      copy2buff(L, top, n, getstr(ts));
       setsvalue2s(L, top - n, ts);  /* create result */
     }
     total -= n-1;  /* got 'n' strings to create 1 new */
@@ -815,6 +847,14 @@ void aqlV_objlen (aql_State *L, StkId ra, const TValue *rb) {
       setivalue(s2v(ra), tsvalue(rb)->u.lnglen);
       return;
     }
+    case AQL_VBUILDER: {
+      setivalue(s2v(ra), l_castU2S(buildervalue(rb)->len));
+      return;
+    }
+    case AQL_VRANGE: {
+      setivalue(s2v(ra), rangevalue(rb)->count);
+      return;
+    }
     default: {  /* try metamethod */
       tm = aqlT_gettmbyobj(L, rb, TM_LEN);
       if (l_unlikely(notm(tm)))  /* no metamethod? */
@@ -986,21 +1026,31 @@ void aqlV_objlen (aql_State *L, StkId ra, const TValue *rb) {
 /*
 ** 闭包和表操作函数
 */
-static void pushclosure (aql_State *L, Proto *p, UpVal **encup, StkId base,
+static void pushclosure (aql_State *L, Proto *p, LClosure *encl, StkId base,
                          StkId ra) {
   int nup = p->sizeupvalues;
   Upvaldesc *uv = p->upvalues;
   int i;
   aql_debug("[DEBUG] pushclosure: nup=%d, base=%p, ra=%p\n", nup, (void*)base, (void*)ra);
-  LClosure *ncl = aqlF_newLclosure(L, nup);
+  LClosure *ncl = p->flatupvals ? aqlF_newLclosureflat(L, nup)
+                                : aqlF_newLclosure(L, nup);
   ncl->p = p;
   setclLvalue2s(L, ra, ncl);  /* anchor new closure in stack */
   for (i = 0; i < nup; i++) {  /* fill in its upvalues */
     aql_debug("[DEBUG] pushclosure: upvalue[%d] instack=%d, idx=%d\n", i, uv[i].instack, uv[i].idx);
+    if (uv[i].flat) {  /* never reassigned: copy the value, no UpVal box */
+      if (uv[i].instack) {
+        setobj(L, &clLflat(ncl)[i], s2v(base + uv[i].idx));
+      }
+      else {  /* enclosing upvalue is flat too */
+        setobj(L, &clLflat(ncl)[i], &clLflat(encl)[uv[i].idx]);
+      }
+      continue;
+    }
     if (uv[i].instack)  /* upvalue refers to local variable? */
       ncl->upvals[i] = aqlF_findupval(L, base + uv[i].idx);
     else  /* get upvalue from enclosing function */
-      ncl->upvals[i] = encup[uv[i].idx];
+      ncl->upvals[i] = encl->upvals[uv[i].idx];
     aqlC_barrier(L, obj2gco(ncl), obj2gco(ncl->upvals[i]));
   }
 }
@@ -1182,6 +1232,18 @@ void aqlV_finishset (aql_State *L, const TValue *t, TValue *key,
   aqlG_runerror(L, "'__newindex' chain too long; possible loop");
 }
 
+/*
+** Inline cache of the OP_GETPROP instruction just fetched ('pc' points
+** to the next one); the cache array is allocated on first use
+*/
+static PropCache *getpropcache (aql_State *L, Proto *p, const Instruction *pc) {
+  if (p->propcache == NULL) {
+    p->propcache = aqlM_newvector(L, p->sizecode, PropCache);
+    memset(p->propcache, 0, p->sizecode * sizeof(PropCache));
+  }
+  return &p->propcache[pc - p->code - 1];
+}
+
 /*
 ** 新一代 VM 执行函数 - 与 Lua lvm.c 的 luaV_execute 保持一致
 ** 未来将替代 avm.c 中的 aqlV_execute
@@ -1348,6 +1410,23 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         setbuiltinvalue(s2v(ra), builtin_id);
         vmbreak;
       }
+
+      vmcase(OP_CALLBUILTIN) {
+        /* R[A] := builtin[C](R[A+1], ... ,R[A+B]); no frame, one result */
+        int nargs = GETARG_B(i);
+        int id = GETARG_C(i);
+        const Builtin *bf;
+        if (l_unlikely(id >= G(L)->nbuiltins))
+          Protect(aqlG_runerror(L, "unknown builtin function #%d", id));
+        bf = aqlB_get(L, id);
+        if (l_unlikely(!aqlB_checkarity(bf, nargs)))
+          Protect(aqlB_arityerror(L, bf, nargs));
+        if (l_likely(bf->fn != NULL))
+          Protect(bf->fn(L, ra, nargs));
+        else  /* host builtin: may reallocate the stack */
+          Protect(aqlB_callhost(L, bf, ra, nargs));
+        vmbreak;
+      }
       
       vmcase(OP_GETUPVAL) {
         int b = GETARG_B(i);
@@ -1376,6 +1455,12 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         vmbreak;
       }
       
+      vmcase(OP_GETFLATUP) {
+        /* 按值捕获的 upvalue：直接读取闭包内的平坦槽位，无需经过 UpVal */
+        setobj2s(L, ra, &clLflat(cl)[GETARG_B(i)]);
+        vmbreak;
+      }
+      
       vmcase(OP_SETUPVAL) {
         int b = GETARG_B(i);
         DEBUG_SETUPVAL(L, ci, i, pc, cl, base, func_name);
@@ -1492,27 +1577,25 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         const TValue *slot;
         TValue *rb = vRB(i);
         TValue *rc = vRC(i);
-        aql_Unsigned n;
-        
-        aql_debug("GETTABLE: A=%d, B=%d, C=%d", GETARG_A(i), GETARG_B(i), GETARG_C(i));
-        aql_debug("GETTABLE: table类型=%d, key类型=%d", ttype(rb), ttype(rc));
-        
-        if (!ttistable(rb)) {
-          aql_error("GETTABLE: table不是表类型 - 实际类型=%d", ttype(rb));
-          setnilvalue(s2v(ra));
-          vmbreak;
-        }
-        
-        if (ttisinteger(rc)
-            ? (cast_void(n = ivalue(rc)), aqlV_fastgeti(L, rb, n, slot))
-            : aqlV_fastget(L, rb, rc, slot, aqlH_get)) {
-          setobj2s(L, ra, slot);
-          aql_debug("GETTABLE: 快速查找成功，结果类型=%d", ttype(s2v(ra)));
+        if (l_likely(ttistable(rb))) {
+          Table *h = hvalue(rb);
+          if (ttisinteger(rc)) {
+            aql_Integer n = ivalue(rc);
+            slot = (l_castS2U(n) - 1u < h->alimit)  /* array part? */
+                   ? &h->array[n - 1]
+                   : aqlH_getint(h, n);
+          }
+          else
+            slot = aqlH_get(h, rc);
+          if (!isempty(slot)) {
+            setobj2s(L, ra, slot);
+          }
+          else
+            Protect(aqlV_finishget(L, rb, rc, ra, slot));
         }
         else {
-          aql_debug("GETTABLE: 使用完整查找");
-          Protect(aqlV_finishget(L, rb, rc, ra, slot));
-          aql_debug("GETTABLE: 完整查找完成，结果类型=%d", ttype(s2v(ra)));
+          aql_error("GETTABLE: table不是表类型 - 实际类型=%d", ttype(rb));
+          setnilvalue(s2v(ra));
         }
         vmbreak;
       }
@@ -1616,27 +1699,24 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         const TValue *slot;
         TValue *rb = vRB(i);  /* key (table is in 'ra') */
         TValue *rc = RKC(i);  /* value */
-        aql_Unsigned n;
-        
-        aql_debug("SETTABLE: A=%d, B=%d, C=%d", GETARG_A(i), GETARG_B(i), GETARG_C(i));
-        aql_debug("SETTABLE: table类型=%d, key类型=%d, value类型=%d", ttype(s2v(ra)), ttype(rb), ttype(rc));
-        
-        if (!ttistable(s2v(ra))) {
-          aql_error("SETTABLE: table不是表类型 - 实际类型=%d", ttype(s2v(ra)));
-          vmbreak;
-        }
-        
-        if (ttisinteger(rb)
-            ? (cast_void(n = ivalue(rb)), aqlV_fastgeti(L, s2v(ra), n, slot))
-            : aqlV_fastget(L, s2v(ra), rb, slot, aqlH_get)) {
-          aql_debug("SETTABLE: 快速设置");
-          aqlV_finishfastset(L, s2v(ra), slot, rc);
-        }
-        else {
-          aql_debug("SETTABLE: 使用完整设置");
-          Protect(aqlV_finishset(L, s2v(ra), rb, rc, slot));
+        if (l_likely(ttistable(s2v(ra)))) {
+          Table *h = hvalue(s2v(ra));
+          if (ttisinteger(rb)) {
+            aql_Integer n = ivalue(rb);
+            slot = (l_castS2U(n) - 1u < h->alimit)  /* array part? */
+                   ? &h->array[n - 1]
+                   : aqlH_getint(h, n);
+          }
+          else
+            slot = aqlH_get(h, rb);
+          if (!isempty(slot)) {
+            aqlV_finishfastset(L, s2v(ra), slot, rc);
+          }
+          else
+            Protect(aqlV_finishset(L, s2v(ra), rb, rc, slot));
         }
-        aql_debug("SETTABLE: 设置完成");
+        else
+          aql_error("SETTABLE: table不是表类型 - 实际类型=%d", ttype(s2v(ra)));
         vmbreak;
       }
       
@@ -1719,187 +1799,28 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         int b = GETARG_B(i);
         int nargs = b - 1;
         int nresults = GETARG_C(i) - 1;
-        aql_debug("🔍 [CALL] 开始执行: func=%p, nargs=%d, nresults=%d\n", (void*)func, nargs, nresults);
-        
+        CallInfo *newci;
         if (b != 0)
           L->top.p = func + b;
         else
           nargs = cast_int(L->top.p - func - 1);
-        
-        // 检查是否是有效的函数对象
-        TValue *f = s2v(func);
-        aql_debug("🔍 [CALL] 检查函数对象: f=%p, type=%d\n", (void*)f, ttype(f));
-
-        if (ttisbuiltin(f)) {
-          int builtin_id = builtinvalue(f);
-          int nparams = nargs;
-          StkId args_base = func + 1;
-
-          aql_debug("🔍 [CALL] builtin function: id=%d, nparams=%d\n", builtin_id, nparams);
-
-          switch (builtin_id) {
-            case 0: {  /* print */
-              for (int j = 0; j < nparams; j++) {
-                TValue *arg = s2v(args_base + j);
-
-                if (j > 0)
-                  printf("\t");
-
-                if (ttisstring(arg)) {
-                  printf("%s", getstr(tsvalue(arg)));
-                } else if (ttisinteger(arg)) {
-                  printf("%lld", (long long)ivalue(arg));
-                } else if (ttisfloat(arg)) {
-                  printf("%.14g", fltvalue(arg));
-                } else if (ttisboolean(arg)) {
-                  printf("%s", bvalue(arg) ? "true" : "false");
-                } else if (ttisnil(arg)) {
-                  printf("nil");
-                } else if (ttisrange(arg)) {
-                  RangeObject *range = rangevalue(arg);
-                  printf("range(%lld, %lld, %lld)",
-                         (long long)range->start,
-                         (long long)range->stop,
-                         (long long)range->step);
-                } else {
-                  printf("(unknown type %d)", ttype(arg));
-                }
-              }
-              if (nparams > 0)
-                printf("\n");
-              setnilvalue(s2v(func));
-              break;
-            }
-            case 2: {  /* len */
-              if (nparams != 1) {
-                setnilvalue(s2v(func));
-                break;
-              }
-              aqlV_objlen(L, func, s2v(args_base));
-              break;
-            }
-            case 3: {  /* string/tostring */
-              if (nparams != 1) {
-                setnilvalue(s2v(func));
-                break;
-              }
-
-              TValue *arg = s2v(args_base);
-              TValue *result = s2v(func);
-
-              if (ttisstring(arg)) {
-                setobj(L, result, arg);
-              } else if (ttisinteger(arg)) {
-                char buffer[32];
-                snprintf(buffer, sizeof(buffer), "%lld", (long long)ivalue(arg));
-                setsvalue(L, result, aqlStr_new(L, buffer));
-              } else if (ttisfloat(arg)) {
-                char buffer[32];
-                snprintf(buffer, sizeof(buffer), "%.14g", fltvalue(arg));
-                setsvalue(L, result, aqlStr_new(L, buffer));
-              } else if (ttisboolean(arg)) {
-                setsvalue(L, result, aqlStr_new(L, bvalue(arg) ? "true" : "false"));
-              } else if (ttisnil(arg)) {
-                setsvalue(L, result, aqlStr_new(L, "nil"));
-              } else {
-                char buffer[32];
-                snprintf(buffer, sizeof(buffer), "(type %d)", ttype(arg));
-                setsvalue(L, result, aqlStr_new(L, buffer));
-              }
-              break;
-            }
-            case 5: {  /* range */
-              aql_Integer start = 0;
-              aql_Integer stop = 0;
-              aql_Integer step = 1;
-              RangeObject *range;
-
-              if (nparams < 1 || nparams > 3) {
-                setnilvalue(s2v(func));
-                break;
-              }
-
-              if (nparams == 1) {
-                TValue *arg = s2v(args_base);
-                if (!ttisinteger(arg)) {
-                  setnilvalue(s2v(func));
-                  break;
-                }
-                stop = ivalue(arg);
-              } else if (nparams == 2) {
-                TValue *arg1 = s2v(args_base);
-                TValue *arg2 = s2v(args_base + 1);
-                if (!ttisinteger(arg1) || !ttisinteger(arg2)) {
-                  setnilvalue(s2v(func));
-                  break;
-                }
-                start = ivalue(arg1);
-                stop = ivalue(arg2);
-                step = aqlR_infer_step(start, stop);
-              } else {
-                TValue *arg1 = s2v(args_base);
-                TValue *arg2 = s2v(args_base + 1);
-                TValue *arg3 = s2v(args_base + 2);
-                if (!ttisinteger(arg1) || !ttisinteger(arg2) || !ttisinteger(arg3)) {
-                  setnilvalue(s2v(func));
-                  break;
-                }
-                start = ivalue(arg1);
-                stop = ivalue(arg2);
-                step = ivalue(arg3);
-              }
-
-              range = aqlR_new(L, start, stop, step);
-              if (range == NULL) {
-                setnilvalue(s2v(func));
-              } else {
-                setrangevalue(L, s2v(func), range);
-              }
-              break;
-            }
-            default:
-              setnilvalue(s2v(func));
-              break;
-          }
-
-          if (nresults >= 0)
-            L->top.p = ci->top.p;
-          vmbreak;
-        }
-
-        if (!ttisLclosure(f) && !ttisCclosure(f)) {
-          // 不是函数对象，跳过CALL并继续执行
-          aql_debug("⚠️  [CALL] R%d不是函数对象，跳过调用\n", GETARG_A(i));
-          /* 跟踪模式：显示指令执行后的状态（跳过情况） */
-          if (func_name) {
-            /* print_instruction_trace(L, ci, i, pc, cl, base, func_name, 0);  // AFTER */
-          }
+        if (ttisbuiltin(s2v(func))) {  /* builtin loaded as a value (OP_LOADBUILTIN) */
+          Protect(aqlB_call(L, func, cast_int(builtinvalue(s2v(func))), nargs));
           vmbreak;
         }
-        
-        aql_debug("🔍 [CALL] 函数对象有效，准备调用 aqlD_precall\n");
-        
-        CallInfo *new_ci = aqlD_precall(L, func, nresults);
-        aql_debug("🔍 [CALL] aqlD_precall 返回: new_ci=%p\n", (void*)new_ci);
-        
-        if (new_ci) {  /* AQL function? */
-          aql_debug("🔍 [CALL] 准备调用 AQL 函数，跳转到 newframe\n");
+        if (l_unlikely(!ttisLclosure(s2v(func)) && !ttisCclosure(s2v(func))))
+          vmbreak;  /* not a function: the call is skipped */
+        savepc(L);  /* in case of errors */
+        if ((newci = aqlD_precall(L, func, nresults)) == NULL)
+          updatetrap(ci);  /* C call; nothing else to be done */
+        else {
           if (aql_debug_is_enabled(AQL_FLAG_VT)) {
             aql_info_vt("------------------------------------------------\n");
             aql_info_vt("args=%d, rets=%d\t\n", nargs, nresults);
           }
-          ci = L->ci;
-          aql_debug("🔍 [CALL] 设置 ci=%p，跳转到 newframe\n", (void*)ci);
+          ci = newci;
           goto newframe;  /* restart aqlV_execute over new aql function */
-        } else {  /* C function */
-          aql_debug("🔍 [CALL] 调用 C 函数，已完成\n");
-          updatetrap(ci);  /* C function already completed */
         }
-        
-        /* 跟踪模式：显示指令执行后的状态 - 暂时禁用避免段错误 */
-        /* if (func_name) {
-          print_instruction_trace(L, ci, i, pc, cl, base, func_name, 0);  // AFTER
-        } */
         vmbreak;
       }
       
@@ -1927,9 +1848,21 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
           aql_debug("TAILCALL: 关闭upvalues (k=1)");
         }
         
-        aql_debug("TAILCALL: 调用aqlD_pretailcall");
-        n = aqlD_pretailcall(L, ci, ra, b, delta);
-        aql_debug("TAILCALL: aqlD_pretailcall返回, n=%d", n);
+        if (ttisbuiltin(s2v(ra))) {  /* builtin value: one result in 'ra' */
+          Protect(aqlB_call(L, ra, cast_int(builtinvalue(s2v(ra))), b - 1));
+          updatestack(ci);
+          L->top.p = ra + 1;
+          n = 1;
+        }
+        else if (l_unlikely(!ttisclosure(s2v(ra)))) {  /* as in OP_CALL */
+          L->top.p = ra + 1;
+          n = 1;
+        }
+        else {
+          aql_debug("TAILCALL: 调用aqlD_pretailcall");
+          n = aqlD_pretailcall(L, ci, ra, b, delta);
+          aql_debug("TAILCALL: aqlD_pretailcall返回, n=%d", n);
+        }
         
         if (n < 0) {  /* Lua function */
           goto newframe;  /* execute callee in reused frame */
@@ -1937,11 +1870,10 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
           ci->func.p -= delta;  /* restore 'func' (if vararg) */
           (void)aqlD_poscall(L, ci, n);  /* finish caller */
           updatetrap(ci);
-          if (L->ci != NULL && L->ci != &L->base_ci) {
-            ci = L->ci;
-            goto newframe;
-          }
-          return;
+          if (ci->callstatus & CIST_FRESH)  /* end this 'aqlV_execute'? */
+            return;
+          ci = L->ci;
+          goto newframe;
         }
         vmbreak;
       }
@@ -1970,16 +1902,17 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
           aql_debug("🔍 [RETURN] 没有k位，不关闭upvalues\n");
         }
         
+        if (nparams1)  /* vararg function? */
+          ci->func.p -= ci->u.l.nextraargs + nparams1;
         if (l_unlikely(L->hookmask)) {
           aql_debug("🔍 [RETURN] 使用 hook 模式处理返回值\n");
-          if (nparams1)  /* vararg function? */
-            ci->func.p -= ci->u.l.nextraargs + nparams1;
           L->top.p = ra + n;  /* set call for 'aqlD_poscall' */
           aqlD_poscall(L, ci, n);
           updatetrap(ci);
         }
         else {  /* do the 'poscall' here */
           int nres = ci->nresults;
+          StkId res = ci->func.p;  /* 结果写回原函数槽位 */
           aql_debug("🔍 [RETURN] 直接处理返回值: ci->nresults=%d\n", nres);
           aql_debug("🔍 [RETURN] 检查调用者 - L->ci=%p, ci=%p\n", (void*)L->ci, (void*)ci);
           L->ci = ci->previous;  /* back to caller */
@@ -1987,57 +1920,37 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
           
           if (nres == 0) {
             aql_debug("🔍 [RETURN] 不需要返回值，设置 top=base-1\n");
-            L->top.p = base - 1;  /* asked for no results */
+            L->top.p = res;  /* asked for no results */
           }
           else if (nres < 0) {
             aql_debug("🔍 [RETURN] 要所有结果，复制%d个返回值\n", n);
             /* 要所有结果 - 复制所有n个返回值 */
             for (int i = 0; i < n; i++) {
-              setobjs2s(L, base - 1 + i, ra + i);
+              setobjs2s(L, res + i, ra + i);
               aql_debug("🔍 [RETURN] 复制返回值[%d]到base-%d\n", i, 1-i);
             }
-            L->top.p = base - 1 + n;  /* top points after all results */
+            L->top.p = res + n;  /* top points after all results */
           }
           else {
             aql_debug("🔍 [RETURN] 固定数量的结果: 复制最多%d个值\n", nres);
             /* 固定数量的结果 - 复制最多nres个值 */
             int copy_count = (n < nres) ? n : nres;
             for (int i = 0; i < copy_count; i++) {
-              setobjs2s(L, base - 1 + i, ra + i);
+              setobjs2s(L, res + i, ra + i);
               aql_debug("🔍 [RETURN] 复制返回值[%d]到base-%d\n", i, 1-i);
             }
             /* 如果需要更多结果，用nil填充 */
             for (int i = copy_count; i < nres; i++) {
-              setnilvalue(s2v(base - 1 + i));
+              setnilvalue(s2v(res + i));
             }
-            L->top.p = base - 1 + nres;
+            L->top.p = res + nres;
           }
         }
         
-        /* 检查是否需要回到调用者 */
-        aql_debug("🔍 [RETURN] 检查调用者 - L->ci=%p, ci=%p\n", (void*)L->ci, (void*)ci);
-        if (L->ci != ci && L->ci != NULL && L->ci != &L->base_ci) {
-          /* 已经回到调用者，更新ci并重新初始化执行上下文 */
-          CallInfo *new_ci = L->ci;
-          aql_debug("🔍 [RETURN] 回到调用者，新的ci=%p\n", (void*)new_ci);
-          
-          /* 验证新的CallInfo是否有效 */
-          if (new_ci == NULL || new_ci->func.p == NULL) {
-            aql_debug("🔍 [RETURN] 错误 - 无效的CallInfo，退出VM\n");
-            return;
-          }
-          
-          ci = new_ci;  /* 更新ci为当前的CallInfo */
-          aql_debug("🔍 [RETURN] 更新ci=%p，跳转到 newframe\n", (void*)ci);
-          goto newframe;  /* restart aqlV_execute over caller function */
-        }
-        else {
-          /* 这是顶层函数的返回，退出VM */
-          aql_debug("🔍 [RETURN] 顶层函数返回，退出VM\n");
+        if (ci->callstatus & CIST_FRESH)  /* end this 'aqlV_execute'? */
           return;
-        }
-        
-        aql_debug("🔍 [RETURN] RETURN 指令执行完成\n");
+        ci = L->ci;
+        goto newframe;  /* restart aqlV_execute over caller function */
       }
       
       vmcase(OP_RETURN0) {
@@ -2060,27 +1973,10 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         aql_info_vt("  Return: (no return value)");
         aql_info_vt("\n");
         
-        /* 检查是否需要回到调用者 */
-        aql_debug("RETURN0: 检查调用者 - L->ci=%p, ci=%p", (void*)L->ci, (void*)ci);
-        if (L->ci != ci && L->ci != NULL && L->ci != &L->base_ci) {
-          /* 已经回到调用者，更新ci并重新初始化执行上下文 */
-          CallInfo *new_ci = L->ci;
-          aql_debug("RETURN0: 回到调用者，新的ci=%p", (void*)new_ci);
-          
-          /* 验证新的CallInfo是否有效 */
-          if (new_ci == NULL || new_ci->func.p == NULL) {
-            aql_debug("RETURN0: 错误 - 无效的CallInfo，退出VM");
-            return;
-          }
-          
-          ci = new_ci;  /* 更新ci为当前的CallInfo */
-          goto newframe;  /* restart aqlV_execute over caller function */
-        }
-        else {
-          /* 这是顶层函数的返回，退出VM */
-          aql_debug("RETURN0: 顶层函数返回，退出VM");
+        if (ci->callstatus & CIST_FRESH)  /* end this 'aqlV_execute'? */
           return;
-        }
+        ci = L->ci;
+        goto newframe;  /* restart aqlV_execute over caller function */
       }
       
       vmcase(OP_RETURN1) {
@@ -2132,28 +2028,10 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         }
         aql_info_vt("\n");
         
-        /* 检查是否需要回到调用者 */
-        aql_debug("RETURN1: 检查调用者 - L->ci=%p, ci=%p, ci->previous=%p", 
-                 (void*)L->ci, (void*)ci, (void*)ci->previous);
-        if (L->ci != ci && L->ci != NULL && L->ci != &L->base_ci) {
-          /* 已经回到调用者，更新ci并重新初始化执行上下文 */
-          CallInfo *new_ci = L->ci;
-          aql_debug("RETURN1: 回到调用者，新的ci=%p", (void*)new_ci);
-          
-          /* 验证新的CallInfo是否有效 */
-          if (new_ci == NULL || new_ci->func.p == NULL) {
-            aql_debug("RETURN1: 错误 - 无效的CallInfo，退出VM");
-            return;
-          }
-          
-          ci = new_ci;  /* 更新ci为当前的CallInfo */
-          goto newframe;  /* restart aqlV_execute over caller function */
-        }
-        else {
-          /* 这是顶层函数的返回，退出VM */
-          aql_debug("RETURN1: 顶层函数返回，退出VM");
+        if (ci->callstatus & CIST_FRESH)  /* end this 'aqlV_execute'? */
           return;
-        }
+        ci = L->ci;
+        goto newframe;  /* restart aqlV_execute over caller function */
       }
       
       vmcase(OP_FORLOOP) {
@@ -2199,6 +2077,18 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
            to-be-closed variable. The call will use the stack after
            these values (starting at 'ra + 4')
         */
+        if (ttisthread(s2v(ra))) {  /* generator: next value is a resume */
+          aql_State *co = thvalue(s2v(ra));
+          if (aqlD_costatus(L, co) == AQL_COS_DEAD)
+            setnilvalue(s2v(ra + 4));  /* exhausted: end the loop */
+          else {
+            int status;
+            Protect(status = aqlD_resumeco(L, co, NULL, ra + 4));
+            if (status == AQL_OK)  /* body returned? */
+              setnilvalue(s2v(ra + 4));  /* its result ends the loop */
+          }
+          vmbreak;
+        }
         /* push function and arguments */
         setobjs2s(L, ra + 4, ra);
         setobjs2s(L, ra + 5, ra + 1);
@@ -2221,10 +2111,76 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         vmbreak;
       }
       
+      vmcase(OP_ITER_INIT) {
+        /* containers and ranges get an integer cursor; other iterables
+           keep the generic-for state (nil) and are driven by OP_TFORCALL */
+        TValue *obj = s2v(ra);
+        if (ttiscontainer(obj) || ttisrange(obj)) {
+          setivalue(s2v(ra + 1), 0);
+        }
+        else if (ttisfunction(obj) || ttisthread(obj) || ttistable(obj)) {
+          setnilvalue(s2v(ra + 1));
+        }
+        else
+          halfProtect(aqlG_runerror(L, "attempt to iterate over a %s value",
+                                    aqlO_typename(obj)));
+        setnilvalue(s2v(ra + 2));
+        setnilvalue(s2v(ra + 3));
+        pc += GETARG_Bx(i);  /* jump to OP_ITER_NEXT */
+        vmbreak;
+      }
+      
+      vmcase(OP_ITER_NEXT) {
+        TValue *cursor = s2v(ra + 1);
+        if (ttisinteger(cursor)) {  /* native container walk? */
+          TValue *obj = s2v(ra);
+          size_t idx = l_castS2U(ivalue(cursor));
+          if (ttisdict(obj)) {  /* keys, in iteration order */
+            DictEntry *e = aqlD_nextentry(dictvalue(obj), &idx);
+            if (e == NULL) {
+              pc += 2;  /* done: skip OP_TFORCALL/OP_TFORLOOP */
+              vmbreak;
+            }
+            setobj2s(L, ra + 4, &e->key);
+          }
+          else if (ttisrange(obj)) {  /* numeric loop over start/step */
+            RangeObject *r = rangevalue(obj);
+            if (idx >= l_castS2U(r->count)) {
+              pc += 2;  /* done: skip OP_TFORCALL/OP_TFORLOOP */
+              vmbreak;
+            }
+            setivalue(s2v(ra + 4), aqlR_at(r, l_castU2S(idx)));
+            idx++;
+          }
+          else {  /* array, slice or vector: elements by position */
+            AQL_ContainerBase *c = containervalue(obj);
+            if (idx >= c->length) {
+              pc += 2;  /* done: skip OP_TFORCALL/OP_TFORLOOP */
+              vmbreak;
+            }
+            switch (ttisvector(obj) ? c->dtype : AQL_DATA_TYPE_ANY) {
+              case AQL_DATA_TYPE_INT64:
+                setivalue(s2v(ra + 4), ((int64_t *)c->data)[idx]);
+                break;
+              case AQL_DATA_TYPE_FLOAT64:
+                setfltvalue(s2v(ra + 4), ((double *)c->data)[idx]);
+                break;
+              default:
+                setobj2s(L, ra + 4, &((TValue *)c->data)[idx]);
+                break;
+            }
+            idx++;
+          }
+          setivalue(cursor, l_castU2S(idx));
+          pc -= GETARG_Bx(i);  /* jump back to the loop body */
+        }
+        /* else fall through to OP_TFORCALL */
+        vmbreak;
+      }
+      
       vmcase(OP_SETLIST) {
         int n = GETARG_B(i);
         unsigned int last = GETARG_C(i);
-        Table *h = hvalue(s2v(ra));
         if (n == 0)
           n = cast_int(L->top.p - ra) - 1;  /* get up to the top */
         else
@@ -2234,20 +2190,36 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
           last += GETARG_Ax(*pc) * (MAXARG_C + 1);
           pc++;
         }
-        if (last > aqlH_realasize(h))  /* needs more space? */
-          aqlH_resizearray(L, h, last);  /* preallocate it at once */
-        for (; n > 0; n--) {
-          TValue *val = s2v(ra + n);
-          setobj2t(L, &h->array[last - 1], val);
-          last--;
-          aqlC_barrierback(L, obj2gco(h), val);
+        if (ttisarray(s2v(ra)) || ttisslice(s2v(ra))) {
+          /* 数组容器：一次性写入 n 个值 (字面量已按精确长度预分配) */
+          AQL_ContainerBase *c = containervalue(s2v(ra));
+          TValue *dst;
+          int k;
+          if (last > c->length &&
+              acontainer_array_resize(L, c, last) != 0)
+            aqlG_runerror(L, "cannot grow array to %d elements", cast_int(last));
+          dst = (TValue *)c->data + (last - n);
+          for (k = 1; k <= n; k++)
+            setobj(L, dst++, s2v(ra + k));
+          vmbreak;
+        }
+        {
+          Table *h = hvalue(s2v(ra));
+          if (last > aqlH_realasize(h))  /* needs more space? */
+            aqlH_resizearray(L, h, last);  /* preallocate it at once */
+          for (; n > 0; n--) {
+            TValue *val = s2v(ra + n);
+            setobj2t(L, &h->array[last - 1], val);
+            last--;
+            aqlC_barrierback(L, obj2gco(h), val);
+          }
         }
         vmbreak;
       }
       
       vmcase(OP_CLOSURE) {
         Proto *p = cl->p->p[GETARG_Bx(i)];
-        halfProtect(pushclosure(L, p, cl->upvals, base, ra));
+        halfProtect(pushclosure(L, p, cl, base, ra));
         checkGC(L, ra + 1);
         vmbreak;
       }
@@ -2276,7 +2248,9 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         TMS tm = TM_ADD;
         TValue *v1 = vRB(i);
         TValue *v2 = vRC(i);
-        if (ttisstring(v1) || ttisstring(v2)) {
+        /* 构建器按其当前内容参与字符串拼接，结果是新字符串，构建器不变 */
+        if (ttisstring(v1) || ttisstring(v2) ||
+            ttisbuilder(v1) || ttisbuilder(v2)) {
           TValue s1;
           TValue s2;
           value_to_string_value(L, v1, &s1);
@@ -2552,6 +2526,14 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         vmbreak;
       }
       
+      vmcase(OP_TESTFUNC) {
+        /* 内联调用点的守卫：R[A] 仍是编译期内联的那个原型时才执行内联体 */
+        TValue *rb = KB(i);
+        int cond = ttisLclosure(s2v(ra)) && clLvalue(s2v(ra))->p == pvalue(rb);
+        docondjump();
+        vmbreak;
+      }
+      
       vmcase(OP_EQI) {
         int cond;
         int im = GETARG_sB(i);
@@ -2665,6 +2647,10 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         int container_type = GETARG_B(i);
         int size_or_capacity = GETARG_C(i);
         AQL_ContainerBase *container = NULL;
+        if (TESTARG_k(i)) {  /* exact size continues in OP_EXTRAARG */
+          size_or_capacity += GETARG_Ax(*pc) * (MAXARG_C + 1);
+          pc++;
+        }
         
         aql_debug("OP_NEWOBJECT: A=%d, B=%d, C=%d, ra=%p", 
                  GETARG_A(i), container_type, size_or_capacity, (void*)ra);
@@ -2718,9 +2704,46 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
       
       vmcase(OP_GETPROP) {
         TValue *rb = vRB(i);
-        TValue *rc = vRC(i);
+        TValue *rc = RKC(i);  /* k: constant key */
         int handled = 0;
         
+        /* 数组/切片 + 整数下标：内联边界检查，直接读取元素 */
+        if ((ttisarray(rb) || ttisslice(rb)) && ttisinteger(rc) &&
+            l_castS2U(ivalue(rc)) < containervalue(rb)->length) {
+          setobj2s(L, ra, &((TValue *)containervalue(rb)->data)[ivalue(rc)]);
+          vmbreak;
+        }
+        
+        /* range + 整数下标：由 start/step 直接计算，不物化；越界为 nil */
+        if (ttisrange(rb)) {
+          RangeObject *r = rangevalue(rb);
+          if (ttisinteger(rc) && l_castS2U(ivalue(rc)) < l_castS2U(r->count)) {
+            setivalue(s2v(ra), aqlR_at(r, ivalue(rc)));
+          }
+          else {
+            setnilvalue(s2v(ra));
+          }
+          vmbreak;
+        }
+        
+        /* 常量字符串键 + 带 shape 的字典：按站点内联缓存 (shape -> slot) */
+        if (TESTARG_k(i) && ttisdict(rb) && ttisshrstring(rc) &&
+            dictvalue(rb)->shape != NULL) {
+          Dict *dict = dictvalue(rb);
+          PropCache *ic = getpropcache(L, cl->p, pc);
+          if (ic->shape != dict->shape) {  /* miss: look the key up */
+            int slot = aqlD_shapeslot(dict->shape, tsvalue(rc));
+            if (slot >= 0) {
+              ic->shape = dict->shape;
+              ic->slot = slot;
+            }
+          }
+          if (ic->shape == dict->shape) {
+            setobj2s(L, ra, &dict->entries[ic->slot].value);
+            vmbreak;
+          }
+        }
+        
         aql_debug("OP_GETPROP: A=%d, B=%d, C=%d", GETARG_A(i), GETARG_B(i), GETARG_C(i));
         aql_debug("OP_GETPROP: ra=%p, rb=%p, rc=%p", (void*)ra, (void*)rb, (void*)rc);
         
@@ -2731,6 +2754,7 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
             handled = 1;
           } else {
             aql_debug("OP_GETPROP: dict 获取失败");
+            setnilvalue(s2v(ra));  /* 不存在的键读作 nil */
           }
         } else if (ttiscontainer(rb)) {
           AQL_ContainerBase *container = (AQL_ContainerBase*)containervalue(rb);
@@ -2766,7 +2790,7 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
               aql_debug("OP_GETPROP: 向量获取");
               if (ttisinteger(rc)) {
                 size_t idx = (size_t)ivalue(rc);
-                if (acontainer_array_get(L, container, idx, s2v(ra)) == 0) {
+                if (acontainer_vector_get(L, container, idx, s2v(ra)) == 0) {
                   aql_debug("OP_GETPROP: 向量获取成功");
                   handled = 1;
                 } else {
@@ -2798,6 +2822,15 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
         TValue *rc = vRC(i);
         int handled = 0;
         
+        /* 数组/切片 + 整数下标：内联边界检查，直接写入元素 */
+        if ((ttisarray(s2v(ra)) || ttisslice(s2v(ra))) && ttisinteger(rb)) {
+          AQL_ContainerBase *c = containervalue(s2v(ra));
+          if (l_castS2U(ivalue(rb)) < c->length && !acontainer_is_readonly(c)) {
+            setobj(L, &((TValue *)c->data)[ivalue(rb)], rc);
+            vmbreak;
+          }
+        }
+        
         aql_debug("OP_SETPROP: A=%d, B=%d, C=%d", GETARG_A(i), GETARG_B(i), GETARG_C(i));
         aql_debug("OP_SETPROP: ra=%p, rb=%p, rc=%p", (void*)ra, (void*)rb, (void*)rc);
         
@@ -2843,7 +2876,7 @@ void aqlV_execute2 (aql_State *L, CallInfo *ci) {
               if (ttisinteger(rb)) {
                 size_t idx = (size_t)ivalue(rb);
                 aql_debug("OP_SETPROP: 设置向量索引 %zu", idx);
-                if (acontainer_array_set(L, container, idx, rc) == 0) {
+                if (acontainer_vector_set(L, container, idx, rc) == 0) {
                   aql_debug("OP_SETPROP: 向量设置成功");
                   handled = 1;
                 } else {
@@ -180,4 +180,98 @@ void aqlZ_cleanup_string(aql_State *L, ZIO *z) {
     aqlM_freemem(L, z->data, sizeof(StringReaderData));
     z->data = NULL;
   }
-}
\ No newline at end of file
+}
+
+/*
+** File reader: hands the source to the lexer one AQL_BUFFERSIZE block
+** at a time, so loading a file needs no memory proportional to its size
+*/
+const char *aqlZ_file_reader(aql_State *L, void *data, size_t *size) {
+  FileReaderData *frd = (FileReaderData *)data;
+  UNUSED(L);
+  if (feof(frd->f)) {
+    *size = 0;
+    return NULL;
+  }
+  *size = fread(frd->buff, 1, sizeof(frd->buff), frd->f);
+  return (*size > 0) ? frd->buff : NULL;
+}
+/* --------- Output buffer --------- */
+
+/*
+** 'print' formats into a per-state buffer that goes to stdout in large
+** writes. Anything that writes to stdout directly must call
+** 'aqlZ_outflush' first to keep the output in order.
+*/
+void aqlZ_outflush (aql_State *L) {
+  global_State *g = G(L);
+  if (g->outn > 0) {
+    fwrite(g->outbuf, 1, g->outn, stdout);
+    g->outn = 0;
+  }
+  fflush(stdout);
+}
+
+/*
+** Returns room for 'n' bytes (n <= AQL_OUTBUFSIZE) at the end of the
+** buffer, flushing it if needed; commit with 'aqlZ_outaddsize'.
+*/
+char *aqlZ_outspace (aql_State *L, size_t n) {
+  global_State *g = G(L);
+  if (l_unlikely(g->outbuf == NULL))
+    g->outbuf = aqlM_newvector(L, AQL_OUTBUFSIZE, char);
+  else if (n > AQL_OUTBUFSIZE - g->outn)
+    aqlZ_outflush(L);
+  return g->outbuf + g->outn;
+}
+
+void aqlZ_outwrite (aql_State *L, const char *s, size_t l) {
+  global_State *g = G(L);
+  if (l == 0)  /* nothing to write ('s' may be NULL, e.g. an empty builder) */
+    return;
+  if (l <= AQL_OUTBUFSIZE - g->outn && g->outbuf != NULL) {  /* fast path */
+    memcpy(g->outbuf + g->outn, s, l);
+    g->outn += l;
+  }
+  else if (l >= AQL_OUTBUFSIZE) {  /* too large to buffer */
+    aqlZ_outflush(L);
+    fwrite(s, 1, l, stdout);
+  }
+  else {
+    memcpy(aqlZ_outspace(L, l), s, l);
+    g->outn += l;
+  }
+}
+
+/*
+** Called when a 'print' is complete
+*/
+void aqlZ_outendline (aql_State *L) {
+  if (G(L)->outmode == AQL_OUTLINE)
+    aqlZ_outflush(L);
+}
+
+/*
+** Sets the flush policy by name ("line", "block" or "explicit");
+** returns 0 for an unknown name.
+*/
+int aqlZ_setoutmode (aql_State *L, const char *mode) {
+  static const char *const names[] = {"line", "block", "explicit", NULL};
+  int i;
+  for (i = 0; names[i] != NULL; i++) {
+    if (strcmp(mode, names[i]) == 0) {
+      G(L)->outmode = i;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void aqlZ_outclose (aql_State *L) {
+  global_State *g = G(L);
+  if (g->outbuf != NULL) {
+    aqlZ_outflush(L);
+    aqlM_freearray(L, g->outbuf, AQL_OUTBUFSIZE);
+    g->outbuf = NULL;
+  }
+}
@@ -136,4 +136,22 @@ AQL_API int aqlZ_skip_bom(ZIO *z);  /* Skip UTF-8 BOM if present */
 AQL_API int aqlZ_getutf8(ZIO *z);     /* Read one UTF-8 character */
 AQL_API void aqlZ_pushutf8(aql_State *L, Mbuffer *buff, int cp);  /* Push UTF-8 character */
 
+/* --------- Output buffer --------- */
+
+/*
+** Flush policies for the output of 'print'
+*/
+#define AQL_OUTLINE	0	/* flush at the end of every 'print' */
+#define AQL_OUTBLOCK	1	/* flush when the buffer is full */
+#define AQL_OUTEXPLICIT	2	/* flush on 'flush()', errors and close only */
+
+AQL_API char *aqlZ_outspace(aql_State *L, size_t n);
+AQL_API void aqlZ_outwrite(aql_State *L, const char *s, size_t l);
+AQL_API void aqlZ_outendline(aql_State *L);
+AQL_API void aqlZ_outflush(aql_State *L);
+AQL_API int aqlZ_setoutmode(aql_State *L, const char *mode);
+AQL_API void aqlZ_outclose(aql_State *L);
+
+#define aqlZ_outaddsize(L,n)	(G(L)->outn += (n))
+
 #endif /* azio_h */ 
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include "aapi.h"
 #include "aparser.h"
 #include "arepl.h"
+#include "azio.h"
 #include "ajit.h"
 #include "adebug_user.h"
 
@@ -29,7 +30,9 @@ static void print_usage(const char *progname) {
     printf("  --version      Show version information\n");
     printf("  -i, --interactive  Enter interactive mode (default if no file)\n");
     printf("  -e <expr>      Evaluate expression directly\n");
-    printf("  --test         Run comprehensive arithmetic tests\n\n");
+    printf("  --test         Run comprehensive arithmetic tests\n");
+    printf("  --output <mode>  print flush policy: line, block or explicit\n");
+    printf("                 (default: $AQL_OUTPUT, else line on a terminal)\n\n");
     printf("Debug Options:\n");
     printf("  -v             详细模式 (词法+ AST +字节码 + 执行跟踪)\n");
     printf("  -vb            只输出字节码 (类似 luac -l)\n");
@@ -177,6 +180,7 @@ int main(int argc, char *argv[]) {
     int run_test = 0;
     const char *filename = NULL;
     const char *expression = NULL;
+    const char *outmode = getenv("AQL_OUTPUT");
     
     /* JIT configuration */
     int jit_mode = 1;  // 0=off, 1=auto, 2=force, 3=stats
@@ -242,6 +246,12 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[i], "--jit-stats") == 0) {
             show_jit_stats = 1;
             jit_mode = 1;
+        } else if (strcmp(argv[i], "--output") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --output requires a mode\n");
+                return 1;
+            }
+            outmode = argv[++i];
         } else if (strcmp(argv[i], "-e") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: -e requires an expression\n");
@@ -268,6 +278,16 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    /* print output policy; traces and the REPL write to stdout directly */
+    if (debug_flags != AQL_DEBUG_NONE || interactive || run_test ||
+        (!filename && !expression))
+        aqlZ_setoutmode(L, "line");
+    else if (outmode && !aqlZ_setoutmode(L, outmode)) {
+        fprintf(stderr, "Error: Unknown output mode '%s'\n", outmode);
+        aql_close(L);
+        return 1;
+    }
+    
     /* Initialize debug system */
     aqlD_init_debug();
     aqlD_set_debug_flags(debug_flags);
@@ -302,6 +322,7 @@ int main(int argc, char *argv[]) {
         /* Evaluate single expression */
         printf("Evaluating: %s\n", expression);
         if (execute_expression(L, expression, "=(command line)")) {
+            aqlZ_outflush(L);
             if (get_execution_result(L, &result_value)) {
                 printf("Result: ");
                 aqlP_print_value(result_value);
@@ -330,6 +351,8 @@ int main(int argc, char *argv[]) {
         aqlREPL_run(L);
     }
     
+    aqlZ_outflush(L);  /* pending print output goes before any report */
+    
     /* Show JIT statistics if requested */
     if (show_jit_stats && jit_mode > 0) {
         printf("\n=== JIT Performance Report ===\n");
@@ -0,0 +1,110 @@
+/*
+** hash_bench.c - string hash throughput and bucket distribution
+**
+** Compares the seeded word-at-a-time hash (aqlS_hash_data) with the
+** byte-at-a-time djb2 loop it replaced:
+**   1. throughput (MB/s) at several key lengths;
+**   2. bucket spread of sequential keys ("key0", "key1", ...);
+**   3. a collision flood: 2^12 keys built from the djb2-equal blocks
+**      "Ez"/"FY", which all share one djb2 hash.
+**
+** Build and run: make bench_hash
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "astring.h"
+
+#define NBUCKETS  (1 << 16)
+#define NKEYS     (1 << 16)
+#define FLOODBITS 12
+
+typedef unsigned int (*HashFn)(const char *s, size_t l, unsigned int seed);
+
+static unsigned int djb2 (const char *s, size_t l, unsigned int seed) {
+  unsigned int h = 5381;
+  size_t i;
+  (void)seed;
+  for (i = 0; i < l; i++)
+    h = ((h << 5) + h) + (unsigned char)s[i];
+  return h;
+}
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void throughput (const char *name, HashFn fn) {
+  static const size_t lens[] = {8, 16, 32, 64, 256, 4096};
+  char *buf = malloc(4096);
+  size_t i, j;
+  for (i = 0; i < 4096; i++) buf[i] = (char)('a' + (i * 7) % 26);
+  printf("%-8s", name);
+  for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    size_t total = (size_t)64 << 20;  /* 64 MB per length */
+    size_t n = total / lens[i];
+    volatile unsigned int sink = 0;
+    double t0 = now();
+    for (j = 0; j < n; j++)
+      sink += fn(buf, lens[i], (unsigned int)j);
+    printf(" %5zuB:%7.0f", lens[i], (double)total / (now() - t0) / 1e6);
+  }
+  printf("  MB/s\n");
+  free(buf);
+}
+
+/* max bucket load and chi-square / (nbuckets - 1): ~1.0 is ideal */
+static void spread (const char *name, HashFn fn, char **keys, int nkeys,
+                    unsigned int seed) {
+  static unsigned int count[NBUCKETS];
+  double expect = (double)nkeys / NBUCKETS, chi = 0;
+  unsigned int maxload = 0;
+  int i;
+  memset(count, 0, sizeof(count));
+  for (i = 0; i < nkeys; i++)
+    count[fn(keys[i], strlen(keys[i]), seed) & (NBUCKETS - 1)]++;
+  for (i = 0; i < NBUCKETS; i++) {
+    double d = count[i] - expect;
+    chi += d * d / expect;
+    if (count[i] > maxload) maxload = count[i];
+  }
+  printf("  %-8s max bucket %6u   chi2/df %8.2f\n", name, maxload,
+         chi / (NBUCKETS - 1));
+}
+
+int main (void) {
+  static char *seq[NKEYS], *flood[1 << FLOODBITS];
+  unsigned int seed = (unsigned int)time(NULL);
+  int i, b;
+
+  printf("== throughput ==\n");
+  throughput("djb2", djb2);
+  throughput("seeded", aqlS_hash_data);
+
+  for (i = 0; i < NKEYS; i++) {
+    seq[i] = malloc(16);
+    snprintf(seq[i], 16, "key%d", i);
+  }
+  printf("== %d sequential keys, %d buckets ==\n", NKEYS, NBUCKETS);
+  spread("djb2", djb2, seq, NKEYS, seed);
+  spread("seeded", aqlS_hash_data, seq, NKEYS, seed);
+
+  for (i = 0; i < (1 << FLOODBITS); i++) {
+    flood[i] = malloc(2 * FLOODBITS + 1);
+    for (b = 0; b < FLOODBITS; b++)
+      memcpy(flood[i] + 2 * b, (i >> b) & 1 ? "Ez" : "FY", 2);
+    flood[i][2 * FLOODBITS] = '\0';
+  }
+  printf("== flood: %d keys with one djb2 hash ==\n", 1 << FLOODBITS);
+  spread("djb2", djb2, flood, 1 << FLOODBITS, seed);
+  spread("seeded", aqlS_hash_data, flood, 1 << FLOODBITS, seed);
+
+  for (i = 0; i < NKEYS; i++) free(seq[i]);
+  for (i = 0; i < (1 << FLOODBITS); i++) free(flood[i]);
+  return 0;
+}
@@ -0,0 +1,104 @@
+/*
+** tailcall_bench.c - stack use and speed of deep tail recursion
+**
+** Runs tail-recursive AQL functions at growing depths and reports, after
+** each run, the stack size and the number of CallInfo nodes of the
+** state. Proper tail calls reuse the caller's frame, so both stay flat
+** up to 10M iterations:
+**   1. a counting loop written as self tail recursion;
+**   2. a two-state machine of mutually tail-calling functions;
+**   3. a vararg function tail-calling itself.
+** A plain (non-tail) recursion is run last for contrast. Each line also
+** tells whether the stack is a reserved mapping (AQL_MMAPSTACK) or an
+** ordinary block, so a build that lost the mapped stacks shows up here.
+**
+** Build and run: make bench_tailcall
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "aql.h"
+#include "aapi.h"
+#include "astate.h"
+
+static const char *const programs[] = {
+  "function loop(n, acc) {\n"
+  "  if n == 0 { return acc }\n"
+  "  return loop(n - 1, acc + 1)\n"
+  "}\n"
+  "loop(%d, 0)\n",
+
+  "function ping(n) { if n == 0 { return 0 } return pong(n - 1) }\n"
+  "function pong(n) { if n == 0 { return 1 } return ping(n - 1) }\n"
+  "ping(%d)\n",
+
+  "function va(n, ...) {\n"
+  "  if n == 0 { return 0 }\n"
+  "  return va(n - 1, n, n)\n"
+  "}\n"
+  "va(%d)\n",
+
+  "function deep(n) {\n"
+  "  if n == 0 { return 0 }\n"
+  "  return 1 + deep(n - 1)\n"
+  "}\n"
+  "deep(%d)\n",
+};
+
+static const char *const names[] = {"self", "mutual", "vararg", "no tail"};
+
+static double now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud; (void)osize;
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, nsize);
+}
+
+static int countci (aql_State *L) {
+  CallInfo *ci;
+  int n = 0;
+  for (ci = L->base_ci.next; ci != NULL; ci = ci->next)
+    n++;
+  return n;
+}
+
+/* run program 'p' at depth 'depth' in a fresh state */
+static void run (int p, int depth) {
+  char src[512];
+  aql_State *L = aql_newstate(alloc, NULL);
+  double t0;
+  int ok;
+  snprintf(src, sizeof(src), programs[p], depth);
+  t0 = now();
+  ok = (aqlP_compile_string(L, src, strlen(src), "=bench") == 0 &&
+        aqlP_execute_compiled(L, 0, 0) == 1);
+  printf("  %-8s %9d  %8.3fs  stack %7d slots (%s)  %5d CallInfo  %s\n",
+         names[p], depth, now() - t0, stacksize(L),
+         L->stackmapped ? "mapped" : "realloc", countci(L),
+         ok ? "ok" : "FAILED");
+  aql_close(L);
+}
+
+int main (void) {
+  static const int depths[] = {10000, 100000, 1000000, 10000000};
+  int p, d;
+  printf("== tail calls ==\n");
+  for (p = 0; p < 3; p++)
+    for (d = 0; d < (int)(sizeof(depths) / sizeof(depths[0])); d++)
+      run(p, depths[d]);
+  printf("== plain recursion ==\n");
+  run(3, 10000);
+  run(3, 100000);
+  return 0;
+}
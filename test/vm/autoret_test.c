@@ -0,0 +1,112 @@
+/*
+** autoret_test.c - chunks loaded with mode "r" return their last expression
+**
+** Loads each chunk through 'aql_load' with mode "r", runs it and checks
+** the returned value: a trailing call, a trailing expression after an
+** 'if' block, a call in the middle of the chunk (which must not return)
+** and an indexed store. Also checks that load failures report the
+** parser status.
+**
+** Build and run: make test_autoret
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aql.h"
+#include "aapi.h"
+#include "aobject.h"
+#include "astate.h"
+
+typedef struct Source {
+  const char *s;
+  size_t size;
+} Source;
+
+static int failures = 0;
+
+static void *alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud; (void)osize;
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, nsize);
+}
+
+static const char *reader (aql_State *L, void *ud, size_t *size) {
+  Source *src = (Source *)ud;
+  (void)L;
+  *size = src->size;
+  src->size = 0;  /* whole chunk in one block */
+  return (*size > 0) ? src->s : NULL;
+}
+
+static int load (aql_State *L, const char *chunk, const char *mode) {
+  Source src;
+  src.s = chunk;
+  src.size = strlen(chunk);
+  return aql_load(L, reader, &src, "=autoret", mode);
+}
+
+static void checkreturn (const char *what, const char *chunk,
+                         aql_Integer expected) {
+  aql_State *L = aql_newstate(alloc, NULL);
+  int status = load(L, chunk, "r");
+  if (status != AQL_OK)
+    fprintf(stderr, "autoret: %s: load failed (%d)\n", what, status);
+  else if (aql_execute(L, 0, 1) != 0)
+    fprintf(stderr, "autoret: %s: run failed\n", what);
+  else {
+    const TValue *v = s2v(L->top.p - 1);
+    if (ttisinteger(v) && ivalue(v) == expected) {
+      aql_close(L);
+      return;
+    }
+    fprintf(stderr, "autoret: %s: expected %lld\n", what,
+            (long long)expected);
+  }
+  failures++;
+  aql_close(L);
+}
+
+static void checkstatus (const char *what, int status, int expected) {
+  if (status != expected) {
+    fprintf(stderr, "autoret: %s: status %d, expected %d\n",
+            what, status, expected);
+    failures++;
+  }
+}
+
+int main (void) {
+  aql_State *L;
+  checkreturn("trailing call",
+              "function twice(x) { return x * 2 }\n"
+              "twice(21)\n", 42);
+  checkreturn("expression after if block",
+              "let x = 1\n"
+              "if x > 0 {\n"
+              "  x = 5\n"
+              "}\n"
+              "x + 1\n", 6);
+  checkreturn("mid-chunk call",
+              "function inc(x) { return x + 1 }\n"
+              "inc(1)\n"
+              "let y = inc(40)\n"
+              "y + 1;\n", 42);
+  checkreturn("indexed store",
+              "let a = [1, 2]\n"
+              "a[1] = 5\n"
+              "a[1] + 1\n", 6);
+  L = aql_newstate(alloc, NULL);
+  checkstatus("syntax error", load(L, "let = 1\n", "r"), AQL_ERRSYNTAX);
+  checkstatus("expression without mode \"r\"", load(L, "1 + 2\n", NULL),
+              AQL_ERRSYNTAX);
+  checkstatus("missing file",
+              aql_loadfile_with_return(L, "/nonexistent/autoret.aql"),
+              AQL_ERRFILE);
+  aql_close(L);
+  printf("autoret: %s\n", failures == 0 ? "ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
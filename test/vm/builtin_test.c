@@ -0,0 +1,162 @@
+/*
+** builtin_test.c - builtins registered by the host through the public API
+**
+** Registers C functions with 'aql_registerbuiltin' and calls them from
+** scripts loaded with mode "r": direct calls, a variadic builtin, one
+** that returns nil, one that leaves extra values on the stack, and calls
+** with the wrong number of arguments.
+** Registering a name again keeps its id.
+**
+** Build and run: make test_builtin
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aql.h"
+#include "aapi.h"
+#include "aobject.h"
+#include "astate.h"
+
+typedef struct Source {
+  const char *s;
+  size_t size;
+} Source;
+
+static int failures = 0;
+
+static void *alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud; (void)osize;
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, nsize);
+}
+
+static const char *reader (aql_State *L, void *ud, size_t *size) {
+  Source *src = (Source *)ud;
+  (void)L;
+  *size = src->size;
+  src->size = 0;  /* whole chunk in one block */
+  return (*size > 0) ? src->s : NULL;
+}
+
+/* addmul(a, b, c) = a * b + c */
+static int addmul (aql_State *L, int base, int nargs) {
+  (void)nargs;
+  aql_pushinteger(L, aql_tointeger(L, base) * aql_tointeger(L, base + 1)
+                     + aql_tointeger(L, base + 2));
+  return 1;
+}
+
+/* sum(...) of any number of integers */
+static int sum (aql_State *L, int base, int nargs) {
+  aql_Integer s = 0;
+  int i;
+  for (i = 0; i < nargs; i++)
+    s += aql_tointeger(L, base + i);
+  aql_pushinteger(L, s);
+  return 1;
+}
+
+/* nothing() returns nil */
+static int nothing (aql_State *L, int base, int nargs) {
+  (void)L; (void)base; (void)nargs;
+  return 0;
+}
+
+/* last(n) pushes 1 ... n and returns the last one pushed */
+static int last (aql_State *L, int base, int nargs) {
+  aql_Integer n = aql_tointeger(L, base), i;
+  (void)nargs;
+  for (i = 1; i <= n; i++)
+    aql_pushinteger(L, i);
+  return 1;
+}
+
+static aql_State *newstate (void) {
+  aql_State *L = aql_newstate(alloc, NULL);
+  char name[16];
+  strcpy(name, "addmul");
+  aql_registerbuiltin(L, name, addmul, 3, 3);
+  strcpy(name, "xxxxxx");  /* the registry keeps its own copy */
+  aql_registerbuiltin(L, "sum", sum, 0, AQL_BUILTIN_VARARG);
+  aql_registerbuiltin(L, "nothing", nothing, 0, 0);
+  aql_registerbuiltin(L, "last", last, 1, 1);
+  return L;
+}
+
+/* run 'chunk' in a fresh state; returns its status and leaves 'L' open */
+static int run (aql_State **pL, const char *chunk) {
+  Source src;
+  int status;
+  *pL = newstate();
+  src.s = chunk;
+  src.size = strlen(chunk);
+  status = aql_load(*pL, reader, &src, "=builtin", "r");
+  if (status == AQL_OK)
+    status = aql_execute(*pL, 0, 1);
+  return status;
+}
+
+static void checkreturn (const char *what, const char *chunk,
+                         aql_Integer expected) {
+  aql_State *L;
+  if (run(&L, chunk) != 0)
+    fprintf(stderr, "builtin: %s: run failed\n", what);
+  else {
+    const TValue *v = s2v(L->top.p - 1);
+    if (ttisinteger(v) && ivalue(v) == expected) {
+      aql_close(L);
+      return;
+    }
+    fprintf(stderr, "builtin: %s: expected %lld\n", what,
+            (long long)expected);
+  }
+  failures++;
+  aql_close(L);
+}
+
+static void checknil (const char *what, const char *chunk) {
+  aql_State *L;
+  if (run(&L, chunk) != 0 || !ttisnil(s2v(L->top.p - 1))) {
+    fprintf(stderr, "builtin: %s: expected nil\n", what);
+    failures++;
+  }
+  aql_close(L);
+}
+
+static void checkerror (const char *what, const char *chunk) {
+  aql_State *L;
+  if (run(&L, chunk) == 0) {
+    fprintf(stderr, "builtin: %s: expected an error\n", what);
+    failures++;
+  }
+  aql_close(L);
+}
+
+int main (void) {
+  aql_State *L = newstate();
+  int id = aql_registerbuiltin(L, "sum", sum, 0, AQL_BUILTIN_VARARG);
+  if (id < 0 || aql_registerbuiltin(L, "sum", sum, 1, 1) != id) {
+    fprintf(stderr, "builtin: re-registering changed the id\n");
+    failures++;
+  }
+  aql_close(L);
+  checkreturn("direct call", "addmul(6, 7, 0)\n", 42);
+  checkreturn("call in an expression",
+              "let x = 5\n"
+              "addmul(x, 2, 1) + 1\n", 12);
+  checkreturn("variadic", "sum() + sum(1) + sum(1, 2, 3)\n", 7);
+  checkreturn("extra values left on the stack",
+              "let a = 1\n"
+              "let b = last(15)\n"
+              "a + b\n", 16);
+  checknil("nil result", "nothing()\n");
+  checkerror("too few arguments", "addmul(1, 2)\n");
+  checkerror("too many arguments", "nothing(1)\n");
+  printf("builtin: %s\n", failures == 0 ? "ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+/*
+** format_test.c - conversions of aqlS_formatf
+**
+** Checks each printf conversion with flags, field widths, precisions
+** and length modifiers, plus the number formatting shared with
+** 'tostring': '%f' without a precision and number-to-string conversion
+** print '%.14g' style.
+**
+** Build and run: make test_format
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aql.h"
+#include "aobject.h"
+#include "astate.h"
+#include "astring.h"
+
+static int failures = 0;
+
+static void *alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud; (void)osize;
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, nsize);
+}
+
+static void check (const char *fmt, const char *expected, TString *ts) {
+  if (tsslen(ts) != strlen(expected) ||
+      memcmp(getstr(ts), expected, tsslen(ts)) != 0) {
+    fprintf(stderr, "format: \"%s\": expected \"%s\", got \"%.*s\"\n",
+            fmt, expected, (int)tsslen(ts), getstr(ts));
+    failures++;
+  }
+}
+
+#define CHECK(L,expected,fmt,...) \
+  check(fmt, expected, aqlS_formatf(L, fmt, __VA_ARGS__))
+
+static void checknumber (aql_State *L, double x, const char *expected) {
+  TValue v;
+  char buff[MAXNUMBER2STR];
+  setfltvalue(&v, x);
+  check("tostring", expected, aqlStr_fromnumber(L, &v));
+  aqlO_fmtflt(buff, x);
+  check("aqlO_fmtflt", expected, aqlStr_new(L, buff));
+}
+
+int main (void) {
+  aql_State *L = aql_newstate(alloc, NULL);
+  char longs[600], expected[700];
+  int dummy;
+  /* integers */
+  CHECK(L, "42 -7", "%d %i", 42, -7);
+  CHECK(L, "4294967295", "%u", 4294967295u);
+  CHECK(L, "ff FF 0xff 377", "%x %X %#x %o", 255, 255, 255, 255);
+  CHECK(L, "9223372036854775807", "%lld", 9223372036854775807LL);
+  CHECK(L, "-9000000000", "%ld", -9000000000L);
+  CHECK(L, "ffffffffffffffff", "%llx", 0xffffffffffffffffULL);
+  CHECK(L, "123456", "%zu", (size_t)123456);
+  CHECK(L, "-1", "%hhd", 255);
+  CHECK(L, "-9223372036854775808", "%I", (long long)(-9223372036854775807LL - 1));
+  /* field widths, flags and precision */
+  CHECK(L, "[   42]", "[%5d]", 42);
+  CHECK(L, "[42   ]", "[%-5d]", 42);
+  CHECK(L, "[00042]", "[%05d]", 42);
+  CHECK(L, "[+42]", "[%+d]", 42);
+  CHECK(L, "[ 42]", "[% d]", 42);
+  CHECK(L, "[  0x2a]", "[%#6x]", 42);
+  CHECK(L, "[  042]", "[%5.3d]", 42);
+  CHECK(L, "[    7]", "[%*d]", 5, 7);
+  CHECK(L, "[7    ]", "[%*d]", -5, 7);
+  CHECK(L, "[  abc]", "[%5s]", "abc");
+  CHECK(L, "[abc  ]", "[%-5s]", "abc");
+  CHECK(L, "[ab]", "[%.2s]", "abcdef");
+  CHECK(L, "[abc]", "[%.*s]", 3, "abcdef");
+  CHECK(L, "[    -12]", "[%7I]", (long long)-12);
+  /* characters, strings, pointers, literal '%' */
+  CHECK(L, "x", "%c", 'x');
+  CHECK(L, "hello (null)", "%s %s", "hello", (char *)NULL);
+  {
+    char p[32];
+    snprintf(p, sizeof(p), "%p", (void *)&dummy);
+    CHECK(L, p, "%p", (void *)&dummy);
+  }
+  CHECK(L, "100%", "%d%%", 100);
+  /* floats: '%f' prints as tostring, the rest as printf */
+  CHECK(L, "0.1 2.5 3", "%f %f %f", 0.1, 2.5, 3.0);
+  CHECK(L, "0.33333333333333", "%f", 1.0 / 3.0);
+  CHECK(L, "[    2.5]", "[%7f]", 2.5);
+  CHECK(L, "[2.5    ]", "[%-7f]", 2.5);
+  CHECK(L, "[-0002.5]", "[%07f]", -2.5);
+  CHECK(L, "[+2.5]", "[%+f]", 2.5);
+  CHECK(L, "3.14 3.142", "%.2f %.*f", 3.14159, 3, 3.14159);
+  CHECK(L, "1.500000e+00 1.5E+00", "%e %.1E", 1.5, 1.5);
+  CHECK(L, "0.0001 1E-05", "%g %G", 0.0001, 0.00001);
+  CHECK(L, "0x1p+0", "%a", 1.0);
+  CHECK(L, "inf -inf", "%f %f", 1.0 / 0.0, -1.0 / 0.0);
+  /* unknown conversions are copied; long results */
+  CHECK(L, "%y 5", "%y %d", 5);
+  memset(longs, 'a', sizeof(longs) - 1);
+  longs[sizeof(longs) - 1] = '\0';
+  snprintf(expected, sizeof(expected), "<%s|%d>", longs, 12345);
+  CHECK(L, expected, "<%s|%d>", longs, 12345);
+  /* number-to-string */
+  checknumber(L, 0.1 + 0.2, "0.3");
+  checknumber(L, 1.0 / 3.0, "0.33333333333333");
+  checknumber(L, 3.141592653589793, "3.1415926535898");
+  checknumber(L, 123456789012345.0, "1.2345678901234e+14");
+  checknumber(L, 12345678901234.0, "12345678901234");
+  checknumber(L, 1e14, "1e+14");
+  checknumber(L, 0.0001, "0.0001");
+  checknumber(L, 0.00001, "1e-05");
+  checknumber(L, -2.5, "-2.5");
+  checknumber(L, 5e-324, "4.9406564584125e-324");
+  aql_close(L);
+  printf("format: %s\n", failures == 0 ? "ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
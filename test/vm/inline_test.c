@@ -0,0 +1,82 @@
+/*
+** inline_test.c - call sites that fall back from inlining leave no code
+**
+** Compiles calls to a small global function and checks the emitted
+** code: a call that keeps one result is inlined (guard plus copied
+** body), while a tail call and a multiple assignment, which need the
+** regular call, keep neither the guard nor the copied body.
+**
+** Build and run: make test_inline
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aql.h"
+#include "aapi.h"
+#include "aobject.h"
+#include "aopcodes.h"
+#include "astate.h"
+
+static const char program[] =
+  "function sq(x) { return x * x }\n"
+  "function use() { return sq(7) }\n"
+  "function keep() {\n"
+  "  let y = sq(7)\n"
+  "  return y\n"
+  "}\n"
+  "let c, d = sq(3)\n";
+
+static int failures = 0;
+
+static void *alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud; (void)osize;
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, nsize);
+}
+
+static int count (const Proto *p, OpCode op) {
+  int pc, n = 0;
+  for (pc = 0; pc < p->sizecode; pc++)
+    if (GET_OPCODE(p->code[pc]) == op)
+      n++;
+  return n;
+}
+
+static void check (const char *what, int ok) {
+  if (!ok) {
+    fprintf(stderr, "inline: %s\n", what);
+    failures++;
+  }
+}
+
+int main (void) {
+  aql_State *L = aql_newstate(alloc, NULL);
+  Proto *chunk, *use, *keep;
+  if (aqlP_compile_string(L, program, strlen(program), "=inline") != 0) {
+    fprintf(stderr, "inline: compile failed\n");
+    return 1;
+  }
+  chunk = clLvalue(s2v(L->top.p - 1))->p;
+  if (chunk->sizep < 3) {
+    fprintf(stderr, "inline: expected three functions\n");
+    return 1;
+  }
+  use = chunk->p[1];
+  keep = chunk->p[2];
+  check("single-result call not inlined", count(keep, OP_TESTFUNC) == 1);
+  check("inlined body missing", count(keep, OP_MUL) == 1);
+  check("tail call kept the guard", count(use, OP_TESTFUNC) == 0);
+  check("tail call kept the body", count(use, OP_MUL) == 0);
+  check("tail call not emitted", count(use, OP_TAILCALL) == 1);
+  check("multiple assignment kept the guard", count(chunk, OP_TESTFUNC) == 0);
+  check("multiple assignment kept the body", count(chunk, OP_MUL) == 0);
+  check("multiple assignment has no call", count(chunk, OP_CALL) == 1);
+  aql_close(L);
+  printf("inline: %s\n", failures == 0 ? "ok" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
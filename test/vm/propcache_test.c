@@ -0,0 +1,87 @@
+/*
+** propcache_test.c - OP_GETPROP inline caches are filled by real scripts
+**
+** Compiles a chunk with three constant-key reads, runs it, and checks
+** the per-instruction caches of the main function:
+**   1. a site that only sees one shape caches it with the key's slot;
+**   2. a site fed two shapes ends up caching the last one;
+**   3. a site reading a promoted dict (no shape) stays empty.
+**
+** Build and run: make test_propcache
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aql.h"
+#include "aapi.h"
+#include "adict.h"
+#include "aobject.h"
+#include "aopcodes.h"
+#include "astate.h"
+
+static const char program[] =
+  "let a = {x: 1, y: 2}\n"
+  "let b = {y: 3, x: 4}\n"
+  "let big = {k1: 1, k2: 2, k3: 3, k4: 4, k5: 5, k6: 6, k7: 7, k8: 8, y: 9}\n"
+  "let s = 0\n"
+  "for i in range(10) {\n"
+  "  s = s + a[\"y\"]\n"
+  "}\n"
+  "for d in [a, b] {\n"
+  "  s = s + d[\"y\"]\n"
+  "}\n"
+  "s = s + big[\"y\"]\n";
+
+static void *alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud; (void)osize;
+  if (nsize == 0) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, nsize);
+}
+
+static int check (const char *what, int ok) {
+  if (!ok)
+    fprintf(stderr, "propcache: %s\n", what);
+  return ok;
+}
+
+int main (void) {
+  aql_State *L = aql_newstate(alloc, NULL);
+  const PropCache *site[3];
+  Proto *p;
+  int pc, n = 0, ok = 1;
+  if (aqlP_compile_string(L, program, strlen(program), "=propcache") != 0) {
+    fprintf(stderr, "propcache: compile failed\n");
+    return 1;
+  }
+  p = clLvalue(s2v(L->top.p - 1))->p;
+  setobj2s(L, L->top.p, s2v(L->top.p - 1));  /* keep the chunk anchored */
+  L->top.p++;
+  if (aqlP_execute_compiled(L, 0, 0) != 1) {
+    fprintf(stderr, "propcache: run failed\n");
+    return 1;
+  }
+  if (!check("no cache allocated", p->propcache != NULL))
+    return 1;
+  for (pc = 0; pc < p->sizecode && n < 3; pc++) {
+    Instruction i = p->code[pc];
+    if (GET_OPCODE(i) == OP_GETPROP && TESTARG_k(i))
+      site[n++] = &p->propcache[pc];
+  }
+  if (!check("expected three constant-key reads", n == 3))
+    return 1;
+  ok &= check("single-shape site not cached", site[0]->shape != NULL);
+  ok &= check("single-shape site has wrong slot", site[0]->slot == 1);
+  ok &= check("two-shape site not cached", site[1]->shape != NULL);
+  ok &= check("two-shape site kept the first shape",
+              site[1]->shape != site[0]->shape);
+  ok &= check("two-shape site has wrong slot", site[1]->slot == 0);
+  ok &= check("promoted dict was cached", site[2]->shape == NULL);
+  aql_close(L);
+  printf("propcache: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}